@@ -0,0 +1,81 @@
+#include <vector>
+
+#include "acknowledger.hh"
+
+using namespace std;
+
+/* a sender silent this long is forgotten, so a long-running receiver
+   doesn't keep state for every source port it has ever seen; idle flows
+   are looked for this often */
+static const uint64_t FLOW_IDLE_MS = 60000;
+static const uint64_t FLOW_SWEEP_INTERVAL_MS = 10000;
+
+Acknowledger::Acknowledger( StreamReceiver * const stream, TraceWriter * const trace )
+  : flows_(), next_sweep_( 0 ), stream_( stream ), trace_( trace )
+{}
+
+/* forget the flows idle since before now - FLOW_IDLE_MS */
+void Acknowledger::expire_flows( const uint64_t now )
+{
+  vector<FlowKey> idle;
+  flows_.for_each( [&] ( const FlowKey & key, const Flow & flow ) {
+      if ( flow.last_seen + FLOW_IDLE_MS < now ) {
+	idle.push_back( key );
+      }
+    } );
+
+  for ( const auto & key : idle ) {
+    flows_.erase( key );
+  }
+}
+
+/* acknowledge a datagram back to its source */
+void Acknowledger::receive( UDPSocket & socket, const UDPSocket::received_datagram & recd )
+{
+  ContestMessage message = recd.payload;
+
+  if ( recd.timestamp >= next_sweep_ ) {
+    expire_flows( recd.timestamp );
+    next_sweep_ = recd.timestamp + FLOW_SWEEP_INTERVAL_MS;
+  }
+
+  Flow & flow = flows_[ FlowKey( recd.source_address ) ];
+  flow.last_seen = recd.timestamp;
+
+  if ( trace_ ) {
+    trace_->arrival( recd.timestamp_us, recd.payload.size(), message.header.sequence_number );
+  }
+
+  /* count congestion marks from the path */
+  if ( (recd.tos & Socket::ECN_MASK) == Socket::ECN_CE ) {
+    flow.ce_count++;
+  }
+
+  /* parity isn't acked itself, but may rebuild a lost datagram to ack in its place */
+  const bool recovered = is_parity( message );
+  if ( recovered ) {
+    if ( not flow.fec.recover( ContestMessage( message ), message ) ) {
+      return;
+    }
+  } else {
+    flow.fec.add( message );
+  }
+
+  if ( stream_ and not is_message_segment( message.payload ) ) {
+    stream_->receive( message.payload );
+  }
+
+  /* assemble the acknowledgment */
+  message.transform_into_ack( flow.sequence_number++, recd.timestamp, flow.ce_count );
+  if ( recovered ) {
+    message.header.ack_payload_length |= FEC_RECOVERED_FLAG;
+  }
+  if ( stream_ ) {
+    message.payload = stream_->ack();
+  }
+
+  /* timestamp the ack just before sending */
+  message.set_send_timestamp();
+
+  socket.try_sendto( recd.source_address, message.to_string() );
+}
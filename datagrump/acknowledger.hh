@@ -0,0 +1,49 @@
+#ifndef ACKNOWLEDGER_HH
+#define ACKNOWLEDGER_HH
+
+#include <cstdint>
+
+#include "byte_stream.hh"
+#include "fec.hh"
+#include "flow_key.hh"
+#include "socket.hh"
+#include "trace.hh"
+
+/* The receiving end of datagrump, as receiver.cc and the benchmark both
+   run it: acknowledges every datagram back to its source, numbering each
+   flow's acks and counting its congestion marks, acks datagrams that
+   parity rebuilds in place of lost ones, and (in stream mode) reassembles
+   the stream and says in each ack how far it got. Flows are told apart by
+   source address, and one that goes quiet for a minute is forgotten (its
+   next datagram starts a new flow). */
+class Acknowledger
+{
+private:
+  struct Flow
+  {
+    uint64_t sequence_number = 0; /* of the next ack */
+    uint64_t ce_count = 0;
+    FecDecoder fec {};
+    uint64_t last_seen = 0; /* when its latest datagram arrived (ms) */
+  };
+
+  FlowMap<Flow> flows_;
+  uint64_t next_sweep_;
+
+  StreamReceiver * stream_; /* optional */
+  TraceWriter * trace_; /* optional: log each arrival */
+
+  void expire_flows( const uint64_t now );
+
+public:
+  Acknowledger( StreamReceiver * const stream, TraceWriter * const trace );
+
+  Acknowledger( const Acknowledger & other ) = delete;
+  Acknowledger & operator=( const Acknowledger & other ) = delete;
+
+  /* acknowledge a datagram that arrived on socket (if the socket buffer
+     is full, the ack is dropped; a later ack covers it) */
+  void receive( UDPSocket & socket, const UDPSocket::received_datagram & recd );
+};
+
+#endif /* ACKNOWLEDGER_HH */
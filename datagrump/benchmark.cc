@@ -0,0 +1,652 @@
+/* self-contained loopback benchmark: sender -> bottleneck -> receiver */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "datagrump_sender.hh"
+#include "acknowledger.hh"
+#include "delivery_log.hh"
+#include "fec.hh"
+#include "flow_key.hh"
+#include "header_codec.hh"
+#include "poller.hh"
+#include "timestamp.hh"
+#include "trace.hh"
+#include "util.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* size of a link delivery opportunity in a mahimahi trace */
+static const uint64_t TRACE_OPPORTUNITY_BYTES = 1504;
+
+/* CPU time consumed by the calling thread, in nanoseconds */
+static uint64_t thread_cpu_ns( void )
+{
+  timespec ts;
+  SystemCall( "clock_gettime", clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts ) );
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* monotonic time in microseconds (finer than timestamp_ms, for the link model) */
+static uint64_t now_us( void )
+{
+  return chrono::duration_cast<chrono::microseconds>( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+/* synthetic bottleneck: random (non-congestive) loss, fixed delay, drop-tail queue
+   (optionally marking ECN-capable datagrams that have queued too long), then a
+   token-bucket or trace-driven link; what happens to each datagram can be logged */
+class Bottleneck
+{
+private:
+  struct Packet
+  {
+    uint64_t eligible_us; /* arrival time plus propagation delay */
+    string payload;
+    uint8_t tos;
+    uint32_t sequence_number; /* for the log */
+  };
+
+  uint64_t delay_us_;
+  size_t queue_limit_;
+  uint64_t mark_threshold_us_; /* zero: never mark */
+  deque<Packet> queue_;
+
+  double loss_rate_;
+  minstd_rand random_;
+  uniform_real_distribution<double> uniform_;
+
+  /* token bucket (rate of zero means an unlimited link) */
+  double bytes_per_us_;
+  double tokens_;
+  double bucket_depth_;
+  uint64_t last_refill_us_;
+
+  /* mahimahi-style trace of delivery opportunities (in ms, repeating) */
+  vector<uint64_t> trace_ms_;
+  size_t trace_index_;
+  uint64_t trace_base_us_;
+
+  DeliveryLogWriter * log_; /* optional */
+
+  void log( const uint64_t now, const uint32_t bytes, const uint32_t sequence_number,
+	    const DeliveryEventType type )
+  {
+    if ( log_ ) {
+      log_->log( { now, bytes, sequence_number, type } );
+    }
+  }
+
+  uint64_t next_opportunity_us( void ) const
+  {
+    return trace_base_us_ + trace_ms_.at( trace_index_ ) * 1000;
+  }
+
+  /* hand the head of the queue to the link, marking it CE if it waited too long */
+  template <typename Callback>
+  void deliver_head( const uint64_t now, const Callback & deliver )
+  {
+    Packet & p = queue_.front();
+    if ( mark_threshold_us_
+	 and (p.tos & Socket::ECN_MASK) != 0
+	 and now > p.eligible_us + mark_threshold_us_ ) {
+      p.tos |= Socket::ECN_CE;
+      marked++;
+    }
+    log( now, p.payload.size(), p.sequence_number, DeliveryEventType::Departure );
+    deliver( p.payload, p.tos );
+    queue_.pop_front();
+  }
+
+  void advance_opportunity( void )
+  {
+    if ( ++trace_index_ == trace_ms_.size() ) {
+      trace_index_ = 0;
+      trace_base_us_ += trace_ms_.back() * 1000;
+    }
+  }
+
+public:
+  uint64_t dropped, lost, marked;
+
+  Bottleneck( const double rate_mbps, const string & trace_filename,
+	      const uint64_t delay_ms, const size_t queue_limit,
+	      const uint64_t mark_threshold_ms, const double loss_rate )
+    : delay_us_( delay_ms * 1000 ), queue_limit_( queue_limit ),
+      mark_threshold_us_( mark_threshold_ms * 1000 ), queue_(),
+      loss_rate_( loss_rate ), random_( 1 ), uniform_( 0, 1 ),
+      bytes_per_us_( rate_mbps / 8 ), tokens_( 0 ), bucket_depth_( 10 * TRACE_OPPORTUNITY_BYTES ),
+      last_refill_us_( now_us() ),
+      trace_ms_(), trace_index_( 0 ), trace_base_us_( now_us() ), log_( nullptr ),
+      dropped( 0 ), lost( 0 ), marked( 0 )
+  {
+    if ( trace_filename.empty() ) {
+      return;
+    }
+
+    trace_ms_ = load_opportunities_ms( trace_filename );
+
+    if ( trace_ms_.empty() or trace_ms_.back() == 0 ) {
+      throw runtime_error( "trace file " + trace_filename + " has no usable delivery opportunities" );
+    }
+  }
+
+  Bottleneck( const Bottleneck & other ) = delete;
+  Bottleneck & operator=( const Bottleneck & other ) = delete;
+
+  /* log arrivals, departures and drops (and a trace's delivery opportunities) */
+  void set_log( DeliveryLogWriter * const log ) { log_ = log; }
+
+  /* enqueue a datagram arriving from the sender */
+  void enqueue( string && payload, const uint8_t tos, const uint64_t now )
+  {
+    const uint32_t sequence_number = log_ ? ContestMessage::Header( payload ).sequence_number : 0;
+    log( now, payload.size(), sequence_number, DeliveryEventType::Arrival );
+
+    if ( loss_rate_ > 0 and uniform_( random_ ) < loss_rate_ ) {
+      log( now, payload.size(), sequence_number, DeliveryEventType::Drop );
+      lost++;
+      return;
+    }
+
+    if ( queue_.size() >= queue_limit_ ) {
+      log( now, payload.size(), sequence_number, DeliveryEventType::Drop );
+      dropped++;
+      return;
+    }
+
+    queue_.push_back( { now + delay_us_, move( payload ), tos, sequence_number } );
+  }
+
+  /* hand every datagram the link can deliver by now to the callback */
+  template <typename Callback>
+  void service( const uint64_t now, const Callback & deliver )
+  {
+    if ( not trace_ms_.empty() ) {
+      /* one datagram per delivery opportunity; unused opportunities are lost */
+      while ( next_opportunity_us() <= now ) {
+	const uint64_t opportunity = next_opportunity_us();
+	log( opportunity, TRACE_OPPORTUNITY_BYTES, NO_SEQUENCE_NUMBER, DeliveryEventType::Opportunity );
+	if ( not queue_.empty() and queue_.front().eligible_us <= opportunity ) {
+	  deliver_head( opportunity, deliver );
+	}
+	advance_opportunity();
+      }
+      return;
+    }
+
+    if ( bytes_per_us_ > 0 ) {
+      tokens_ = min( bucket_depth_, tokens_ + (now - last_refill_us_) * bytes_per_us_ );
+      last_refill_us_ = now;
+    }
+
+    while ( not queue_.empty() and queue_.front().eligible_us <= now ) {
+      const double size = queue_.front().payload.size();
+      if ( bytes_per_us_ > 0 ) {
+	if ( tokens_ < size ) {
+	  break;
+	}
+	tokens_ -= size;
+      }
+
+      deliver_head( now, deliver );
+    }
+  }
+
+  /* milliseconds until the link might next have something to do */
+  int timeout_ms( const uint64_t now ) const
+  {
+    uint64_t next = now + 10000;
+
+    if ( not trace_ms_.empty() ) {
+      next = next_opportunity_us();
+    } else if ( not queue_.empty() ) {
+      next = queue_.front().eligible_us;
+
+      /* (and once it is eligible, until the bucket holds enough tokens for it) */
+      const double size = queue_.front().payload.size();
+      if ( bytes_per_us_ > 0 and tokens_ < size ) {
+	next = max( next, last_refill_us_ + uint64_t( ceil( (size - tokens_) / bytes_per_us_ ) ) );
+      }
+    }
+
+    /* (rounded up, so the relay doesn't wake early and spin) */
+    return next <= now ? 0 : max( uint64_t( 1 ), (next - now + 999) / 1000 );
+  }
+};
+
+/* one path through the relay: its link, the socket it forwards to the receiver
+   from, and the sender subflow it carries (as the relay last saw it) */
+struct Path
+{
+  Bottleneck bottleneck;
+  UDPSocket socket;
+  Address sender_address;
+  FlowKey sender_key;
+  uint8_t tos;
+  uint64_t delivered;
+};
+
+struct BenchmarkOptions
+{
+  uint64_t duration_ms = 10000;
+  vector<double> rate_mbps = { 0 }; /* per path (the last one repeats) */
+  string trace_filename = "";
+  string record_filename = "";
+  string log_filename = "";
+  vector<uint64_t> delay_ms = { 0 };
+  size_t queue_limit = 1000;
+  string ip = "127.0.0.1";
+  unsigned int spin_budget_us = 0;
+  string path_cache = "";
+  uint64_t mark_threshold_ms = 0;
+  bool tx_timestamps = false;
+  string controller = controller_names().front();
+  string stream_filename = "";
+  string output_filename = "/dev/null";
+  bool fec = false;
+  double loss_rate = 0;
+  size_t paths = 1;
+  int64_t message_interval_ms = -1; /* negative: no messages */
+  unsigned int message_weight = 0; /* zero: strict priority */
+  bool io_thread = false;
+};
+
+/* a comma-separated list, e.g. "12,4" */
+template <typename T, typename Parse>
+static vector<T> parse_list( const string & list, const Parse & parse )
+{
+  vector<T> ret;
+  size_t start = 0;
+  while ( true ) {
+    const size_t comma = list.find( ',', start );
+    ret.push_back( parse( list.substr( start, comma - start ) ) );
+    if ( comma == string::npos ) {
+      return ret;
+    }
+    start = comma + 1;
+  }
+}
+
+/* path i's entry in a per-path list (the last one stands for the rest) */
+template <typename T>
+static T for_path( const vector<T> & list, const size_t i )
+{
+  return list.at( min( i, list.size() - 1 ) );
+}
+
+static void usage( const char * const argv0 )
+{
+  cerr << "Usage: " << argv0 << " [-d SECONDS] [-r MBIT/S | -t TRACEFILE] [-l DELAY_MS]"
+       << " [-q QUEUE_PACKETS] [-i IP] [-s SPIN_US] [-c CACHEFILE] [-m MARK_MS] [-x] [-a CONTROLLER]"
+       << " [-f FILE [-o OUTPUT]] [-p LOSS] [-e] [-n PATHS] [-R TRACE] [-L LOG]"
+       << " [-u INTERVAL_MS [-w WEIGHT]] [-P]" << endl
+       << "   -d  length of the run (default 10 s)" << endl
+       << "   -r  token-bucket bottleneck rate (default unlimited)" << endl
+       << "   -t  replay a mahimahi trace (or a binary one from record=) as the bottleneck" << endl
+       << "   -l  one-way propagation delay before the bottleneck" << endl
+       << "   -q  drop-tail queue limit at the bottleneck (default 1000)" << endl
+       << "   -i  local address for the bottleneck and receiver (default 127.0.0.1)" << endl
+       << "   -s  let the sender spin this long before blocking in poll()" << endl
+       << "   -c  warm-start the controller from (and save it to) a path cache" << endl
+       << "   -m  mark ECN-capable datagrams CE after queueing this long (default never)" << endl
+       << "   -x  take RTT samples from kernel transmit timestamps" << endl
+       << "   -a  controller to run (";
+  for ( const auto & name : controller_names() ) {
+    cerr << (name == controller_names().front() ? "" : ", ") << name;
+  }
+  cerr << "; default " << controller_names().front() << ")" << endl
+       << "   -f  send a file as a reliable byte stream (ends early once it is delivered)" << endl
+       << "   -o  where the receiver writes the stream (default /dev/null)" << endl
+       << "   -p  drop this fraction of datagrams at random before the bottleneck" << endl
+       << "   -e  send XOR parity datagrams so the receiver can rebuild losses" << endl
+       << "   -n  stripe across this many paths, each with its own bottleneck"
+       << " (-r and -l then take a comma-separated value per path)" << endl
+       << "   -R  record arrivals at the receiver to a binary trace, as receiver record= does" << endl
+       << "   -L  log each datagram's arrival, departure or drop at the bottleneck (see delivery-log)" << endl
+       << "   -u  also send a 100-byte message this often (0: as fast as they go), ahead of the bulk data" << endl
+       << "   -w  give the messages this weight alongside the bulk data instead of priority" << endl
+       << "   -P  pipeline the sender: socket I/O on a thread of its own" << endl;
+}
+
+int main( int argc, char *argv[] )
+{
+  /* check the command-line arguments */
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  BenchmarkOptions options;
+  int opt;
+  while ( (opt = getopt( argc, argv, "d:r:t:l:q:i:s:c:m:xa:f:o:p:en:R:L:u:w:P" )) != -1 ) {
+    switch ( opt ) {
+    case 'd': options.duration_ms = stod( optarg ) * 1000; break;
+    case 'r': options.rate_mbps = parse_list<double>( optarg, [] ( const string & x ) { return stod( x ); } ); break;
+    case 't': options.trace_filename = optarg; break;
+    case 'l': options.delay_ms = parse_list<uint64_t>( optarg, [] ( const string & x ) { return stoull( x ); } ); break;
+    case 'q': options.queue_limit = stoull( optarg ); break;
+    case 'i': options.ip = optarg; break;
+    case 's': options.spin_budget_us = stoul( optarg ); break;
+    case 'm': options.mark_threshold_ms = stoull( optarg ); break;
+    case 'x': options.tx_timestamps = true; break;
+    case 'a': options.controller = optarg; break;
+    case 'c': options.path_cache = optarg; break;
+    case 'f': options.stream_filename = optarg; break;
+    case 'o': options.output_filename = optarg; break;
+    case 'p': options.loss_rate = stod( optarg ); break;
+    case 'e': options.fec = true; break;
+    case 'n': options.paths = stoul( optarg ); break;
+    case 'R': options.record_filename = optarg; break;
+    case 'L': options.log_filename = optarg; break;
+    case 'u': options.message_interval_ms = stoll( optarg ); break;
+    case 'w': options.message_weight = stoul( optarg ); break;
+    case 'P': options.io_thread = true; break;
+    default: usage( argv[ 0 ] ); return EXIT_FAILURE;
+    }
+  }
+
+  const auto & names = controller_names();
+  if ( optind != argc or options.paths == 0
+       or find( names.begin(), names.end(), options.controller ) == names.end() ) {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+
+  atomic<bool> done( false );
+
+  /* receiver: acknowledge every datagram (to each flow separately), as in receiver.cc */
+  UDPSocket receiver_socket;
+  receiver_socket.set_timestamps();
+  receiver_socket.set_receive_queue_drops();
+  receiver_socket.set_receive_tos();
+  receiver_socket.bind( Address( options.ip, 0 ) );
+  const Address receiver_address = receiver_socket.local_address();
+
+  unique_ptr<StreamReceiver> stream_receiver;
+  if ( not options.stream_filename.empty() ) {
+    stream_receiver.reset( new StreamReceiver( options.output_filename ) );
+  }
+
+  unique_ptr<TraceWriter> trace;
+  if ( not options.record_filename.empty() ) {
+    trace.reset( new TraceWriter( options.record_filename ) );
+  }
+
+  uint64_t received = 0, received_bytes = 0, receiver_cpu_ns = 0;
+  thread receiver_thread( [&] () {
+      try {
+	const uint64_t cpu_start = thread_cpu_ns();
+	Acknowledger acknowledger( stream_receiver.get(), trace.get() );
+
+	Poller poller;
+	poller.add_action( Action( receiver_socket, Direction::In, [&] () {
+	      const UDPSocket::received_datagram recd = receiver_socket.recv();
+	      received++;
+	      received_bytes += recd.payload.size();
+	      acknowledger.receive( receiver_socket, recd );
+	      return ResultType::Continue;
+	    } ) );
+
+	while ( not done ) {
+	  poller.poll( 10 );
+	}
+
+	receiver_cpu_ns = thread_cpu_ns() - cpu_start;
+      } catch ( const exception & e ) {
+	print_exception( e );
+	abort();
+      }
+    } );
+
+  /* bottleneck: relay datagrams from the sender through each path's link model,
+     and acks straight back. Each path forwards from a socket of its own, so the
+     receiver sees one flow per path and its acks find their way back. */
+  UDPSocket relay_socket;
+  relay_socket.set_receive_queue_drops();
+  relay_socket.set_receive_tos();
+  relay_socket.bind( Address( options.ip, 0 ) );
+  const Address relay_address = relay_socket.local_address();
+
+  /* every path logs to the same file (sequence numbers are shared, so they don't clash) */
+  unique_ptr<DeliveryLogWriter> delivery_log;
+  if ( not options.log_filename.empty() ) {
+    delivery_log.reset( new DeliveryLogWriter( options.log_filename ) );
+  }
+
+  vector<unique_ptr<Path>> paths;
+  for ( size_t i = 0; i < options.paths; i++ ) {
+    paths.emplace_back( new Path { Bottleneck( for_path( options.rate_mbps, i ), options.trace_filename,
+					       for_path( options.delay_ms, i ), options.queue_limit,
+					       options.mark_threshold_ms, options.loss_rate ),
+				   UDPSocket(), Address(), FlowKey(), 0, 0 } );
+    paths.back()->socket.bind( Address( options.ip, 0 ) );
+    paths.back()->bottleneck.set_log( delivery_log.get() );
+  }
+
+  thread relay_thread( [&] () {
+      try {
+	size_t paths_taken = 0;
+
+	Poller poller;
+	poller.add_action( Action( relay_socket, Direction::In, [&] () {
+	      UDPSocket::received_datagram recd = relay_socket.recv();
+	      const FlowKey source( recd.source_address );
+
+	      Path * path = nullptr;
+	      for ( auto & candidate : paths ) {
+		if ( candidate->sender_key == source ) {
+		  path = candidate.get();
+		  break;
+		}
+	      }
+
+	      /* a new subflow takes the next path (past the last, it takes the last over) */
+	      if ( not path ) {
+		path = paths.at( min( paths_taken++, paths.size() - 1 ) ).get();
+		path->sender_address = recd.source_address;
+		path->sender_key = source;
+	      }
+
+	      path->bottleneck.enqueue( move( recd.payload ), recd.tos, now_us() );
+	      return ResultType::Continue;
+	    } ) );
+
+	for ( auto & path : paths ) {
+	  poller.add_action( Action( path->socket, Direction::In, [&] () {
+		relay_socket.sendto( path->sender_address, path->socket.recv().payload );
+		return ResultType::Continue;
+	      } ) );
+	}
+
+	while ( not done ) {
+	  int timeout = 10;
+	  for ( const auto & path : paths ) {
+	    timeout = min( timeout, path->bottleneck.timeout_ms( now_us() ) );
+	  }
+	  poller.poll( timeout );
+
+	  for ( auto & path : paths ) {
+	    path->bottleneck.service( now_us(), [&] ( const string & payload, const uint8_t tos ) {
+		/* carry the datagram's ECN bits (and any mark) on to the receiver */
+		if ( tos != path->tos ) {
+		  path->socket.set_tos( tos );
+		  path->tos = tos;
+		}
+		path->socket.sendto( receiver_address, payload );
+		path->delivered++;
+	      } );
+	  }
+	}
+      } catch ( const exception & e ) {
+	print_exception( e );
+	abort();
+      }
+    } );
+
+  /* sender: the real DatagrumpSender and Controller, run on this thread */
+  /* with several paths, every subflow leaves from the benchmark's address
+     (on a port of its own, which is how the relay tells them apart) */
+  const vector<string> via = options.paths > 1 ? vector<string>( options.paths, options.ip ) : vector<string>();
+  const auto sender = make_datagrump_sender( options.controller, relay_address, false, via );
+  if ( options.spin_budget_us ) {
+    sender->set_spin_budget( options.spin_budget_us );
+  }
+  if ( not options.path_cache.empty() ) {
+    sender->use_path_cache( options.path_cache );
+  }
+  if ( options.tx_timestamps ) {
+    sender->use_tx_timestamps( false );
+  }
+  if ( stream_receiver ) {
+    sender->use_stream( options.stream_filename );
+  }
+  if ( options.fec ) {
+    sender->use_fec();
+  }
+  if ( options.io_thread ) {
+    sender->use_io_thread();
+  }
+
+  /* messages: an application thread writes them down a pipe, as one would to sender messages= */
+  int message_pipe[ 2 ];
+  SystemCall( "pipe2", pipe2( message_pipe, O_CLOEXEC ) );
+  FileDescriptor message_reader( message_pipe[ 0 ] ), message_writer( message_pipe[ 1 ] );
+  message_writer.set_blocking( false );
+
+  if ( options.message_interval_ms >= 0 ) {
+    sender->add_message_class( "/dev/fd/" + to_string( message_reader.fd_num() ),
+			       max( options.message_weight, 1u ), options.message_weight == 0 );
+  }
+
+  thread message_thread( [&] () {
+      uint64_t count = 0;
+      while ( options.message_interval_ms >= 0 and not done ) {
+	string message = "message " + to_string( count ) + " ";
+	message.resize( 99, '.' );
+	message += '\n';
+
+	/* (if the pipe is full, the sender is behind: try again shortly) */
+	if ( NonBlockingSystemCall( "write", ::write( message_writer.fd_num(), message.data(), message.size() ) ) > 0 ) {
+	  count++;
+	  if ( options.message_interval_ms == 0 ) {
+	    continue;
+	  }
+	}
+	this_thread::sleep_for( chrono::milliseconds( max( options.message_interval_ms, int64_t( 1 ) ) ) );
+      }
+    } );
+
+  const uint64_t cpu_start = thread_cpu_ns();
+  const uint64_t start = timestamp_ms();
+  sender->loop( start + options.duration_ms );
+  const uint64_t elapsed_ms = max( uint64_t( 1 ), timestamp_ms() - start );
+  const uint64_t sender_cpu_ns = thread_cpu_ns() - cpu_start;
+
+  done = true;
+  receiver_thread.join();
+  relay_thread.join();
+  message_thread.join();
+
+  const SenderStats & stats = sender->stats();
+  const double seconds = elapsed_ms / 1000.0;
+
+  cout << "controller: " << options.controller << endl;
+  cout << "header codec: " << header_codec_implementation() << endl;
+  uint64_t dropped = 0, lost = 0, marked = 0;
+  for ( size_t i = 0; i < paths.size(); i++ ) {
+    const Bottleneck & bottleneck = paths[ i ]->bottleneck;
+    dropped += bottleneck.dropped;
+    lost += bottleneck.lost;
+    marked += bottleneck.marked;
+
+    cout << "bottleneck";
+    if ( paths.size() > 1 ) {
+      cout << " " << i;
+    }
+    cout << ": ";
+    if ( not options.trace_filename.empty() ) {
+      cout << "trace " << options.trace_filename;
+    } else if ( for_path( options.rate_mbps, i ) > 0 ) {
+      cout << for_path( options.rate_mbps, i ) << " Mbit/s token bucket";
+    } else {
+      cout << "unlimited";
+    }
+    cout << ", " << for_path( options.delay_ms, i ) << " ms delay, " << options.queue_limit << "-packet queue";
+    if ( paths.size() > 1 ) {
+      cout << ", " << paths[ i ]->delivered / seconds << " packets/s delivered";
+    }
+    cout << endl;
+  }
+
+  cout << "duration: " << seconds << " s" << endl;
+  cout << "datagrams: " << stats.datagrams_sent << " sent, "
+       << received << " delivered, "
+       << dropped << " dropped, "
+       << lost << " lost at random and "
+       << marked << " marked at bottleneck, "
+       << stats.acks_received << " acked, "
+       << stats.queue_full_events << " held for a full socket buffer, "
+       << stats.ce_marks << " CE marks echoed" << endl;
+  cout << "socket buffer drops: relay " << relay_socket.receive_queue_drops()
+       << ", receiver " << receiver_socket.receive_queue_drops() << endl;
+  cout << "throughput: " << received / seconds << " packets/s ("
+       << received_bytes * 8 / seconds / 1e6 << " Mbit/s)" << endl;
+  cout << "CPU per packet: sender " << sender_cpu_ns / max( uint64_t( 1 ), stats.datagrams_sent );
+  if ( options.io_thread ) {
+    cout << " ns + I/O thread " << stats.io_thread_cpu_ns / max( uint64_t( 1 ), stats.datagrams_sent );
+  }
+  cout << " ns, receiver " << receiver_cpu_ns / max( uint64_t( 1 ), received ) << " ns" << endl;
+  if ( stream_receiver ) {
+    cout << "stream: " << stream_receiver->bytes_delivered() << " bytes delivered in order"
+	 << (stream_receiver->finished() ? " (complete)" : " (incomplete)")
+	 << ", goodput " << stream_receiver->bytes_delivered() * 8 / seconds / 1e6 << " Mbit/s, "
+	 << stats.retransmissions << " segments sent again" << endl;
+  }
+  if ( options.fec ) {
+    cout << "FEC (" << fec_implementation() << "): " << stats.parity_sent << " parity datagrams, "
+	 << stats.fec_recovered << " losses rebuilt" << endl;
+  }
+  cout << "retransmission timer: went off " << stats.timer_expirations << " times" << endl;
+  if ( options.tx_timestamps ) {
+    cout << "kernel TX timestamps: " << stats.tx_timestamps << ", mean time in host "
+	 << double( stats.host_delay_ms ) / max( uint64_t( 1 ), stats.tx_timestamps ) << " ms" << endl;
+  }
+  if ( stats.classes.size() > 1 ) {
+    for ( const auto & traffic_class : stats.classes ) {
+      const uint64_t datagrams = max( uint64_t( 1 ), traffic_class.datagrams );
+      cout << "class " << traffic_class.name << ": " << traffic_class.datagrams << " datagrams, "
+	   << traffic_class.bytes * 8 / seconds / 1e6 << " Mbit/s, waited "
+	   << double( traffic_class.total_wait_us ) / datagrams / 1000 << " ms on average ("
+	   << traffic_class.max_wait_us / 1000.0 << " ms at most) in the sender, RTT "
+	   << double( traffic_class.total_rtt_ms ) / max( uint64_t( 1 ), traffic_class.acked ) << " ms on average" << endl;
+    }
+  }
+  cout << "RTT (ms): min " << stats.rtt_percentile( 0 )
+       << ", median " << stats.rtt_percentile( 0.5 )
+       << ", p95 " << stats.rtt_percentile( 0.95 )
+       << ", p99 " << stats.rtt_percentile( 0.99 )
+       << ", max " << stats.rtt_percentile( 1 ) << endl;
+
+  if ( options.spin_budget_us ) {
+    const uint64_t polls = stats.spin.events_while_spinning + stats.spin.blocking_polls;
+    cout << "spinning: " << stats.spin.spin_ns / 1e6 << " ms of sender CPU ("
+	 << 100.0 * stats.spin.spin_ns / (sender_cpu_ns ? sender_cpu_ns : 1) << "%), "
+	 << stats.spin.events_while_spinning << " of " << polls
+	 << " polls answered without sleeping" << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,349 @@
+#include <cstring>
+#include <stdexcept>
+
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "byte_stream.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* flags byte */
+static const uint8_t SEGMENT_FIN = 0x01;
+static const uint8_t SEGMENT_MESSAGE = 0x02;
+
+/* input is read, and output written, this much at a time */
+static const size_t IO_SIZE = 1024 * 1024;
+
+static uint64_t get_be64( const char * const data )
+{
+  uint64_t word;
+  memcpy( &word, data, sizeof( word ) );
+  return be64toh( word );
+}
+
+static void put_be64( char * const data, const uint64_t value )
+{
+  const uint64_t word = htobe64( value );
+  memcpy( data, &word, sizeof( word ) );
+}
+
+/* Parse segment from a datagram payload */
+StreamSegment::StreamSegment( const string & payload )
+  : offset(), fin(), data()
+{
+  if ( payload.size() < SEGMENT_HEADER_SIZE ) {
+    throw runtime_error( "datagram too small to contain a stream segment" );
+  }
+
+  offset = get_be64( payload.data() );
+  fin = payload[ 8 ] & SEGMENT_FIN;
+  data.assign( payload, SEGMENT_HEADER_SIZE, string::npos );
+}
+
+StreamSegment::StreamSegment( const uint64_t s_offset, const bool s_fin, string && s_data )
+  : offset( s_offset ), fin( s_fin ), data( move( s_data ) )
+{}
+
+/* Make payload representation of segment */
+string StreamSegment::to_string( void ) const
+{
+  string ret( SEGMENT_HEADER_SIZE, 0 );
+  put_be64( &ret[ 0 ], offset );
+  ret[ 8 ] = fin ? SEGMENT_FIN : 0;
+  return ret + data;
+}
+
+/* a message from another class of traffic, in segment form */
+string make_message_segment( const string & message )
+{
+  string ret( SEGMENT_HEADER_SIZE, 0 );
+  ret[ 8 ] = SEGMENT_MESSAGE;
+  return ret + message;
+}
+
+bool is_message_segment( const string & payload )
+{
+  return payload.size() >= SEGMENT_HEADER_SIZE and (payload[ 8 ] & SEGMENT_MESSAGE);
+}
+
+/* ack payload: how far the stream has been delivered in order */
+string make_stream_ack( const uint64_t delivered )
+{
+  string ret( sizeof( delivered ), 0 );
+  put_be64( &ret[ 0 ], delivered );
+  return ret;
+}
+
+bool parse_stream_ack( const string & payload, uint64_t & delivered )
+{
+  if ( payload.size() < sizeof( delivered ) ) {
+    return false;
+  }
+
+  delivered = get_be64( payload.data() );
+  return true;
+}
+
+/* "-" is the standard input or output (dup'ed, so closing it is harmless) */
+static int open_stream_file( const string & filename, const int standard_fd, const int flags )
+{
+  if ( filename == "-" ) {
+    return SystemCall( "dup", dup( standard_fd ) );
+  }
+
+  return SystemCall( "open " + filename, open( filename.c_str(), flags | O_CLOEXEC, 0644 ) );
+}
+
+/* send a file */
+StreamSender::StreamSender( const string & filename )
+  : input_( open_stream_file( filename, STDIN_FILENO, O_RDONLY ) ),
+    input_done_( false ),
+    unsent_or_unacked_(),
+    base_( 0 ),
+    next_offset_( 0 ),
+    fin_sent_( false ),
+    delivered_( 0 ),
+    in_flight_(),
+    first_in_flight_( 0 ),
+    lost_(),
+    retransmissions_( 0 ),
+    reorder_threshold_( 3 ),
+    segment_data_size_( SEGMENT_DATA_SIZE )
+{}
+
+/* read more of the input, straight onto the end of the buffer
+   (a blocking read: the input is expected to be a file or a fast pipe) */
+bool StreamSender::read_input( void )
+{
+  if ( input_done_ ) {
+    return false;
+  }
+
+  /* drop what the receiver has delivered first, so the buffer stays
+     about STREAM_WINDOW long (and the erase is amortized over a megabyte) */
+  const uint64_t done = min( delivered_, buffered_end() ) - base_;
+  if ( done >= IO_SIZE ) {
+    unsent_or_unacked_.erase( 0, done );
+    base_ += done;
+  }
+
+  const size_t old_size = unsent_or_unacked_.size();
+  unsent_or_unacked_.resize( old_size + IO_SIZE );
+  const size_t bytes_read = input_.read( &unsent_or_unacked_[ old_size ], IO_SIZE );
+  unsent_or_unacked_.resize( old_size + bytes_read );
+
+  if ( input_.eof() ) {
+    input_done_ = true;
+  }
+
+  return bytes_read > 0;
+}
+
+/* may new data go out now (within the receiver's window)? */
+bool StreamSender::new_data_allowed( void )
+{
+  if ( fin_sent_ or next_offset_ >= delivered_ + STREAM_WINDOW ) {
+    return false;
+  }
+
+  while ( next_offset_ == buffered_end() and not input_done_ ) {
+    read_input();
+  }
+
+  /* the end of the stream goes out too, in an empty segment if need be */
+  return next_offset_ < buffered_end() or input_done_;
+}
+
+void StreamSender::declare_lost( const uint64_t offset )
+{
+  /* a later ack may already show it arrived (only the ack was lost) */
+  if ( offset < delivered_ ) {
+    return;
+  }
+
+  lost_.push_back( offset );
+}
+
+/* is there a segment to send now? */
+bool StreamSender::has_segment( void )
+{
+  while ( not lost_.empty() and lost_.front() < delivered_ ) {
+    lost_.pop_front();
+  }
+
+  return not lost_.empty() or new_data_allowed();
+}
+
+/* payload for the datagram with this sequence number */
+string StreamSender::next_segment( const uint64_t sequence_number )
+{
+  if ( not has_segment() ) {
+    throw runtime_error( "StreamSender::next_segment: nothing to send" );
+  }
+
+  if ( in_flight_.empty() ) {
+    first_in_flight_ = sequence_number;
+  } else if ( sequence_number < first_in_flight_ + in_flight_.size() ) {
+    throw runtime_error( "StreamSender::next_segment: sequence numbers must increase" );
+  }
+
+  /* the datagrams in between weren't segments: nothing to wait for */
+  while ( first_in_flight_ + in_flight_.size() < sequence_number ) {
+    in_flight_.push_back( { next_offset_, true } );
+  }
+
+  /* lost segments first, since the receiver is waiting on them */
+  uint64_t offset = next_offset_;
+  if ( not lost_.empty() ) {
+    offset = lost_.front();
+    lost_.pop_front();
+    retransmissions_++;
+  }
+
+  const uint64_t length = min( uint64_t( segment_data_size_ ), buffered_end() - offset );
+  const bool fin = input_done_ and offset + length == buffered_end();
+
+  if ( offset == next_offset_ ) {
+    next_offset_ += length;
+    fin_sent_ = fin;
+  }
+
+  in_flight_.push_back( { offset, false } );
+
+  return StreamSegment( offset, fin, unsent_or_unacked_.substr( offset - base_, length ) ).to_string();
+}
+
+/* an ack for a datagram arrived */
+void StreamSender::ack_received( const uint64_t sequence_number_acked, const string & ack_payload )
+{
+  uint64_t delivered;
+  if ( parse_stream_ack( ack_payload, delivered ) ) {
+    delivered_ = max( delivered_, delivered );
+  }
+
+  if ( sequence_number_acked - first_in_flight_ < in_flight_.size() ) {
+    in_flight_[ sequence_number_acked - first_in_flight_ ].settled = true;
+  }
+
+  /* retire the acked datagrams at the front, and give up on any that
+     enough later datagrams have overtaken */
+  while ( not in_flight_.empty()
+	  and (in_flight_.front().settled
+	       or (reorder_threshold_ and first_in_flight_ + reorder_threshold_ <= sequence_number_acked)) ) {
+    if ( not in_flight_.front().settled ) {
+      declare_lost( in_flight_.front().offset );
+    }
+    in_flight_.pop_front();
+    first_in_flight_++;
+  }
+}
+
+/* the caller knows this datagram was lost */
+void StreamSender::datagram_lost( const uint64_t sequence_number )
+{
+  if ( sequence_number - first_in_flight_ >= in_flight_.size() ) {
+    return; /* already acked or given up on */
+  }
+
+  InFlight & datagram = in_flight_[ sequence_number - first_in_flight_ ];
+  if ( not datagram.settled ) {
+    declare_lost( datagram.offset );
+    datagram.settled = true;
+  }
+
+  retire_settled();
+}
+
+/* drop the acked (or given-up-on) datagrams at the front */
+void StreamSender::retire_settled( void )
+{
+  while ( not in_flight_.empty() and in_flight_.front().settled ) {
+    in_flight_.pop_front();
+    first_in_flight_++;
+  }
+}
+
+/* no ack for a while: give up on the oldest datagram still in flight */
+void StreamSender::timer_expired( void )
+{
+  retire_settled();
+
+  if ( not in_flight_.empty() ) {
+    declare_lost( in_flight_.front().offset );
+    in_flight_.pop_front();
+    first_in_flight_++;
+  } else if ( fin_sent_ and not complete() ) {
+    /* everything was acked, but the acks saying how far the stream got were lost */
+    declare_lost( delivered_ );
+  }
+}
+
+/* write the stream to a file */
+StreamReceiver::StreamReceiver( const string & filename )
+  : output_( open_stream_file( filename, STDOUT_FILENO, O_WRONLY | O_CREAT | O_TRUNC ) ),
+    out_of_order_(),
+    delivered_( 0 ),
+    fin_offset_( -1 ),
+    finished_( false ),
+    write_buffer_()
+{
+  write_buffer_.reserve( IO_SIZE );
+}
+
+/* append data (starting at index from) to the in-order stream */
+void StreamReceiver::deliver( const string & data, const size_t from )
+{
+  write_buffer_.append( data, from, string::npos );
+  delivered_ += data.size() - from;
+
+  if ( write_buffer_.size() >= IO_SIZE ) {
+    flush();
+  }
+}
+
+/* one large sequential write */
+void StreamReceiver::flush( void )
+{
+  if ( not write_buffer_.empty() ) {
+    output_.write( write_buffer_ );
+    write_buffer_.clear();
+  }
+}
+
+/* a segment arrived */
+void StreamReceiver::receive( const string & payload )
+{
+  StreamSegment segment( payload );
+  const uint64_t end = segment.offset + segment.data.size();
+
+  if ( segment.fin ) {
+    fin_offset_ = end;
+  }
+
+  if ( segment.offset > delivered_ ) {
+    /* ahead of a gap: hold it (unless it is past the window, which a
+       well-behaved sender never does) */
+    if ( end <= delivered_ + STREAM_WINDOW ) {
+      out_of_order_.emplace( segment.offset, move( segment.data ) );
+    }
+  } else if ( end > delivered_ ) {
+    deliver( segment.data, delivered_ - segment.offset );
+
+    /* the gap is filled: deliver whatever was waiting behind it */
+    while ( not out_of_order_.empty() and out_of_order_.begin()->first <= delivered_ ) {
+      const auto held = out_of_order_.begin();
+      if ( held->first + held->second.size() > delivered_ ) {
+	deliver( held->second, delivered_ - held->first );
+      }
+      out_of_order_.erase( held );
+    }
+  }
+
+  if ( not finished_ and delivered_ == fin_offset_ ) {
+    flush();
+    finished_ = true;
+  }
+}
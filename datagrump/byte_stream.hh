@@ -0,0 +1,168 @@
+#ifndef BYTE_STREAM_HH
+#define BYTE_STREAM_HH
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+
+#include "file_descriptor.hh"
+#include "header_codec.hh"
+
+/* Reliable, in-order byte stream over datagrump. In stream mode each
+   datagram's payload is a segment: the stream offset of its first byte, a
+   flags byte, and the data. Each ack's payload is how far the receiver has
+   delivered the stream in order (counting the end of the stream as one more
+   byte, as TCP counts its FIN), which frees the sender's copy and moves the
+   flow-control window. */
+
+/* segment header: 64-bit offset and a flags byte */
+static const size_t SEGMENT_HEADER_SIZE = 9;
+
+/* data per segment (the segment fills a full-sized datagram) */
+static const size_t SEGMENT_DATA_SIZE = MAX_PAYLOAD_SIZE - SEGMENT_HEADER_SIZE;
+
+/* the sender never sends more than this far past the receiver's in-order
+   point, so this bounds what the receiver holds for reassembly */
+static const uint64_t STREAM_WINDOW = 8 * 1024 * 1024;
+
+struct StreamSegment
+{
+  uint64_t offset;
+  bool fin; /* the stream ends with this segment's data */
+  std::string data;
+
+  /* Parse segment from a datagram payload */
+  StreamSegment( const std::string & payload );
+
+  StreamSegment( const uint64_t s_offset, const bool s_fin, std::string && s_data );
+
+  /* Make payload representation of segment */
+  std::string to_string( void ) const;
+};
+
+/* In stream mode, a datagram from another class of traffic (see
+   scheduler.hh) goes as a segment flagged as a message, which the receiver
+   acks but leaves out of the stream */
+std::string make_message_segment( const std::string & message );
+bool is_message_segment( const std::string & payload );
+
+/* ack payload: how far the stream has been delivered in order */
+std::string make_stream_ack( const uint64_t delivered );
+
+/* false if the ack carries no stream position (it acks a plain datagram) */
+bool parse_stream_ack( const std::string & payload, uint64_t & delivered );
+
+/* Sending half: reads the input as the window allows, hands out a segment
+   for each datagram, and sends a segment again if its datagram is lost */
+class StreamSender
+{
+private:
+  FileDescriptor input_;
+  bool input_done_;
+
+  /* input from base_ on, kept until the receiver has delivered it */
+  std::string unsent_or_unacked_;
+  uint64_t base_;
+
+  uint64_t next_offset_; /* first byte never sent */
+  bool fin_sent_;
+  uint64_t delivered_; /* receiver's in-order point, from the latest ack */
+
+  /* datagrams sent and not yet acked or given up on, by sequence number */
+  struct InFlight
+  {
+    uint64_t offset;
+    bool settled; /* acked, or already declared lost */
+  };
+  std::deque<InFlight> in_flight_;
+  uint64_t first_in_flight_; /* sequence number of in_flight_.front() */
+
+  std::deque<uint64_t> lost_; /* offsets of segments to send again */
+  uint64_t retransmissions_;
+
+  /* a datagram is lost once this many sent after it have been acked
+     (the packet threshold of RFC 8985, tolerating a little reordering) */
+  uint64_t reorder_threshold_;
+
+  size_t segment_data_size_;
+
+  /* one past the last byte read so far */
+  uint64_t buffered_end( void ) const { return base_ + unsent_or_unacked_.size(); }
+
+  /* read more of the input (returns false at the end) */
+  bool read_input( void );
+
+  bool new_data_allowed( void );
+  void declare_lost( const uint64_t offset );
+  void retire_settled( void );
+
+public:
+  /* send a file ("-" for standard input) */
+  StreamSender( const std::string & filename );
+
+  /* is there a segment to send now (new data, or a lost segment)? */
+  bool has_segment( void );
+
+  /* payload for the datagram with this sequence number (sequence numbers
+     must increase; those skipped went to datagrams of other kinds) */
+  std::string next_segment( const uint64_t sequence_number );
+
+  /* an ack for a datagram arrived */
+  void ack_received( const uint64_t sequence_number_acked, const std::string & ack_payload );
+
+  /* wait for more later acks before giving up on a datagram (default 3;
+     0 leaves loss detection to datagram_lost() and the timer) */
+  void set_reorder_threshold( const uint64_t threshold ) { reorder_threshold_ = threshold; }
+
+  /* data per segment from now on (default SEGMENT_DATA_SIZE, the most that fits) */
+  void set_segment_data_size( const size_t size ) { segment_data_size_ = std::min( size, SEGMENT_DATA_SIZE ); }
+
+  /* the caller knows this datagram was lost (e.g. a later one on the same path was acked) */
+  void datagram_lost( const uint64_t sequence_number );
+
+  /* no ack for a while: give up on the oldest datagram still in flight */
+  void timer_expired( void );
+
+  /* has the receiver delivered the whole stream? */
+  bool complete( void ) const { return input_done_ and fin_sent_ and delivered_ > next_offset_; }
+
+  uint64_t bytes_delivered( void ) const { return std::min( delivered_, next_offset_ ); }
+  uint64_t retransmissions( void ) const { return retransmissions_; }
+};
+
+/* Receiving half: reassembles segments in order and writes the stream out
+   in large sequential writes */
+class StreamReceiver
+{
+private:
+  FileDescriptor output_;
+
+  /* segments that arrived ahead of a gap, by offset (at most STREAM_WINDOW bytes' worth) */
+  std::map<uint64_t, std::string> out_of_order_;
+  uint64_t delivered_; /* bytes delivered in order */
+  uint64_t fin_offset_; /* length of the stream, once known (-1 until then) */
+  bool finished_;
+
+  /* in-order bytes not yet written out */
+  std::string write_buffer_;
+
+  void deliver( const std::string & data, const size_t from );
+  void flush( void );
+
+public:
+  /* write the stream to a file ("-" for standard output) */
+  StreamReceiver( const std::string & filename );
+
+  /* a segment arrived */
+  void receive( const std::string & payload );
+
+  /* ack payload reporting how far the stream has been delivered */
+  std::string ack( void ) const { return make_stream_ack( delivered_ + finished_ ); }
+
+  bool finished( void ) const { return finished_; }
+  uint64_t bytes_delivered( void ) const { return delivered_; }
+};
+
+#endif /* BYTE_STREAM_HH */
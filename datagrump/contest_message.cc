@@ -1,37 +1,42 @@
+#include <cstring>
 #include <stdexcept>
 
+#include <endian.h>
+
 #include "contest_message.hh"
+#include "header_codec.hh"
 #include "timestamp.hh"
 
 using namespace std;
 
-/* helper to get the nth uint64_t field (in network byte order) */
-uint64_t get_header_field( const size_t n, const string & str )
+/* Parse header from wire */
+ContestMessage::Header::Header( const string & str )
+  : Header( -1 )
 {
-  if ( str.size() < (n + 1) * sizeof( uint64_t ) ) {
+  /* one bounds check for all the fields */
+  if ( str.size() < HEADER_WIRE_SIZE ) {
     throw runtime_error( "contest message too small to contain header" );
   }
 
-  const uint64_t * const data_ptr
-    = reinterpret_cast<const uint64_t *>( str.data() ) + n;
+  uint64_t fields[ HEADER_FIELDS ];
+  memcpy( fields, str.data(), HEADER_WIRE_SIZE );
+  for ( auto & field : fields ) {
+    field = be64toh( field );
+  }
 
-  return be64toh( *data_ptr );
+  set_header_fields( fields, *this );
 }
 
-/* Parse header from wire */
-ContestMessage::Header::Header( const string & str )
-  : sequence_number( get_header_field( 0, str ) ),
-    send_timestamp( get_header_field( 1, str ) ),
-    ack_sequence_number( get_header_field( 2, str ) ),
-    ack_send_timestamp( get_header_field( 3, str ) ),
-    ack_recv_timestamp( get_header_field( 4, str ) ),
-    ack_payload_length( get_header_field( 5, str ) )
-{}
-
 /* Parse incoming message from wire */
 ContestMessage::ContestMessage( const string & str )
   : header( str ),
-    payload( str.begin() + sizeof( header ), str.end() )
+    payload( str.begin() + HEADER_WIRE_SIZE, str.end() )
+{}
+
+/* Incoming message whose header is already parsed */
+ContestMessage::ContestMessage( const Header & s_header, const string & str )
+  : header( s_header ),
+    payload( str.begin() + HEADER_WIRE_SIZE, str.end() )
 {}
 
 /* Fill in the send_timestamp for an outgoing message */
@@ -40,23 +45,26 @@ void ContestMessage::set_send_timestamp( void )
   header.send_timestamp = timestamp_ms();
 }
 
-/* helper to put a uint64_t field (in network byte order) */
-string put_header_field( const uint64_t n )
+/* Fill in the send_timestamp of an outgoing message in wire form */
+void ContestMessage::set_send_timestamp( string & datagram )
 {
-  const uint64_t network_order = htobe64( n );
-  return string( reinterpret_cast<const char *>( &network_order ),
-		 sizeof( network_order ) );
+  if ( datagram.size() < HEADER_WIRE_SIZE ) {
+    throw runtime_error( "contest message too small to contain header" );
+  }
+
+  /* (the second field of the header) */
+  const uint64_t now = htobe64( timestamp_ms() );
+  memcpy( &datagram[ sizeof( uint64_t ) ], &now, sizeof( now ) );
 }
 
 /* Make wire representation of header */
 string ContestMessage::Header::to_string( void ) const
 {
-  return put_header_field( sequence_number )
-    + put_header_field( send_timestamp )
-    + put_header_field( ack_sequence_number )
-    + put_header_field( ack_send_timestamp )
-    + put_header_field( ack_recv_timestamp )
-    + put_header_field( ack_payload_length );
+  const uint64_t fields[ HEADER_FIELDS ] = { htobe64( sequence_number ), htobe64( send_timestamp ),
+					     htobe64( ack_sequence_number ), htobe64( ack_send_timestamp ),
+					     htobe64( ack_recv_timestamp ), htobe64( ack_payload_length ),
+					     htobe64( ack_ce_count ) };
+  return string( reinterpret_cast<const char *>( fields ), HEADER_WIRE_SIZE );
 }
 
 /* Make wire representation of message */
@@ -67,7 +75,8 @@ string ContestMessage::to_string( void ) const
 
 /* Transform into an ack of the ContestMessage */
 void ContestMessage::transform_into_ack( const uint64_t sequence_number,
-					 const uint64_t recv_timestamp )
+					 const uint64_t recv_timestamp,
+					 const uint64_t ce_count )
 {
   /* ack the old sequence number */
   header.ack_sequence_number = header.sequence_number;
@@ -80,6 +89,9 @@ void ContestMessage::transform_into_ack( const uint64_t sequence_number,
   header.ack_recv_timestamp = recv_timestamp;
   header.ack_payload_length = payload.length();
 
+  /* echo the receiver's running count of congestion marks */
+  header.ack_ce_count = ce_count;
+
   /* delete the payload */
   payload.clear();
 }
@@ -98,7 +110,8 @@ ContestMessage::Header::Header( const uint64_t s_sequence_number )
     ack_sequence_number( -1 ),
     ack_send_timestamp( -1 ),
     ack_recv_timestamp( -1 ),
-    ack_payload_length( -1 )
+    ack_payload_length( -1 ),
+    ack_ce_count( 0 )
 {}
 
 /* Is this message an ack? */
@@ -14,6 +14,7 @@ struct ContestMessage
     uint64_t ack_send_timestamp;
     uint64_t ack_recv_timestamp;
     uint64_t ack_payload_length;
+    uint64_t ack_ce_count; /* CE-marked datagrams the receiver has seen so far */
 
     /* Header for new message */
     Header( const uint64_t s_sequence_number );
@@ -34,15 +35,22 @@ struct ContestMessage
   /* Parse incoming datagram from wire */
   ContestMessage( const std::string & str );
 
+  /* The same, with its header already parsed (see decode_header_batch) */
+  ContestMessage( const Header & s_header, const std::string & str );
+
   /* Fill in the send_timestamp for an outgoing datagram */
   void set_send_timestamp( void );
 
+  /* The same for a datagram already in wire form */
+  static void set_send_timestamp( std::string & datagram );
+
   /* Make wire representation of datagram */
   std::string to_string( void ) const;
 
   /* Transform into an ack of the ContestMessage */
   void transform_into_ack( const uint64_t sequence_number,
-			   const uint64_t recv_timestamp );
+			   const uint64_t recv_timestamp,
+			   const uint64_t ce_count );
 
   /* Is this message an ack? */
   bool is_ack( void ) const;
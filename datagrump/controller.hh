@@ -3,11 +3,49 @@
 
 #include <cstdint>
 #include <deque>
+#include <iostream>
 #include <utility>
 
+#include "estimator.hh"
+#include "path_cache.hh"
+#include "timestamp.hh"
+
+/* Tuning knobs of the window controller. They are template arguments, so
+   each configuration compiles to its own controller with the constants
+   folded in (and the sender's loop can inline the whole thing). */
+struct ControllerConfig
+{
+  float window_drop; /* multiplicative decrease on a timeout or congestion signal */
+  unsigned int smallest_window_size;
+  float ssthresh_scale; /* congestion-avoidance growth per ack is ssthresh_scale * ssthresh / window */
+  unsigned int timeout; /* the timeout (ms) before there is an RTT sample to adapt it */
+  unsigned int min_rto, max_rto; /* bounds on the adaptive timeout (ms), before backoff */
+};
+
+/* findBestWindow.sh rebuilds with -DTUNED_TIMEOUT=... to sweep the timeout */
+#ifndef TUNED_TIMEOUT
+#define TUNED_TIMEOUT 60
+#endif
+
+/* the tuned defaults */
+constexpr ControllerConfig DEFAULT_CONTROLLER = {
+  .window_drop = 0.74, .smallest_window_size = 5, .ssthresh_scale = 1.1,
+  .timeout = TUNED_TIMEOUT, .min_rto = 20, .max_rto = 1000 };
+
+/* backs off less on each congestion signal (for paths with non-congestive loss) */
+constexpr ControllerConfig GENTLE_CONTROLLER = {
+  .window_drop = 0.85, .smallest_window_size = 5, .ssthresh_scale = 1.1,
+  .timeout = 80, .min_rto = 30, .max_rto = 1000 };
+
+/* grows faster in congestion avoidance and cuts harder (for links whose rate swings) */
+constexpr ControllerConfig AGGRESSIVE_CONTROLLER = {
+  .window_drop = 0.6, .smallest_window_size = 5, .ssthresh_scale = 2,
+  .timeout = 50, .min_rto = 15, .max_rto = 1000 };
+
 /* Congestion controller interface */
 using namespace std;
 
+template <ControllerConfig config>
 class Controller
 {
 private:
@@ -18,14 +56,29 @@ private:
   deque<pair<uint64_t, uint64_t> > outgoingPackets;
   uint64_t receivedAckno;
   unsigned int ackCount;
-  unsigned int timeout;
   deque<uint64_t> arrivalTimes;
+
+  /* RTT and delivery-rate estimates (also saved for warm starts) */
+  Estimator estimator;
+  unsigned int stableWindow;
+
+  /* Retransmission timer state: the timer first fires as a tail-loss probe,
+     then as a retransmission timeout, which doubles with each expiry */
+  bool probeSent;
+  unsigned int rtoBackoff;
+  unsigned int rto( void ) const;
+
+  /* When the window was last cut for a congestion signal other than a timeout */
+  bool hasCut;
+  uint64_t lastCut;
+  void decreaseWindow( void );
+  void cutWindow( const uint64_t timestamp, const uint64_t interval );
   /* Add member variables here */
 	
 public:
 	/* Public interface for the congestion controller */
 	/* You can change these if you prefer, but will need to change
-	 the call site as well (in sender.cc) */
+	 the call site as well (in datagrump_sender.cc) */
 	
 	/* Default constructor */
 	Controller( const bool debug );
@@ -43,9 +96,257 @@ public:
 		     const uint64_t recv_timestamp_acked,
 		     const uint64_t timestamp_ack_received );
 	
+	/* The local socket buffer was full (the datagram is held and retried) */
+	void local_queue_full( const uint64_t timestamp );
+
+	/* The receiver saw newly_marked more datagrams with Congestion Experienced set */
+	void ecn_marked( const uint64_t newly_marked, const uint64_t timestamp );
+
 	/* How long to wait (in milliseconds) if there are no acks
-	 before sending one more datagram */
+	 before sending one more datagram (and calling timer_expired) */
 	unsigned int timeout_ms( void );
+
+	/* No ack arrived within timeout_ms() */
+	void timer_expired( const uint64_t timestamp );
+
+	/* Snapshot of what has been learned about the path */
+	PathProfile profile( void ) const;
+
+	/* The controller's RTT and delivery-rate estimates */
+	const Estimator & estimates( void ) const { return estimator; }
+
+	/* Start from a profile learned on an earlier run instead of from scratch */
+	void warm_start( const PathProfile & profile );
 };
 
+/* Default constructor */
+template <ControllerConfig config>
+Controller<config>::Controller( const bool debug)
+: debug_( debug ), windowSize( 15 ), windowGrowing(0), ssthresh(1 << 15), outgoingPackets(deque<pair<uint64_t, uint64_t>>()),
+receivedAckno(0), ackCount(0), arrivalTimes(deque<uint64_t>()),
+estimator(), stableWindow(0), probeSent(false), rtoBackoff(1), hasCut(false), lastCut(0) {}
+
+/* Get current window size, in datagrams */
+template <ControllerConfig config>
+unsigned int Controller<config>::window_size( void )
+{
+  /* Window size changes based on network activity */
+  unsigned int the_window_size = this->windowSize;
+  
+  if ( debug_ ) {
+    cerr << "At time " << timestamp_ms()
+    << " window size is " << the_window_size << endl;
+  }
+  
+  return the_window_size;
+}
+
+/* A datagram was sent */
+template <ControllerConfig config>
+void Controller<config>::datagram_was_sent( const uint64_t sequence_number, /* of the sent datagram */
+                                   const uint64_t send_timestamp ) /* in milliseconds */
+{
+  /* (timeouts are the retransmission timer's job: see timer_expired) */
+  outgoingPackets.push_back(make_pair(sequence_number, send_timestamp));
+  estimator.datagram_was_sent(sequence_number, send_timestamp);
+
+  if ( debug_ ) {
+    cerr << "At time " << send_timestamp
+    << " sent datagram " << sequence_number << endl;
+  }
+}
+
+/* An ack was received */
+template <ControllerConfig config>
+void Controller<config>::ack_received( const uint64_t sequence_number_acked, /* what sequence number was acknowledged */
+                              const uint64_t send_timestamp_acked, /* when the acknowledged datagram was sent (sender's clock) */
+                              const uint64_t recv_timestamp_acked, /* when the acknowledged datagram was received (receiver's clock)*/
+                              const uint64_t timestamp_ack_received ) /* when the ack was received (by sender) */
+{
+  receivedAckno = sequence_number_acked;
+
+  /* Track RTT, queueing delay and delivery rate */
+  estimator.ack_received(sequence_number_acked, send_timestamp_acked,
+                         recv_timestamp_acked, timestamp_ack_received);
+
+  /* The path is alive: restart the timer from the probe, without backoff */
+  probeSent = false;
+  rtoBackoff = 1;
+
+  if (timestamp_ack_received != arrivalTimes.front()) {
+    arrivalTimes.push_front(timestamp_ack_received);
+
+    /* For each received packet, increase the window size either by 1 or scale * ssthresh / windowSize */
+    for (size_t i = 0; i < outgoingPackets.size(); i++) {
+      auto sent_seqno = outgoingPackets.front();
+      if (sent_seqno.first > sequence_number_acked)
+        break;
+
+      outgoingPackets.pop_front();
+      if (windowSize < ssthresh) {
+        windowSize++;
+      }
+      if (windowSize >= ssthresh) {
+        windowGrowing += config.ssthresh_scale * ssthresh/float(windowSize);
+        if (windowGrowing > 1) {
+          windowSize ++;
+          windowGrowing = 0;
+        }
+      }
+    }
+
+  }
+
+
+    if ( debug_ ) {
+      cerr << "At time " << timestamp_ack_received
+      << " received ack for datagram " << sequence_number_acked
+      << " (send @ time " << send_timestamp_acked
+      << ", received @ time " << recv_timestamp_acked << " by receiver's clock)"
+      << endl;
+    }
+}
+
+/* Set ssthresh to windowSize and Multiplicatively Decrease */
+template <ControllerConfig config>
+void Controller<config>::decreaseWindow( void )
+{
+  ssthresh = windowSize;
+  windowSize = windowSize * config.window_drop;
+
+  if (windowSize < config.smallest_window_size) {
+    windowSize = config.smallest_window_size;
+  }
+}
+
+/* The same, at most once per interval */
+template <ControllerConfig config>
+void Controller<config>::cutWindow( const uint64_t timestamp, const uint64_t interval )
+{
+  if (hasCut and timestamp < lastCut + interval) {
+    return;
+  }
+  hasCut = true;
+  lastCut = timestamp;
+
+  decreaseWindow();
+}
+
+/* The local socket buffer was full: we are sending faster than the
+   first hop can drain, so treat it like a loss (but cut at most once per timeout) */
+template <ControllerConfig config>
+void Controller<config>::local_queue_full( const uint64_t timestamp )
+{
+  cutWindow(timestamp, config.timeout);
+
+  if ( debug_ ) {
+    cerr << "At time " << timestamp
+    << " local queue full, window now " << windowSize << endl;
+  }
+}
+
+/* The bottleneck's AQM marked datagrams instead of dropping them: back off
+   as for a loss, but at most once per round trip (marks from the same
+   round trip are one congestion event; a round trip is at least a clock
+   tick, so a 0 ms min RTT can't cut on every mark) */
+template <ControllerConfig config>
+void Controller<config>::ecn_marked( const uint64_t newly_marked, const uint64_t timestamp )
+{
+  cutWindow(timestamp, estimator.min_rtt() == uint64_t(-1)
+	    ? config.timeout : max(estimator.min_rtt(), uint64_t(1)));
+
+  if ( debug_ ) {
+    cerr << "At time " << timestamp
+    << " " << newly_marked << " datagrams marked CE, window now " << windowSize << endl;
+  }
+}
+
+/* Retransmission timeout as in RFC 6298: SRTT + 4 RTTVAR (at least a
+   clock tick), within [min_rto, max_rto], doubled for each expiry */
+template <ControllerConfig config>
+unsigned int Controller<config>::rto( void ) const
+{
+  double the_rto = config.timeout;
+  if (estimator.has_rtt_sample()) {
+    the_rto = estimator.srtt() + max(1.0, 4 * estimator.rttvar());
+    the_rto = min(max(the_rto, double(config.min_rto)), double(config.max_rto));
+  }
+  return min(the_rto * rtoBackoff, 60000.0);
+}
+
+/* How long to wait (in milliseconds) if there are no acks
+ before sending one more datagram */
+template <ControllerConfig config>
+unsigned int Controller<config>::timeout_ms( void )
+{
+  /* First a tail-loss probe after two smoothed RTTs (RFC 8985), so a lost
+     last datagram gets noticed without waiting for the full timeout */
+  if (not probeSent and estimator.has_rtt_sample()) {
+    return min(rto(), unsigned(max(2 * estimator.srtt(), 2.0)));
+  }
+  return rto();
+}
+
+/* No ack arrived within timeout_ms() */
+template <ControllerConfig config>
+void Controller<config>::timer_expired( const uint64_t timestamp )
+{
+  if (not probeSent and estimator.has_rtt_sample()) {
+    /* The probe datagram will draw an ack if the path is just quiet */
+    probeSent = true;
+
+    if ( debug_ ) {
+      cerr << "At time " << timestamp << " sending a tail-loss probe" << endl;
+    }
+    return;
+  }
+
+  /* A real timeout: treat it as a loss (every time), and back off */
+  decreaseWindow();
+
+  /* Remember the window we settled on, for warm starts */
+  stableWindow = windowSize;
+
+  if (rtoBackoff < 64) {
+    rtoBackoff *= 2;
+  }
+
+  if ( debug_ ) {
+    cerr << "At time " << timestamp << " timeout, window now " << windowSize
+    << ", next timeout " << rto() << " ms" << endl;
+  }
+}
+
+/* Snapshot of what has been learned about the path */
+template <ControllerConfig config>
+PathProfile Controller<config>::profile( void ) const
+{
+  PathProfile p;
+  p.min_rtt_ms = estimator.min_rtt() == uint64_t(-1) ? 0 : estimator.min_rtt();
+  p.delivery_rate = estimator.delivery_rate();
+  p.stable_window = stableWindow ? stableWindow : windowSize;
+  p.updated = 0;
+  return p;
+}
+
+/* Start from a profile learned on an earlier run: open straight to the
+   last stable window and skip slow start */
+template <ControllerConfig config>
+void Controller<config>::warm_start( const PathProfile & profile )
+{
+  windowSize = profile.stable_window;
+  if (windowSize < config.smallest_window_size) {
+    windowSize = config.smallest_window_size;
+  }
+  ssthresh = windowSize;
+  stableWindow = windowSize;
+
+  estimator.warm_start(profile.min_rtt_ms, profile.delivery_rate, timestamp_ms());
+
+  if ( debug_ ) {
+    cerr << "Warm start: window " << windowSize << ", min RTT " << profile.min_rtt_ms
+    << " ms, delivery rate " << profile.delivery_rate << " datagrams/ms" << endl;
+  }
+}
+
 #endif
@@ -0,0 +1,883 @@
+#include <algorithm>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "datagrump_sender.hh"
+#include "header_codec.hh"
+#include "multipath_sender.hh"
+#include "timestamp.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* how many datagrams' departure times to remember (a power of two) */
+static const size_t DEPARTURE_RING = 4096;
+
+/* the scheduler's first class is the bulk data */
+static const DatagramScheduler::ClassId BULK_CLASS = 0;
+
+/* stop reading a message file while this many of its messages wait to be sent */
+static const size_t MAX_QUEUED_MESSAGES = 1024;
+
+/* most acks taken in one burst (and parsed together) */
+static const size_t ACK_BATCH = 32;
+
+/* record one RTT sample */
+void SenderStats::add_rtt( const uint64_t rtt_ms )
+{
+  rtt_histogram_ms.at( min( rtt_ms, uint64_t( RTT_BUCKETS - 1 ) ) )++;
+}
+
+/* smallest RTT such that the given fraction of samples are at or below it */
+uint64_t SenderStats::rtt_percentile( const double fraction ) const
+{
+  uint64_t total = 0;
+  for ( const auto & count : rtt_histogram_ms ) {
+    total += count;
+  }
+
+  uint64_t seen = 0;
+  for ( size_t i = 0; i < rtt_histogram_ms.size(); i++ ) {
+    seen += rtt_histogram_ms[ i ];
+    if ( seen > 0 and seen >= fraction * total ) {
+      return i;
+    }
+  }
+
+  return 0;
+}
+
+template <typename ControllerType>
+DatagrumpSender<ControllerType>::DatagrumpSender( const Address & peer,
+						  const bool debug )
+  : socket_(),
+    controller_( debug ),
+    sequence_number_( 0 ),
+    next_ack_expected_( 0 ),
+    ce_count_( 0 ),
+    timer_(),
+    timer_deadline_( -1 ),
+    timer_armed_for_( -1 ),
+    stream_(),
+    fec_(),
+    payload_size_( MAX_PAYLOAD_SIZE ),
+    scheduler_(),
+    message_inputs_(),
+    class_sent_(),
+    pending_(),
+    pending_class_( BULK_CLASS ),
+    pending_wait_us_( 0 ),
+    spin_budget_us_( 0 ),
+    buffer_bytes_( 0 ),
+    force_buffers_( true ),
+    path_cache_(),
+    path_key_( peer.ip() ),
+    next_checkpoint_( 0 ),
+    tx_timestamps_( false ),
+    tx_hardware_( false ),
+    tx_hardware_seen_( false ),
+    awaiting_departure_(),
+    first_awaiting_id_( 0 ),
+    departures_(),
+    use_io_thread_( false ),
+    io_(),
+    stats_(),
+    ack_batch_( ACK_BATCH ),
+    ack_batch_times_( ACK_BATCH ),
+    ack_batch_headers_( ACK_BATCH, ContestMessage::Header( 0 ) )
+{
+  /* turn on timestamps when socket receives a datagram */
+  socket_.set_timestamps();
+
+  /* mark datagrams ECN-capable, so an AQM can signal congestion without dropping */
+  socket_.set_tos( Socket::ECN_ECT0 );
+
+  /* a full socket buffer is backpressure, not an error */
+  socket_.set_blocking( false );
+
+  /* never shrink the buffers below the kernel's defaults */
+  buffer_bytes_ = min( socket_.send_buffer(), socket_.receive_buffer() ) / 2;
+
+  /* connect socket to the remote host */
+  /* (note: this doesn't send anything; it just tags the socket
+     locally with the remote address */
+  socket_.connect( peer );
+
+  cerr << "Sending to " << socket_.peer_address().to_string() << endl;
+
+  /* the bulk data: filler (there is always more), or the stream's next segment */
+  scheduler_.add_class( 1, false, {
+      [this] () { return not stream_ or stream_->has_segment(); },
+      [this] () {
+	/* All filler datagrams use the same dummy payload */
+	return stream_ ? stream_->next_segment( sequence_number_ ) : string( payload_size_, 'x' );
+      } } );
+  stats_.classes.emplace_back();
+  stats_.classes.back().name = "bulk";
+}
+
+/* low-latency mode: spin before blocking */
+template <typename ControllerType>
+void DatagrumpSender<ControllerType>::set_spin_budget( const unsigned int spin_budget_us )
+{
+  spin_budget_us_ = spin_budget_us;
+
+  /* kernel busy polling is a bonus; user-space spinning works without it */
+  try {
+    socket_.set_busy_poll( spin_budget_us );
+  } catch ( const unix_error & e ) {
+    cerr << "Kernel busy polling unavailable (" << e.what() << "), spinning in user space only" << endl;
+  }
+}
+
+/* warm-start the controller from a path cache file */
+template <typename ControllerType>
+void DatagrumpSender<ControllerType>::use_path_cache( const string & filename )
+{
+  path_cache_.reset( new PathCache( filename ) );
+
+  PathProfile profile = PathProfile();
+  if ( path_cache_->lookup( path_key_, profile ) ) {
+    controller_.warm_start( profile );
+    cerr << "Warm start for " << path_key_ << " at window " << profile.stable_window << endl;
+  }
+}
+
+/* use kernel transmit timestamps for RTT samples */
+template <typename ControllerType>
+void DatagrumpSender<ControllerType>::use_tx_timestamps( const bool hardware )
+{
+  socket_.set_tx_timestamps( true, hardware );
+  tx_timestamps_ = true;
+  tx_hardware_ = hardware;
+  departures_.assign( DEPARTURE_RING, make_pair( uint64_t( -1 ), uint64_t( 0 ) ) );
+}
+
+/* send a file reliably instead of filler */
+template <typename ControllerType>
+void DatagrumpSender<ControllerType>::use_stream( const string & filename )
+{
+  stream_.reset( new StreamSender( filename ) );
+}
+
+/* send parity datagrams */
+template <typename ControllerType>
+void DatagrumpSender<ControllerType>::use_fec( void )
+{
+  fec_.reset( new FecEncoder );
+  payload_size_ = FEC_MAX_DATA_PAYLOAD_SIZE;
+}
+
+/* send messages from a file, as a class of their own */
+template <typename ControllerType>
+void DatagrumpSender<ControllerType>::add_message_class( const string & filename,
+							 const unsigned int weight,
+							 const bool priority )
+{
+  const int fd = filename == "-"
+    ? SystemCall( "dup", dup( STDIN_FILENO ) )
+    : SystemCall( "open " + filename, open( filename.c_str(), O_RDONLY | O_CLOEXEC ) );
+
+  message_inputs_.emplace_back( new MessageInput { FileDescriptor( fd ), ReadBuffer(),
+						   scheduler_.add_class( weight, priority ) } );
+
+  stats_.classes.emplace_back();
+  stats_.classes.back().name = filename + (priority ? " (priority)" : " (weight " + to_string( weight ) + ")");
+
+  /* with more than one class, remember which each datagram came from */
+  class_sent_.assign( DEPARTURE_RING, make_pair( uint64_t( -1 ), BULK_CLASS ) );
+}
+
+/* Queue each complete line that has arrived from a message file (and, at
+   its end, whatever is left); false once the file is done */
+template <typename ControllerType>
+bool DatagrumpSender<ControllerType>::read_messages( MessageInput & input )
+{
+  const bool more = input.buffer.fill( input.file ) > 0;
+
+  /* a message longer than this goes in pieces (so it fits a datagram even as a segment) */
+  const size_t max_message_size = payload_size_ - SEGMENT_HEADER_SIZE;
+
+  const auto queue_message = [&] ( const size_t length ) {
+    for ( size_t sent = 0; sent < length; sent += max_message_size ) {
+      scheduler_.enqueue( input.id, input.buffer.pop( min( max_message_size, length - sent ) ) );
+    }
+  };
+
+  size_t newline;
+  while ( (newline = input.buffer.find( '\n' )) != string::npos ) {
+    queue_message( newline );
+    input.buffer.consume( 1 );
+  }
+
+  /* a line too long for one datagram goes out in pieces as it arrives */
+  while ( input.buffer.size() >= max_message_size ) {
+    queue_message( max_message_size );
+  }
+
+  if ( not more ) {
+    queue_message( input.buffer.size() );
+  }
+
+  return more;
+}
+
+/* The kernel numbers stamps by counting sends, but some kernels also count a
+   send that failed for lack of buffer space. After a failed send, restart the
+   count so the ids line up with awaiting_departure_ again. */
+template <typename ControllerType>
+void DatagrumpSender<ControllerType>::restart_tx_timestamps( void )
+{
+  /* the stamps already queued carry the old count's ids: throw them away */
+  UDPSocket::tx_timestamp stale;
+  while ( socket_.try_recv_tx_timestamp( stale ) ) {}
+
+  socket_.set_tx_timestamps( false );
+  socket_.set_tx_timestamps( true, tx_hardware_ );
+  awaiting_departure_.clear();
+  first_awaiting_id_ = 0;
+}
+
+/* match stamps from the error queue to the datagrams they belong to */
+template <typename ControllerType>
+void DatagrumpSender<ControllerType>::read_tx_timestamps( void )
+{
+  bool got_any = false;
+  UDPSocket::tx_timestamp stamp;
+
+  while ( socket_.try_recv_tx_timestamp( stamp ) ) {
+    got_any = true;
+
+    /* with hardware stamps, the NIC's and the kernel's both arrive, with
+       the same id; once the NIC's turn up, they are the ones to use */
+    if ( tx_hardware_ ) {
+      if ( stamp.hardware ) {
+	tx_hardware_seen_ = true;
+      } else if ( tx_hardware_seen_ ) {
+	continue;
+      }
+    }
+
+    /* a stamp must be for a datagram still awaiting one: any other id is
+       already matched, or (still in flight at a restart) from the old count */
+    const uint32_t offset = stamp.id - first_awaiting_id_;
+    if ( offset >= awaiting_departure_.size() ) {
+      continue;
+    }
+
+    /* the ones before it never got a stamp */
+    awaiting_departure_.erase( awaiting_departure_.begin(), awaiting_departure_.begin() + offset );
+    first_awaiting_id_ += offset;
+
+    const auto datagram = awaiting_departure_.front();
+    awaiting_departure_.pop_front();
+    first_awaiting_id_++;
+
+    /* parity datagrams take a stamp too, but nothing acks them */
+    if ( datagram.first & FEC_PARITY_FLAG ) {
+      continue;
+    }
+
+    /* a datagram can't leave before it was sent (this catches misnumbered stamps) */
+    if ( stamp.timestamp < datagram.second ) {
+      continue;
+    }
+
+    departures_[ datagram.first & (DEPARTURE_RING - 1) ] = make_pair( datagram.first, stamp.timestamp );
+    stats_.tx_timestamps++;
+    stats_.host_delay_ms += stamp.timestamp - datagram.second;
+  }
+
+  /* if the error queue held no stamps, the error was a real one */
+  if ( not got_any ) {
+    socket_.throw_pending_error();
+  }
+}
+
+/* when a datagram left the host, if known (otherwise when it was sent) */
+template <typename ControllerType>
+uint64_t DatagrumpSender<ControllerType>::departure_time( const uint64_t sequence_number,
+							  const uint64_t send_timestamp ) const
+{
+  if ( tx_timestamps_ ) {
+    const auto & departure = departures_[ sequence_number & (DEPARTURE_RING - 1) ];
+    if ( departure.first == sequence_number ) {
+      return departure.second;
+    }
+  }
+
+  return send_timestamp;
+}
+
+/* record what the controller has learned so far */
+template <typename ControllerType>
+void DatagrumpSender<ControllerType>::checkpoint( void )
+{
+  path_cache_->update( path_key_, controller_.profile() );
+  path_cache_->save();
+}
+
+/* a burst of acks, in ack_batch_[ 0 .. count ): parse their headers together */
+template <typename ControllerType>
+void DatagrumpSender<ControllerType>::got_acks( const size_t count )
+{
+  decode_header_batch( ack_batch_.data(), count, ack_batch_headers_.data() );
+
+  for ( size_t i = 0; i < count; i++ ) {
+    got_ack( ack_batch_times_[ i ], ContestMessage( ack_batch_headers_[ i ], ack_batch_[ i ] ) );
+  }
+}
+
+template <typename ControllerType>
+void DatagrumpSender<ControllerType>::got_ack( const uint64_t timestamp,
+					       const ContestMessage & ack )
+{
+  if ( not ack.is_ack() ) {
+    throw runtime_error( "sender got something other than an ack from the receiver" );
+  }
+
+  /* Update sender's counter */
+  next_ack_expected_ = max( next_ack_expected_,
+			    ack.header.ack_sequence_number + 1 );
+
+  /* the send timestamp echoed in the ack, or the kernel's if we have it */
+  const uint64_t send_timestamp = departure_time( ack.header.ack_sequence_number,
+						  ack.header.ack_send_timestamp );
+
+  stats_.acks_received++;
+  stats_.add_rtt( timestamp - send_timestamp );
+
+  if ( not class_sent_.empty() ) {
+    const auto & sent = class_sent_[ ack.header.ack_sequence_number & (DEPARTURE_RING - 1) ];
+    if ( sent.first == ack.header.ack_sequence_number ) {
+      stats_.classes[ sent.second ].acked++;
+      stats_.classes[ sent.second ].total_rtt_ms += timestamp - send_timestamp;
+    }
+  }
+
+  /* Inform congestion controller */
+  controller_.ack_received( ack.header.ack_sequence_number,
+			    send_timestamp,
+			    ack.header.ack_recv_timestamp,
+			    timestamp );
+
+  /* the ack says which segment arrived, and how far the stream has been delivered */
+  if ( stream_ ) {
+    stream_->ack_received( ack.header.ack_sequence_number, ack.payload );
+    stats_.stream_bytes = stream_->bytes_delivered();
+  }
+
+  /* count the losses parity rebuilt, which set the group size */
+  if ( fec_ ) {
+    fec_->ack_received( ack );
+    stats_.fec_recovered += bool( ack.header.ack_payload_length & FEC_RECOVERED_FLAG );
+  }
+
+  /* the path is alive: push the retransmission timer back */
+  set_timer( timestamp + controller_.timeout_ms() );
+
+  /* the count is cumulative, so a lost or reordered ack loses no marks */
+  if ( ack.header.ack_ce_count > ce_count_ ) {
+    const uint64_t newly_marked = ack.header.ack_ce_count - ce_count_;
+    ce_count_ = ack.header.ack_ce_count;
+    stats_.ce_marks += newly_marked;
+    controller_.ecn_marked( newly_marked, timestamp );
+  }
+}
+
+/* hand a datagram to the socket, or (pipelined) to the I/O thread; false if it is full */
+template <typename ControllerType>
+bool DatagrumpSender<ControllerType>::transmit( const ContestMessage & cm )
+{
+  return io_ ? io_->send( IO_PORT, cm.to_string() ) : socket_.try_send( cm.to_string() );
+}
+
+/* send the next datagram (or retry the held one); false if the socket buffer is full */
+template <typename ControllerType>
+bool DatagrumpSender<ControllerType>::send_datagram( void )
+{
+  if ( not pending_ ) {
+    string payload;
+    if ( not scheduler_.dequeue( payload, pending_class_, pending_wait_us_ ) ) {
+      return true; /* nothing to send */
+    }
+
+    /* in stream mode, the receiver has to tell messages from segments */
+    if ( stream_ and pending_class_ != BULK_CLASS ) {
+      payload = make_message_segment( payload );
+    }
+
+    pending_.reset( new ContestMessage( sequence_number_++, payload ) );
+    if ( stream_ ) {
+      stats_.retransmissions = stream_->retransmissions();
+    }
+  }
+
+  /* (re)stamp just before sending, so a held datagram's RTT excludes the
+     wait (the I/O thread, if there is one, stamps it again as it leaves) */
+  ContestMessage & cm = *pending_;
+  cm.set_send_timestamp();
+
+  if ( not transmit( cm ) ) {
+    /* hold the datagram until the socket is writable again */
+    stats_.queue_full_events++;
+    controller_.local_queue_full( cm.header.send_timestamp );
+    if ( tx_timestamps_ ) {
+      restart_tx_timestamps();
+    }
+    return false;
+  }
+
+  await_departure( cm );
+
+  stats_.datagrams_sent++;
+
+  SenderStats::ClassStats & class_stats = stats_.classes[ pending_class_ ];
+  class_stats.datagrams++;
+  class_stats.bytes += cm.payload.size();
+  class_stats.total_wait_us += pending_wait_us_;
+  class_stats.max_wait_us = max( class_stats.max_wait_us, pending_wait_us_ );
+  if ( not class_sent_.empty() ) {
+    class_sent_[ cm.header.sequence_number & (DEPARTURE_RING - 1) ] = make_pair( cm.header.sequence_number,
+										 pending_class_ );
+  }
+
+  /* Inform congestion controller */
+  controller_.datagram_was_sent( cm.header.sequence_number,
+				 cm.header.send_timestamp );
+
+  if ( fec_ ) {
+    fec_->add( cm );
+    if ( fec_->group_full() ) {
+      send_parity();
+    }
+  }
+
+  pending_.reset();
+  return true;
+}
+
+/* Send the parity for a full group. It is best effort: if the socket
+   buffer is full, it is dropped (and the group goes unprotected), since
+   holding it back would delay the data behind it. */
+template <typename ControllerType>
+void DatagrumpSender<ControllerType>::send_parity( void )
+{
+  ContestMessage parity = fec_->parity();
+  parity.set_send_timestamp();
+
+  if ( not transmit( parity ) ) {
+    if ( tx_timestamps_ ) {
+      restart_tx_timestamps();
+    }
+    return;
+  }
+
+  await_departure( parity );
+  stats_.parity_sent++;
+}
+
+/* remember a datagram sent, to match it with its transmit timestamp */
+template <typename ControllerType>
+void DatagrumpSender<ControllerType>::await_departure( const ContestMessage & cm )
+{
+  if ( not tx_timestamps_ ) {
+    return;
+  }
+
+  awaiting_departure_.emplace_back( cm.header.sequence_number, cm.header.send_timestamp );
+  if ( awaiting_departure_.size() > DEPARTURE_RING ) {
+    /* the kernel isn't sending stamps (or is far behind) */
+    awaiting_departure_.pop_front();
+    first_awaiting_id_++;
+  }
+}
+
+/* Grow the socket buffers to hold twice the window (room for it to grow
+   within an RTT), so a large window doesn't overflow the local host and
+   look like congestion. The kernel doubles the request for its bookkeeping. */
+void grow_socket_buffers( UDPSocket & socket, const unsigned int window,
+			  int & buffer_bytes, bool & force )
+{
+  const int wanted = 2 * int( MTU ) * int( window );
+  if ( wanted <= buffer_bytes ) {
+    return;
+  }
+
+  /* past net.core.[rw]mem_max if permitted, otherwise as far as allowed */
+  if ( force ) {
+    try {
+      socket.set_send_buffer( wanted, true );
+      socket.set_receive_buffer( wanted, true );
+    } catch ( const unix_error & e ) {
+      if ( e.code().value() != EPERM ) {
+	throw;
+      }
+      force = false;
+    }
+  }
+
+  if ( not force ) {
+    socket.set_send_buffer( wanted );
+    socket.set_receive_buffer( wanted );
+  }
+
+  buffer_bytes = wanted;
+}
+
+template <typename ControllerType>
+void DatagrumpSender<ControllerType>::size_buffers( void )
+{
+  grow_socket_buffers( socket_, controller_.window_size(), buffer_bytes_, force_buffers_ );
+}
+
+/* (Re)start the retransmission timer. Pushing the deadline later, as every
+   ack does, costs no syscall: the timerfd goes off at the old time, finds
+   the deadline has moved, and is set again for the new one. */
+template <typename ControllerType>
+void DatagrumpSender<ControllerType>::set_timer( const uint64_t deadline )
+{
+  timer_deadline_ = deadline;
+
+  if ( deadline < timer_armed_for_ ) {
+    const uint64_t now = timestamp_ms();
+    timer_.arm_us( deadline > now ? (deadline - now) * 1000 : 0 );
+    timer_armed_for_ = deadline;
+  }
+}
+
+template <typename ControllerType>
+bool DatagrumpSender<ControllerType>::window_is_open( void )
+{
+  return sequence_number_ - next_ack_expected_ < controller_.window_size()
+    and scheduler_.has_datagram();
+}
+
+/* Close the window (stopping early if the socket buffer fills) */
+template <typename ControllerType>
+void DatagrumpSender<ControllerType>::fill_window( void )
+{
+  while ( pending_ or window_is_open() ) {
+    if ( not send_datagram() ) {
+      break;
+    }
+  }
+}
+
+template <typename ControllerType>
+int DatagrumpSender<ControllerType>::loop( const uint64_t deadline_ms )
+{
+  if ( not use_io_thread_ ) {
+    return run( deadline_ms );
+  }
+
+  /* the stamps arrive on the socket's error queue, in the I/O thread's poller */
+  if ( tx_timestamps_ ) {
+    throw runtime_error( "transmit timestamps are not supported with the I/O thread" );
+  }
+
+  /* the I/O thread stamps datagrams as they leave, except with parity,
+     which rebuilds a lost datagram's stamp from the ones made here */
+  io_.reset( new SenderIOThread( spin_budget_us_ ) );
+  io_->add_port( socket_, not fec_ );
+  io_->start();
+
+  const int ret = run( deadline_ms );
+
+  io_->stop();
+  stats_.io_thread_cpu_ns = io_->cpu_ns();
+  io_.reset();
+  return ret;
+}
+
+/* poll(2) reports an error on the socket: with transmit timestamps, that is
+   just stamps arriving on its error queue (read them); otherwise it ends the
+   loop, as it always has (true) */
+template <typename ControllerType>
+bool DatagrumpSender<ControllerType>::socket_failed( EventLoop & loop, const short revents )
+{
+  if ( not (revents & (POLLERR | POLLHUP | POLLNVAL)) ) {
+    return false;
+  }
+
+  if ( tx_timestamps_ ) {
+    read_tx_timestamps();
+    return false;
+  }
+
+  loop.stop();
+  return true;
+}
+
+/* first: if the window is open, close it by sending more datagrams
+   (waiting for room in the socket buffer when it fills) */
+template <typename ControllerType>
+Task<> DatagrumpSender<ControllerType>::send_while_open( EventLoop & loop, EventLoop::Signal & progress )
+{
+  while ( true ) {
+    if ( pending_ ) {
+      const short revents = co_await loop.writable( socket_ );
+      if ( socket_failed( loop, revents ) ) {
+	co_return;
+      }
+    } else if ( not window_is_open() ) {
+      co_await progress.wait();
+      continue;
+    }
+
+    fill_window();
+    progress.notify(); /* (the message queues have drained) */
+  }
+}
+
+/* second: if sender receives acks, process them and inform the controller
+   (by using the sender's got_ack method) */
+template <typename ControllerType>
+Task<> DatagrumpSender<ControllerType>::take_acks( EventLoop & loop, EventLoop::Signal & progress )
+{
+  UDPSocket::received_datagram recd = { Address(), 0, string(), 0, 0 };
+
+  while ( true ) {
+    const short revents = co_await loop.readable( socket_ );
+    if ( socket_failed( loop, revents ) ) {
+      co_return;
+    }
+
+    size_t count = 0;
+    while ( count < ACK_BATCH and socket_.try_recv( recd ) ) {
+      ack_batch_times_[ count ] = recd.timestamp;
+      swap( ack_batch_[ count++ ], recd.payload );
+    }
+
+    if ( count ) {
+      got_acks( count );
+      progress.notify();
+    }
+  }
+}
+
+/* third: if no ack arrives before the retransmission timer goes off,
+   tell the controller, and send one datagram to try to get things moving
+   again (or retry the one that is waiting) */
+template <typename ControllerType>
+Task<> DatagrumpSender<ControllerType>::retransmit_on_timeout( EventLoop & loop, EventLoop::Signal & progress )
+{
+  while ( true ) {
+    co_await loop.readable( timer_ );
+    timer_.read_expirations();
+    timer_armed_for_ = -1;
+
+    const uint64_t now = timestamp_ms();
+    if ( now < timer_deadline_ ) {
+      set_timer( timer_deadline_ ); /* an ack moved the deadline */
+      continue;
+    }
+
+    stats_.timer_expirations++;
+    controller_.timer_expired( now );
+    if ( stream_ ) {
+      stream_->timer_expired();
+    }
+    send_datagram();
+    set_timer( now + controller_.timeout_ms() );
+    progress.notify();
+  }
+}
+
+/* fourth: queue messages as they arrive from their file (holding off while
+   plenty are waiting, which slows a fast writer to the rate they go out) */
+template <typename ControllerType>
+Task<> DatagrumpSender<ControllerType>::take_messages( EventLoop & loop, EventLoop::Signal & progress,
+							MessageInput & input )
+{
+  while ( true ) {
+    while ( scheduler_.queued( input.id ) >= MAX_QUEUED_MESSAGES ) {
+      co_await progress.wait();
+    }
+
+    co_await loop.readable( input.file );
+    const bool more = read_messages( input );
+    progress.notify();
+
+    if ( not more ) {
+      co_return;
+    }
+  }
+}
+
+/* pipelined: the I/O thread has the socket, and wakes us when acks arrive
+   (or room in its ring we were waiting for); run()'s loop takes the acks
+   and fills the window */
+template <typename ControllerType>
+Task<> DatagrumpSender<ControllerType>::take_io_wakeups( EventLoop & loop )
+{
+  while ( true ) {
+    co_await loop.readable( io_->wakeup( IO_PORT ) );
+    io_->wakeup( IO_PORT ).read_events();
+  }
+}
+
+template <typename ControllerType>
+int DatagrumpSender<ControllerType>::run( const uint64_t deadline_ms )
+{
+  /* read and write from the receiver with coroutines on an event loop */
+  EventLoop loop;
+  loop.set_spin_budget( spin_budget_us_ );
+  EventLoop::Signal progress( loop );
+
+  if ( io_ ) {
+    loop.spawn( take_io_wakeups( loop ) );
+  } else {
+    loop.spawn( send_while_open( loop, progress ) );
+    loop.spawn( take_acks( loop, progress ) );
+  }
+
+  loop.spawn( retransmit_on_timeout( loop, progress ) );
+
+  for ( auto & input : message_inputs_ ) {
+    loop.spawn( take_messages( loop, progress, *input ) );
+  }
+
+  set_timer( timestamp_ms() + controller_.timeout_ms() );
+
+  /* with parity, a lost datagram's ack can come as late as the end of its group
+     (and segments leave room for the parity header) */
+  if ( stream_ and fec_ ) {
+    stream_->set_reorder_threshold( FEC_MAX_GROUP + 3 );
+    stream_->set_segment_data_size( payload_size_ - SEGMENT_HEADER_SIZE );
+  }
+
+  const bool has_deadline = deadline_ms != uint64_t( -1 );
+
+  /* how often to checkpoint the learned path profile (if caching) */
+  const uint64_t CHECKPOINT_INTERVAL = 1000;
+
+  /* Run these rules forever (or until the deadline) */
+  while ( true ) {
+    size_buffers();
+
+    const uint64_t now = timestamp_ms();
+    uint64_t wake_at = deadline_ms;
+
+    if ( path_cache_ ) {
+      if ( now >= next_checkpoint_ ) {
+	checkpoint();
+	next_checkpoint_ = now + CHECKPOINT_INTERVAL;
+      }
+      wake_at = min( wake_at, next_checkpoint_ );
+    }
+
+    if ( has_deadline and now >= deadline_ms ) {
+      if ( path_cache_ ) {
+	checkpoint();
+      }
+      return EXIT_SUCCESS;
+    }
+
+    /* pipelined: take the acks the I/O thread has passed on, and hand it
+       what the window has room for (not blocking if more acks came meanwhile) */
+    bool block = true;
+    if ( io_ ) {
+      SenderIOThread::Incoming recd;
+      size_t count;
+      do {
+	count = 0;
+	while ( count < ACK_BATCH and io_->receive( IO_PORT, recd ) ) {
+	  ack_batch_times_[ count ] = recd.timestamp;
+	  swap( ack_batch_[ count++ ], recd.payload );
+	}
+	got_acks( count );
+      } while ( count == ACK_BATCH );
+      fill_window();
+      block = io_->sleep( IO_PORT );
+    }
+
+    /* the timers above are the only reasons to wake up without an event */
+    const int timeout = wake_at == uint64_t( -1 ) ? -1 : wake_at - now;
+
+    const bool running = loop.run_once( block ? timeout : 0 );
+    stats_.spin = loop.spin_stats();
+
+    if ( io_ ) {
+      io_->wake( IO_PORT );
+
+      /* an error on the socket ends the loop, as it would the event loop's */
+      if ( io_->finished() ) {
+	if ( path_cache_ ) {
+	  checkpoint();
+	}
+	return io_->exit_status();
+      }
+    }
+
+    if ( not running ) {
+      if ( path_cache_ ) {
+	checkpoint();
+      }
+      return EXIT_SUCCESS;
+    }
+
+    if ( stream_ and stream_->complete() ) {
+      if ( path_cache_ ) {
+	checkpoint();
+      }
+      return EXIT_SUCCESS;
+    }
+  }
+}
+
+/* the prebuilt controllers (see controller.hh) */
+typedef unique_ptr<DatagrumpSenderBase> ( *SenderMaker )( const Address & peer,
+							  const vector<string> & via,
+							  const bool debug );
+
+template <ControllerConfig config>
+static unique_ptr<DatagrumpSenderBase> make_sender( const Address & peer,
+						    const vector<string> & via,
+						    const bool debug )
+{
+  if ( not via.empty() ) {
+    return unique_ptr<DatagrumpSenderBase>( new MultipathSender<Controller<config>>( peer, via, debug ) );
+  }
+
+  return unique_ptr<DatagrumpSenderBase>( new DatagrumpSender<Controller<config>>( peer, debug ) );
+}
+
+static const vector<pair<string, SenderMaker>> & prebuilt_senders( void )
+{
+  static const vector<pair<string, SenderMaker>> senders = {
+    { "default", make_sender<DEFAULT_CONTROLLER> },
+    { "gentle", make_sender<GENTLE_CONTROLLER> },
+    { "aggressive", make_sender<AGGRESSIVE_CONTROLLER> } };
+  return senders;
+}
+
+/* names of the prebuilt controllers, default first */
+const vector<string> & controller_names( void )
+{
+  static const vector<string> names = [] () {
+    vector<string> ret;
+    for ( const auto & sender : prebuilt_senders() ) {
+      ret.push_back( sender.first );
+    }
+    return ret;
+  } ();
+  return names;
+}
+
+/* a sender built with the named controller */
+unique_ptr<DatagrumpSenderBase> make_datagrump_sender( const string & controller,
+						       const Address & peer,
+						       const bool debug,
+						       const vector<string> & via )
+{
+  for ( const auto & sender : prebuilt_senders() ) {
+    if ( sender.first == controller ) {
+      return sender.second( peer, via, debug );
+    }
+  }
+
+  throw runtime_error( "unknown controller " + controller );
+}
@@ -0,0 +1,276 @@
+#ifndef DATAGRUMP_SENDER_HH
+#define DATAGRUMP_SENDER_HH
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "socket.hh"
+#include "buffered_io.hh"
+#include "byte_stream.hh"
+#include "contest_message.hh"
+#include "controller.hh"
+#include "event_loop.hh"
+#include "fec.hh"
+#include "io_thread.hh"
+#include "path_cache.hh"
+#include "poller.hh"
+#include "scheduler.hh"
+#include "timer_fd.hh"
+
+/* counters kept by the sender (reported by the benchmark) */
+struct SenderStats
+{
+  /* RTT samples are bucketed by millisecond; the last bucket collects the overflow */
+  static const size_t RTT_BUCKETS = 10001;
+
+  uint64_t datagrams_sent;
+  uint64_t acks_received;
+  uint64_t queue_full_events; /* sends that found the socket buffer full */
+  uint64_t ce_marks; /* datagrams the receiver saw marked Congestion Experienced */
+
+  /* kernel transmit timestamps, and the total time datagrams spent in the host
+     between the user-space stamp and the kernel's */
+  uint64_t tx_timestamps;
+  uint64_t host_delay_ms;
+
+  /* times the retransmission timer fired (probes and timeouts) */
+  uint64_t timer_expirations;
+
+  /* stream mode: bytes the receiver has delivered in order, and segments sent again */
+  uint64_t stream_bytes;
+  uint64_t retransmissions;
+
+  /* FEC mode: parity datagrams sent, and losses the receiver rebuilt from them */
+  uint64_t parity_sent;
+  uint64_t fec_recovered;
+
+  std::vector<uint64_t> rtt_histogram_ms;
+
+  /* per class of traffic (the bulk data first, then each message class):
+     what it sent, how long its datagrams waited in the sender, and the
+     RTT of those acked */
+  struct ClassStats
+  {
+    std::string name = "";
+    uint64_t datagrams = 0, bytes = 0;
+    uint64_t total_wait_us = 0, max_wait_us = 0;
+    uint64_t acked = 0, total_rtt_ms = 0;
+  };
+  std::vector<ClassStats> classes;
+
+  /* time spent spinning in the event loop, and what it bought */
+  Poller::SpinStats spin;
+
+  /* pipelined mode: CPU time of the I/O thread */
+  uint64_t io_thread_cpu_ns;
+
+  SenderStats() : datagrams_sent( 0 ), acks_received( 0 ), queue_full_events( 0 ), ce_marks( 0 ),
+		  tx_timestamps( 0 ), host_delay_ms( 0 ), timer_expirations( 0 ),
+		  stream_bytes( 0 ), retransmissions( 0 ), parity_sent( 0 ), fec_recovered( 0 ),
+		  rtt_histogram_ms( RTT_BUCKETS ), classes(), spin(), io_thread_cpu_ns( 0 ) {}
+
+  /* record one RTT sample */
+  void add_rtt( const uint64_t rtt_ms );
+
+  /* smallest RTT such that the given fraction of samples are at or below it */
+  uint64_t rtt_percentile( const double fraction ) const;
+};
+
+/* What the programs need from a sender, whichever controller it was built
+   with. These are called once per run; everything per datagram happens
+   inside loop(), which is compiled separately for each controller. */
+class DatagrumpSenderBase
+{
+public:
+  virtual ~DatagrumpSenderBase() {}
+
+  /* low-latency mode: spin for up to spin_budget_us before blocking in poll(),
+     and ask the kernel to busy-poll the socket as well (if permitted) */
+  virtual void set_spin_budget( const unsigned int spin_budget_us ) = 0;
+
+  /* warm-start the controller from (and checkpoint it to) a path cache file */
+  virtual void use_path_cache( const std::string & filename ) = 0;
+
+  /* take RTT samples from when the kernel (or, with hardware, the NIC) sent each
+     datagram, not from when it was stamped in user space */
+  virtual void use_tx_timestamps( const bool hardware ) = 0;
+
+  /* send a file ("-" for standard input) reliably and in order, instead of
+     filler; loop() returns once the receiver has all of it */
+  virtual void use_stream( const std::string & filename ) = 0;
+
+  /* follow each group of datagrams with an XOR parity datagram, the group
+     sized to the loss rate (see fec.hh) */
+  virtual void use_fec( void ) = 0;
+
+  /* also send the newline-separated messages read from a file (e.g. a
+     FIFO, or "-" for standard input), one datagram each, as a class of
+     their own: ahead of everything else if priority, otherwise sharing
+     the window with the bulk data (which has weight 1) by weight */
+  virtual void add_message_class( const std::string & filename, const unsigned int weight,
+				  const bool priority ) = 0;
+
+  /* pipelined mode: do the socket I/O on a thread of its own (see
+     io_thread.hh), so the controller's work overlaps with the syscalls */
+  virtual void use_io_thread( void ) = 0;
+
+  /* run until the poller exits (or the deadline, in timestamp_ms() time, passes) */
+  virtual int loop( const uint64_t deadline_ms ) = 0;
+  int loop( void ) { return loop( -1 ); }
+
+  virtual const SenderStats & stats( void ) const = 0;
+};
+
+/* simple sender class to handle the accounting, built around one
+   controller type (so its calls can be inlined into the send loop) */
+template <typename ControllerType>
+class DatagrumpSender final : public DatagrumpSenderBase
+{
+private:
+  UDPSocket socket_;
+  ControllerType controller_; /* your class */
+
+  uint64_t sequence_number_; /* next outgoing sequence number */
+
+  /* if network does not reorder or lose datagrams,
+     this is the sequence number that the sender
+     next expects will be acknowledged by the receiver */
+  uint64_t next_ack_expected_;
+
+  /* receiver's running count of CE marks, as of the latest ack */
+  uint64_t ce_count_;
+
+  /* retransmission timer: fires at timer_deadline_ (in timestamp_ms() time);
+     the timerfd itself is set for timer_armed_for_ (-1 if not set) */
+  TimerFD timer_;
+  uint64_t timer_deadline_, timer_armed_for_;
+  void set_timer( const uint64_t deadline );
+
+  /* the byte stream being sent (optional; otherwise every datagram is filler) */
+  std::unique_ptr<StreamSender> stream_;
+
+  /* parity for the datagrams sent (optional) */
+  std::unique_ptr<FecEncoder> fec_;
+
+  /* the largest data payload (less with parity, to leave room for its header) */
+  size_t payload_size_;
+  void send_parity( void );
+
+  /* which class of traffic each datagram comes from: the bulk data
+     (filler or the stream), or messages read from a file */
+  DatagramScheduler scheduler_;
+
+  struct MessageInput
+  {
+    FileDescriptor file;
+    ReadBuffer buffer;
+    DatagramScheduler::ClassId id;
+  };
+  std::vector<std::unique_ptr<MessageInput>> message_inputs_;
+  bool read_messages( MessageInput & input );
+
+  /* the class each recent datagram came from, as (sequence number, class) */
+  std::vector<std::pair<uint64_t, DatagramScheduler::ClassId>> class_sent_;
+
+  /* datagram held back because the socket buffer was full (and its class) */
+  std::unique_ptr<ContestMessage> pending_;
+  DatagramScheduler::ClassId pending_class_;
+  uint64_t pending_wait_us_;
+
+  unsigned int spin_budget_us_;
+
+  /* socket buffers are sized to hold the controller's window (see size_buffers) */
+  int buffer_bytes_;
+  bool force_buffers_;
+  void size_buffers( void );
+
+  /* learned path profiles, checkpointed while running (optional) */
+  std::unique_ptr<PathCache> path_cache_;
+  std::string path_key_;
+  uint64_t next_checkpoint_;
+
+  void checkpoint( void );
+
+  /* kernel transmit timestamps (optional): datagrams still waiting for their
+     stamp, in send order, as (sequence number, user-space send time), and a
+     ring of recent departure times, as (sequence number, departure time) */
+  bool tx_timestamps_, tx_hardware_;
+  bool tx_hardware_seen_; /* the NIC stamps: ignore the kernel's software stamps */
+  std::deque<std::pair<uint64_t, uint64_t>> awaiting_departure_;
+  uint32_t first_awaiting_id_; /* kernel's id for the front of awaiting_departure_ */
+  std::vector<std::pair<uint64_t, uint64_t>> departures_;
+
+  void await_departure( const ContestMessage & cm );
+  void read_tx_timestamps( void );
+  void restart_tx_timestamps( void );
+  uint64_t departure_time( const uint64_t sequence_number, const uint64_t send_timestamp ) const;
+
+  /* pipelined mode: the thread doing the socket I/O, while loop() runs */
+  bool use_io_thread_;
+  std::unique_ptr<SenderIOThread> io_;
+  static const size_t IO_PORT = 0;
+
+  SenderStats stats_;
+
+  /* acks taken off the socket (or the I/O thread's ring) in a burst, with
+     when each arrived, and their headers, which are parsed all together */
+  std::vector<std::string> ack_batch_;
+  std::vector<uint64_t> ack_batch_times_;
+  std::vector<ContestMessage::Header> ack_batch_headers_;
+
+  /* hand a datagram to the socket (or the I/O thread); false if it is full */
+  bool transmit( const ContestMessage & cm );
+
+  bool send_datagram( void );
+  void got_ack( const uint64_t timestamp, const ContestMessage & msg );
+  void got_acks( const size_t count );
+  bool window_is_open( void );
+  void fill_window( void );
+  int run( const uint64_t deadline_ms );
+
+  /* what run() does, as coroutines on its event loop; they tell each other
+     through progress when the window may have opened or the queues drained */
+  Task<> send_while_open( EventLoop & loop, EventLoop::Signal & progress );
+  Task<> take_acks( EventLoop & loop, EventLoop::Signal & progress );
+  Task<> retransmit_on_timeout( EventLoop & loop, EventLoop::Signal & progress );
+  Task<> take_messages( EventLoop & loop, EventLoop::Signal & progress, MessageInput & input );
+  Task<> take_io_wakeups( EventLoop & loop );
+  bool socket_failed( EventLoop & loop, const short revents );
+
+public:
+  DatagrumpSender( const Address & peer, const bool debug );
+
+  void set_spin_budget( const unsigned int spin_budget_us ) override;
+  void use_path_cache( const std::string & filename ) override;
+  void use_tx_timestamps( const bool hardware ) override;
+  void use_stream( const std::string & filename ) override;
+  void use_fec( void ) override;
+  void add_message_class( const std::string & filename, const unsigned int weight,
+			  const bool priority ) override;
+  void use_io_thread( void ) override { use_io_thread_ = true; }
+  int loop( const uint64_t deadline_ms ) override;
+  using DatagrumpSenderBase::loop;
+
+  const SenderStats & stats( void ) const override { return stats_; }
+};
+
+/* grow a socket's buffers (if need be) to hold twice a window of datagrams;
+   buffer_bytes is what they hold now, and force is cleared once forcing fails */
+void grow_socket_buffers( UDPSocket & socket, const unsigned int window,
+			  int & buffer_bytes, bool & force );
+
+/* names of the prebuilt controllers, default first */
+const std::vector<std::string> & controller_names( void );
+
+/* a sender built with the named controller (throws if there is no such controller);
+   with local addresses or interfaces in via, a MultipathSender with a subflow on each */
+std::unique_ptr<DatagrumpSenderBase> make_datagrump_sender( const std::string & controller,
+							    const Address & peer,
+							    const bool debug,
+							    const std::vector<std::string> & via = {} );
+
+#endif /* DATAGRUMP_SENDER_HH */
@@ -0,0 +1,432 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+
+#include "delivery_log.hh"
+#include "little_endian.hh"
+#include "util.hh"
+
+using namespace std;
+
+static const char LOG_MAGIC[ 8 ] = { 'D', 'G', 'L', 'O', 'G', '0', '0', '1' };
+static const size_t FILE_HEADER_SIZE = 16;
+static const size_t BLOCK_HEADER_SIZE = 16;
+
+/* bytes per event, over all the columns */
+static const size_t EVENT_SIZE = sizeof( uint64_t ) + 2 * sizeof( uint32_t ) + sizeof( uint8_t );
+
+/* events per block the writer fills before appending it (about 68 KiB) */
+static const uint32_t BLOCK_EVENTS = 4096;
+
+/* a block of count events, header and padding included */
+static size_t block_size( const uint32_t count )
+{
+  return BLOCK_HEADER_SIZE + (count * EVENT_SIZE + 7) / 8 * 8;
+}
+
+static int create_log( const string & filename )
+{
+  return SystemCall( "open " + filename,
+		     open( filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644 ) );
+}
+
+/* start a new log */
+DeliveryLogWriter::DeliveryLogWriter( const string & filename )
+  : file_( create_log( filename ) ),
+    timestamps_us_(),
+    bytes_(),
+    sequence_numbers_(),
+    types_(),
+    block_(),
+    count_( 0 )
+{
+  timestamps_us_.reserve( BLOCK_EVENTS );
+  bytes_.reserve( BLOCK_EVENTS );
+  sequence_numbers_.reserve( BLOCK_EVENTS );
+  types_.reserve( BLOCK_EVENTS );
+
+  string header( FILE_HEADER_SIZE, 0 );
+  memcpy( &header[ 0 ], LOG_MAGIC, sizeof( LOG_MAGIC ) );
+  put_le32( &header[ 8 ], BLOCK_EVENTS );
+  file_.write( header );
+}
+
+/* write out the last block */
+DeliveryLogWriter::~DeliveryLogWriter()
+{
+  try {
+    flush();
+  } catch ( const exception & e ) {
+    print_exception( e );
+  }
+}
+
+void DeliveryLogWriter::log( const DeliveryEvent & event )
+{
+  timestamps_us_.push_back( event.timestamp_us );
+  bytes_.push_back( event.bytes );
+  sequence_numbers_.push_back( event.sequence_number );
+  types_.push_back( static_cast<uint8_t>( event.type ) );
+  count_++;
+
+  if ( types_.size() == BLOCK_EVENTS ) {
+    flush();
+  }
+}
+
+/* encode the block being filled, column by column, and append it */
+void DeliveryLogWriter::flush( void )
+{
+  const uint32_t count = types_.size();
+  if ( count == 0 ) {
+    return;
+  }
+
+  block_.assign( block_size( count ), 0 );
+  char * out = &block_[ 0 ];
+  put_le32( out, count );
+  put_le64( out + 8, timestamps_us_.front() );
+  out += BLOCK_HEADER_SIZE;
+
+  for ( const auto & timestamp_us : timestamps_us_ ) {
+    put_le64( out, timestamp_us );
+    out += sizeof( uint64_t );
+  }
+  for ( const auto & bytes : bytes_ ) {
+    put_le32( out, bytes );
+    out += sizeof( uint32_t );
+  }
+  for ( const auto & sequence_number : sequence_numbers_ ) {
+    put_le32( out, sequence_number );
+    out += sizeof( uint32_t );
+  }
+  memcpy( out, types_.data(), count );
+
+  file_.write( block_ );
+
+  timestamps_us_.clear();
+  bytes_.clear();
+  sequence_numbers_.clear();
+  types_.clear();
+}
+
+/* open a log */
+DeliveryLogReader::DeliveryLogReader( const string & filename )
+  : file_( filename, MappedFile::Mode::ReadOnly ),
+    block_events_( 0 ),
+    block_offset_( 0 ),
+    next_block_offset_( FILE_HEADER_SIZE ),
+    block_count_( 0 ),
+    block_index_( 0 ),
+    truncated_( false )
+{
+  if ( file_.size() < FILE_HEADER_SIZE or memcmp( file_.data(), LOG_MAGIC, sizeof( LOG_MAGIC ) ) ) {
+    throw runtime_error( filename + " is not a datagrump delivery log" );
+  }
+
+  block_events_ = get_le32( file_.data() + 8 );
+  file_.advise_sequential();
+}
+
+/* move on to the next complete block */
+bool DeliveryLogReader::next_block( void )
+{
+  const size_t remaining = file_.size() - next_block_offset_;
+  if ( remaining == 0 ) {
+    return false;
+  }
+
+  if ( remaining < BLOCK_HEADER_SIZE ) {
+    truncated_ = true;
+    return false;
+  }
+
+  const uint32_t count = get_le32( file_.data() + next_block_offset_ );
+  if ( count == 0 or count > block_events_ ) {
+    throw runtime_error( "delivery log has a corrupt block header" );
+  }
+
+  if ( block_size( count ) > remaining ) {
+    truncated_ = true;
+    return false;
+  }
+
+  block_offset_ = next_block_offset_;
+  next_block_offset_ += block_size( count );
+  block_count_ = count;
+  block_index_ = 0;
+  return true;
+}
+
+/* the next event, picked out of each column of its block */
+bool DeliveryLogReader::next( DeliveryEvent & event )
+{
+  if ( block_index_ == block_count_ and not next_block() ) {
+    return false;
+  }
+
+  const char * const timestamps = file_.data() + block_offset_ + BLOCK_HEADER_SIZE;
+  const char * const bytes = timestamps + block_count_ * sizeof( uint64_t );
+  const char * const sequence_numbers = bytes + block_count_ * sizeof( uint32_t );
+  const char * const types = sequence_numbers + block_count_ * sizeof( uint32_t );
+
+  const uint32_t i = block_index_++;
+  event.timestamp_us = get_le64( timestamps + i * sizeof( uint64_t ) );
+  event.bytes = get_le32( bytes + i * sizeof( uint32_t ) );
+  event.sequence_number = get_le32( sequence_numbers + i * sizeof( uint32_t ) );
+  event.type = static_cast<DeliveryEventType>( types[ i ] );
+  return true;
+}
+
+/* does the file start with the log magic? */
+bool is_binary_delivery_log( const string & filename )
+{
+  ifstream file( filename, ios::binary );
+  char magic[ sizeof( LOG_MAGIC ) ] = {};
+  file.read( magic, sizeof( magic ) );
+  return file and not memcmp( magic, LOG_MAGIC, sizeof( LOG_MAGIC ) );
+}
+
+MahimahiLogReader::MahimahiLogReader( const string & filename )
+  : file_( filename ),
+    base_ms_( 0 ),
+    next_sequence_number_( 0 ),
+    queue_(),
+    pending_()
+{
+  if ( not file_.is_open() ) {
+    throw runtime_error( "could not open " + filename );
+  }
+}
+
+/* The arrival a departure's delay points to. mahimahi's queue is FIFO, so
+   arrivals ahead of it that haven't left by now never will (they were
+   dropped) and are forgotten. */
+uint32_t MahimahiLogReader::match_departure( const uint64_t departure_ms,
+					     const uint32_t bytes,
+					     const uint64_t delay_ms )
+{
+  const uint64_t arrival_ms = departure_ms - delay_ms;
+  for ( auto it = queue_.begin(); it != queue_.end(); ++it ) {
+    if ( it->arrival_ms == arrival_ms and it->bytes == bytes ) {
+      const uint32_t sequence_number = it->sequence_number;
+      queue_.erase( queue_.begin(), it + 1 );
+      return sequence_number;
+    }
+  }
+
+  return NO_SEQUENCE_NUMBER;
+}
+
+/* the next event: "TIME + BYTES" (arrival), "TIME - BYTES DELAY"
+   (departure), "TIME # BYTES" (opportunity) or "TIME d COUNT BYTES" (drops) */
+bool MahimahiLogReader::next( DeliveryEvent & event )
+{
+  if ( not pending_.empty() ) {
+    event = pending_.front();
+    pending_.pop_front();
+    return true;
+  }
+
+  static const string base_prefix = "# base timestamp:";
+
+  string line;
+  while ( getline( file_, line ) ) {
+    if ( line.empty() ) {
+      continue;
+    }
+
+    if ( line[ 0 ] == '#' ) {
+      if ( line.compare( 0, base_prefix.size(), base_prefix ) == 0 ) {
+	base_ms_ = stoull( line.substr( base_prefix.size() ) );
+      }
+      continue;
+    }
+
+    /* (strtoull rather than streams: these logs run to gigabytes) */
+    char * end;
+    const uint64_t ms = strtoull( line.c_str(), &end, 10 );
+    while ( *end == ' ' ) {
+      end++;
+    }
+    const char code = *end ? *end++ : 0;
+    const uint64_t first = strtoull( end, &end, 10 );
+    const uint64_t second = strtoull( end, &end, 10 );
+
+    event.timestamp_us = (ms > base_ms_ ? ms - base_ms_ : 0) * 1000;
+    event.bytes = first;
+    event.sequence_number = NO_SEQUENCE_NUMBER;
+
+    switch ( code ) {
+    case '+':
+      event.type = DeliveryEventType::Arrival;
+      event.sequence_number = next_sequence_number_++;
+      queue_.push_back( { event.sequence_number, ms, event.bytes } );
+      return true;
+    case '-':
+      event.type = DeliveryEventType::Departure;
+      event.sequence_number = match_departure( ms, event.bytes, second );
+      return true;
+    case '#':
+      event.type = DeliveryEventType::Opportunity;
+      return true;
+    case 'd':
+      /* one event per datagram dropped */
+      if ( first == 0 ) {
+	continue;
+      }
+      event.type = DeliveryEventType::Drop;
+      event.bytes = second / first;
+      pending_.insert( pending_.end(), first - 1, event );
+      return true;
+    default:
+      throw runtime_error( "unrecognized line in mahimahi log: " + line );
+    }
+  }
+
+  return false;
+}
+
+DeliveryLogAnalyzer::DeliveryLogAnalyzer( const uint64_t interval_ms,
+					  const function<void( const Interval & )> & report )
+  : interval_us_( max( uint64_t( 1 ), interval_ms ) * 1000 ),
+    report_( report ),
+    started_( false ),
+    first_us_( 0 ),
+    last_us_( 0 ),
+    merged_us_( 0 ),
+    current_( { 0, interval_us_, 0, 0, 0 } ),
+    in_queue_(),
+    arrival_order_(),
+    delay_histogram_ms_( DELAY_BUCKETS ),
+    arrivals( 0 ), departures( 0 ), drops( 0 ), opportunities( 0 ),
+    arrival_bytes( 0 ), departure_bytes( 0 ), opportunity_bytes( 0 )
+{}
+
+/* forget packets that have been in the queue longer than the histogram reaches */
+void DeliveryLogAnalyzer::forget_stale( const uint64_t now_us )
+{
+  const uint64_t horizon_us = (DELAY_BUCKETS - 1) * 1000;
+
+  while ( not arrival_order_.empty() and now_us - arrival_order_.front().second > horizon_us ) {
+    const auto it = in_queue_.find( arrival_order_.front().first );
+    if ( it != in_queue_.end() and it->second == arrival_order_.front().second ) {
+      in_queue_.erase( it );
+    }
+    arrival_order_.pop_front();
+  }
+}
+
+void DeliveryLogAnalyzer::add( const DeliveryEvent & event )
+{
+  if ( not started_ ) {
+    started_ = true;
+    first_us_ = last_us_ = event.timestamp_us;
+  }
+
+  /* (an event out of order counts as happening with the one before) */
+  const uint64_t now = max( event.timestamp_us, last_us_ );
+  last_us_ = now;
+
+  /* close the intervals that are over, including any with no events (an
+     event right at the end of one still counts in it) */
+  while ( now - first_us_ > current_.start_us + interval_us_ ) {
+    report_( current_ );
+    current_ = { current_.start_us + interval_us_, interval_us_, 0, 0, 0 };
+  }
+
+  switch ( event.type ) {
+  case DeliveryEventType::Arrival:
+    arrivals++;
+    arrival_bytes += event.bytes;
+    current_.arrival_bytes += event.bytes;
+    if ( event.sequence_number != NO_SEQUENCE_NUMBER ) {
+      in_queue_[ event.sequence_number ] = now;
+      arrival_order_.emplace_back( event.sequence_number, now );
+      forget_stale( now );
+    }
+    break;
+  case DeliveryEventType::Departure:
+    {
+      departures++;
+      departure_bytes += event.bytes;
+      current_.departure_bytes += event.bytes;
+
+      const auto it = in_queue_.find( event.sequence_number );
+      if ( event.sequence_number != NO_SEQUENCE_NUMBER and it != in_queue_.end() ) {
+	const uint64_t delay_ms = (now - it->second) / 1000;
+	delay_histogram_ms_.at( min( delay_ms, uint64_t( DELAY_BUCKETS - 1 ) ) )++;
+	in_queue_.erase( it );
+      }
+    }
+    break;
+  case DeliveryEventType::Drop:
+    drops++;
+    if ( event.sequence_number != NO_SEQUENCE_NUMBER ) {
+      in_queue_.erase( event.sequence_number );
+    }
+    break;
+  case DeliveryEventType::Opportunity:
+    opportunities++;
+    opportunity_bytes += event.bytes;
+    current_.opportunity_bytes += event.bytes;
+    break;
+  }
+}
+
+/* report the last, partial interval */
+void DeliveryLogAnalyzer::finish( void )
+{
+  if ( not started_ ) {
+    return;
+  }
+
+  current_.length_us = max( uint64_t( 1 ), last_us_ - first_us_ - current_.start_us );
+  report_( current_ );
+}
+
+/* fold in another log's totals and delays */
+void DeliveryLogAnalyzer::merge( const DeliveryLogAnalyzer & other )
+{
+  merged_us_ += other.duration_us();
+
+  for ( size_t i = 0; i < DELAY_BUCKETS; i++ ) {
+    delay_histogram_ms_[ i ] += other.delay_histogram_ms_[ i ];
+  }
+
+  arrivals += other.arrivals;
+  departures += other.departures;
+  drops += other.drops;
+  opportunities += other.opportunities;
+  arrival_bytes += other.arrival_bytes;
+  departure_bytes += other.departure_bytes;
+  opportunity_bytes += other.opportunity_bytes;
+}
+
+uint64_t DeliveryLogAnalyzer::delay_samples( void ) const
+{
+  uint64_t total = 0;
+  for ( const auto & count : delay_histogram_ms_ ) {
+    total += count;
+  }
+  return total;
+}
+
+/* smallest delay such that the given fraction of departures waited no longer */
+uint64_t DeliveryLogAnalyzer::delay_percentile( const double fraction ) const
+{
+  const uint64_t total = delay_samples();
+
+  uint64_t seen = 0;
+  for ( size_t i = 0; i < delay_histogram_ms_.size(); i++ ) {
+    seen += delay_histogram_ms_[ i ];
+    if ( seen > 0 and seen >= fraction * total ) {
+      return i;
+    }
+  }
+
+  return 0;
+}
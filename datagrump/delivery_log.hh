@@ -0,0 +1,192 @@
+#ifndef DELIVERY_LOG_HH
+#define DELIVERY_LOG_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "file_descriptor.hh"
+#include "mapped_file.hh"
+
+/* Per-packet log of what happened at a bottleneck, like mahimahi's
+   --uplink-log (the benchmark writes one with -L). The event codes are
+   mahimahi's: a packet entering the queue, leaving it (delivered), being
+   dropped, or an opportunity to deliver one. */
+enum class DeliveryEventType : uint8_t { Arrival = '+', Departure = '-', Drop = 'd', Opportunity = '#' };
+
+struct DeliveryEvent
+{
+  uint64_t timestamp_us;
+  uint32_t bytes;
+  uint32_t sequence_number; /* low 32 bits (NO_SEQUENCE_NUMBER if unknown) */
+  DeliveryEventType type;
+};
+
+static const uint32_t NO_SEQUENCE_NUMBER = -1;
+
+/* Binary, columnar version of the log. The file is a 16-byte header (the
+   magic "DGLOG001", the most events per block, and a reserved word), then
+   a series of blocks, each a 16-byte header (its event count, a reserved
+   word and the time of its first event) followed by its events one column
+   at a time: the timestamps (8 bytes each), sizes (4), sequence numbers
+   (4) and event codes (1), padded to a multiple of 8 bytes. Everything is
+   little-endian.
+
+   The writer fills a block in memory and appends it to the file with one
+   write(), so logging costs a few stores per packet; a writer that is
+   killed loses only the block it was filling. */
+class DeliveryLogWriter
+{
+private:
+  FileDescriptor file_;
+
+  /* the block being filled, a column at a time */
+  std::vector<uint64_t> timestamps_us_;
+  std::vector<uint32_t> bytes_, sequence_numbers_;
+  std::vector<uint8_t> types_;
+
+  std::string block_; /* encoding buffer (reused) */
+  uint64_t count_;
+
+public:
+  /* start a new log (replacing any file of that name) */
+  DeliveryLogWriter( const std::string & filename );
+
+  /* write out the last block */
+  ~DeliveryLogWriter();
+
+  DeliveryLogWriter( const DeliveryLogWriter & other ) = delete;
+  DeliveryLogWriter & operator=( const DeliveryLogWriter & other ) = delete;
+
+  void log( const DeliveryEvent & event );
+
+  /* append the events logged so far to the file */
+  void flush( void );
+
+  uint64_t size( void ) const { return count_; }
+};
+
+/* Reads a binary log straight from a read-only mapping, one event at a
+   time, so logs much bigger than memory can be scanned */
+class DeliveryLogReader
+{
+private:
+  MappedFile file_;
+  uint32_t block_events_; /* the most events a block may hold (from the header) */
+  size_t block_offset_, next_block_offset_;
+  uint32_t block_count_, block_index_; /* events in the current block, and those read */
+  bool truncated_;
+
+  bool next_block( void );
+
+public:
+  /* open a log (throws if it isn't one) */
+  DeliveryLogReader( const std::string & filename );
+
+  /* the next event (false at the end of the log) */
+  bool next( DeliveryEvent & event );
+
+  /* did the log end partway through a block (a writer that was killed)? */
+  bool truncated( void ) const { return truncated_; }
+};
+
+/* Reads a mahimahi text log (e.g. run-contest's /tmp/contest_uplink_log)
+   as the same events, a line at a time. mahimahi doesn't log sequence
+   numbers, so arrivals are numbered in order and each departure is matched
+   to the arrival its queueing delay points to. */
+class MahimahiLogReader
+{
+private:
+  std::ifstream file_;
+  uint64_t base_ms_; /* from the "# base timestamp:" line */
+  uint32_t next_sequence_number_;
+
+  /* arrivals not yet matched to a departure: sequence number, ms, bytes */
+  struct Queued
+  {
+    uint32_t sequence_number;
+    uint64_t arrival_ms;
+    uint32_t bytes;
+  };
+  std::deque<Queued> queue_;
+
+  /* the rest of a line that stands for several events (drops) */
+  std::deque<DeliveryEvent> pending_;
+
+  uint32_t match_departure( const uint64_t departure_ms, const uint32_t bytes, const uint64_t delay_ms );
+
+public:
+  MahimahiLogReader( const std::string & filename );
+
+  bool next( DeliveryEvent & event );
+};
+
+/* does the file start with the delivery log magic? */
+bool is_binary_delivery_log( const std::string & filename );
+
+/* One-pass analysis of a log of any size: the throughput in each interval
+   (handed to a callback as soon as the interval is over) and the
+   distribution of queueing delays. Memory use depends on how many packets
+   arrive within the longest delay measured, not on the length of the log. */
+class DeliveryLogAnalyzer
+{
+public:
+  struct Interval
+  {
+    uint64_t start_us, length_us; /* start since the first event (the last interval is short) */
+    uint64_t arrival_bytes, departure_bytes, opportunity_bytes;
+  };
+
+  /* queueing delays are bucketed by millisecond; the last bucket collects the overflow */
+  static const size_t DELAY_BUCKETS = 10001;
+
+private:
+  uint64_t interval_us_;
+  std::function<void( const Interval & )> report_;
+
+  bool started_;
+  uint64_t first_us_, last_us_;
+  uint64_t merged_us_; /* how long the logs merged in (see merge) ran */
+  Interval current_;
+
+  /* packets in the queue: arrival time by sequence number, and the same
+     in arrival order, to forget ones that never left (after DELAY_BUCKETS ms) */
+  std::unordered_map<uint32_t, uint64_t> in_queue_;
+  std::deque<std::pair<uint32_t, uint64_t>> arrival_order_;
+
+  std::vector<uint64_t> delay_histogram_ms_;
+
+  void forget_stale( const uint64_t now_us );
+
+public:
+  uint64_t arrivals, departures, drops, opportunities;
+  uint64_t arrival_bytes, departure_bytes, opportunity_bytes;
+
+  DeliveryLogAnalyzer( const uint64_t interval_ms, const std::function<void( const Interval & )> & report );
+
+  /* events must come in time order (as logged) */
+  void add( const DeliveryEvent & event );
+
+  /* report the last, partial interval */
+  void finish( void );
+
+  /* fold in another log's totals and delays, for a summary over several
+     logs (its duration adds to this one's; its intervals are not reported) */
+  void merge( const DeliveryLogAnalyzer & other );
+
+  /* time from the first event to the last (plus the durations merged in) */
+  uint64_t duration_us( void ) const { return last_us_ - first_us_ + merged_us_; }
+
+  /* departures whose arrival was in the log */
+  uint64_t delay_samples( void ) const;
+
+  /* smallest delay such that the given fraction of departures waited no longer */
+  uint64_t delay_percentile( const double fraction ) const;
+};
+
+#endif /* DELIVERY_LOG_HH */
@@ -0,0 +1,214 @@
+/* analyze per-packet delivery logs, binary or mahimahi, in one streaming pass */
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "delivery_log.hh"
+#include "thread_pool.hh"
+#include "util.hh"
+
+using namespace std;
+
+static void usage( const char * const argv0 )
+{
+  cerr << "Usage: " << argv0 << " analyze LOG [INTERVAL_MS]" << endl
+       << "       " << argv0 << " summary LOG..." << endl
+       << "       " << argv0 << " from-mahimahi INPUT LOG" << endl
+       << "   analyze prints the throughput in each interval (default 500 ms) and" << endl
+       << "   the queueing delay distribution of a binary log (benchmark -L) or a" << endl
+       << "   mahimahi one (mm-link --uplink-log); summary analyzes many logs at" << endl
+       << "   once, on every core, into one table; from-mahimahi converts a" << endl
+       << "   mahimahi log to a binary one" << endl;
+}
+
+/* feed every event of a log to the analyzer */
+template <class Reader>
+static void scan( Reader & reader, DeliveryLogAnalyzer & analyzer )
+{
+  DeliveryEvent event;
+  while ( reader.next( event ) ) {
+    analyzer.add( event );
+  }
+  analyzer.finish();
+}
+
+/* feed a log of either kind to the analyzer (true if it was cut short) */
+static bool scan_log( const string & input, DeliveryLogAnalyzer & analyzer )
+{
+  if ( is_binary_delivery_log( input ) ) {
+    DeliveryLogReader reader( input );
+    scan( reader, analyzer );
+    return reader.truncated();
+  }
+
+  MahimahiLogReader reader( input );
+  scan( reader, analyzer );
+  return false;
+}
+
+static double mbps( const uint64_t bytes, const uint64_t us )
+{
+  return us ? bytes * 8.0 / us : 0;
+}
+
+static void analyze( const string & input, const uint64_t interval_ms )
+{
+  cout << "# time (s), offered load, throughput and capacity (Mbit/s)" << endl << fixed;
+
+  DeliveryLogAnalyzer analyzer( interval_ms, [] ( const DeliveryLogAnalyzer::Interval & interval ) {
+      cout << setprecision( 3 ) << interval.start_us / 1e6
+	   << setprecision( 2 ) << " " << mbps( interval.arrival_bytes, interval.length_us )
+	   << " " << mbps( interval.departure_bytes, interval.length_us )
+	   << " " << mbps( interval.opportunity_bytes, interval.length_us ) << "\n";
+    } );
+
+  if ( scan_log( input, analyzer ) ) {
+    cerr << input << ": log ends partway through a block (ignored)" << endl;
+  }
+
+  cout.flush();
+
+  const uint64_t duration_us = analyzer.duration_us();
+  cerr << "duration: " << duration_us / 1e6 << " s" << endl;
+  cerr << "packets: " << analyzer.arrivals << " arrived, " << analyzer.departures << " delivered, "
+       << analyzer.drops << " dropped" << endl;
+  if ( analyzer.opportunities ) {
+    cerr << "average capacity: " << mbps( analyzer.opportunity_bytes, duration_us ) << " Mbit/s" << endl;
+  }
+  cerr << "average throughput: " << mbps( analyzer.departure_bytes, duration_us ) << " Mbit/s";
+  if ( analyzer.opportunity_bytes ) {
+    cerr << " (" << 100.0 * analyzer.departure_bytes / analyzer.opportunity_bytes << "% utilization)";
+  }
+  cerr << endl;
+  if ( analyzer.delay_samples() ) {
+    cerr << "queueing delay (ms): min " << analyzer.delay_percentile( 0 )
+	 << ", median " << analyzer.delay_percentile( 0.5 )
+	 << ", p95 " << analyzer.delay_percentile( 0.95 )
+	 << ", p99 " << analyzer.delay_percentile( 0.99 )
+	 << ", max " << analyzer.delay_percentile( 1 ) << endl;
+  }
+}
+
+/* one row of the summary table */
+static void print_summary_row( const string & name, const size_t width, const DeliveryLogAnalyzer & analyzer )
+{
+  const uint64_t duration_us = analyzer.duration_us();
+
+  cout << left << setw( width ) << name << right << fixed << setprecision( 1 )
+       << setw( 9 ) << duration_us / 1e6
+       << setw( 11 ) << analyzer.arrivals
+       << setw( 11 ) << analyzer.departures
+       << setw( 9 ) << analyzer.drops
+       << setprecision( 2 ) << setw( 10 ) << mbps( analyzer.departure_bytes, duration_us );
+
+  if ( analyzer.opportunity_bytes ) {
+    cout << setprecision( 1 ) << setw( 7 ) << 100.0 * analyzer.departure_bytes / analyzer.opportunity_bytes << "%";
+  } else {
+    cout << setw( 8 ) << "-";
+  }
+
+  if ( analyzer.delay_samples() ) {
+    cout << setw( 7 ) << analyzer.delay_percentile( 0.5 )
+	 << setw( 7 ) << analyzer.delay_percentile( 0.95 )
+	 << setw( 7 ) << analyzer.delay_percentile( 0.99 );
+  } else {
+    cout << setw( 7 ) << "-" << setw( 7 ) << "-" << setw( 7 ) << "-";
+  }
+  cout << endl;
+}
+
+/* Analyze each log on a worker of the pool, then print a row per log and
+   one for all of them together (their delays pooled, their times added) */
+static void summary( const vector<string> & inputs )
+{
+  struct LogSummary
+  {
+    DeliveryLogAnalyzer analyzer;
+    bool truncated;
+  };
+
+  const auto ignore_intervals = [] ( const DeliveryLogAnalyzer::Interval & ) {};
+
+  ThreadPool pool;
+  const vector<LogSummary> logs = pool.map_reduce(
+    inputs.size(),
+    [&] ( const size_t i ) {
+      LogSummary log { DeliveryLogAnalyzer( 1000, ignore_intervals ), false };
+      log.truncated = scan_log( inputs[ i ], log.analyzer );
+      return log;
+    },
+    vector<LogSummary>(),
+    [] ( vector<LogSummary> && all, LogSummary && log ) {
+      all.push_back( move( log ) );
+      return all;
+    } );
+
+  size_t width = 5;
+  for ( const auto & input : inputs ) {
+    width = max( width, input.size() + 2 );
+  }
+
+  cout << left << setw( width ) << "log" << right
+       << setw( 9 ) << "seconds" << setw( 11 ) << "arrived" << setw( 11 ) << "delivered"
+       << setw( 9 ) << "dropped" << setw( 10 ) << "Mbit/s" << setw( 8 ) << "util"
+       << setw( 7 ) << "p50" << setw( 7 ) << "p95" << setw( 7 ) << "p99" << "  (queueing delay, ms)" << endl;
+
+  DeliveryLogAnalyzer total( 1000, ignore_intervals );
+  for ( size_t i = 0; i < logs.size(); i++ ) {
+    print_summary_row( inputs[ i ], width, logs[ i ].analyzer );
+    total.merge( logs[ i ].analyzer );
+    if ( logs[ i ].truncated ) {
+      cerr << inputs[ i ] << ": log ends partway through a block (ignored)" << endl;
+    }
+  }
+
+  if ( logs.size() > 1 ) {
+    print_summary_row( "all", width, total );
+  }
+
+  cerr << logs.size() << " logs analyzed on " << pool.size() << " threads" << endl;
+}
+
+/* mahimahi log to binary log */
+static void from_mahimahi( const string & input, const string & output )
+{
+  MahimahiLogReader reader( input );
+  DeliveryLogWriter writer( output );
+
+  DeliveryEvent event;
+  while ( reader.next( event ) ) {
+    writer.log( event );
+  }
+  writer.flush();
+
+  cerr << output << ": " << writer.size() << " events" << endl;
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  try {
+    const string command = argc > 1 ? argv[ 1 ] : "";
+    if ( command == "analyze" and (argc == 3 or argc == 4) ) {
+      analyze( argv[ 2 ], argc == 4 ? stoull( argv[ 3 ] ) : 500 );
+    } else if ( command == "summary" and argc >= 3 ) {
+      summary( vector<string>( argv + 2, argv + argc ) );
+    } else if ( command == "from-mahimahi" and argc == 4 ) {
+      from_mahimahi( argv[ 2 ], argv[ 3 ] );
+    } else {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "estimator.hh"
+
+using namespace std;
+
+/* datagrams whose send records are kept (a power of two, above any window) */
+static const size_t IN_FLIGHT_RING = 1 << 14;
+
+/* min RTT is the smallest over this many milliseconds (as in BBR) */
+static const uint64_t MIN_RTT_WINDOW = 10000;
+
+/* bottleneck bandwidth is the highest over this many round trips (as in BBR) */
+static const uint64_t BANDWIDTH_WINDOW = 10;
+
+/* gains for the smoothed RTT and its variance (RFC 6298) */
+static const double SRTT_ALPHA = 1.0 / 8;
+static const double RTTVAR_BETA = 1.0 / 4;
+
+Estimator::Estimator()
+  : in_flight_( IN_FLIGHT_RING, SendRecord { uint64_t( -1 ), 0, 0, 0, 0 } ),
+    delivered_( 0 ), delivered_time_( 0 ), first_sent_time_( 0 ),
+    round_count_( 0 ), next_round_delivered_( 0 ),
+    min_rtt_( MIN_RTT_WINDOW ), bandwidth_( BANDWIDTH_WINDOW ),
+    latest_delivery_rate_( 0 ),
+    has_rtt_sample_( false ), srtt_( 0 ), rttvar_( 0 ), latest_rtt_( 0 ),
+    min_one_way_delay_( INT64_MAX ), queueing_delay_( 0 )
+{}
+
+/* A datagram was sent: snapshot the delivery state, for its rate sample later */
+void Estimator::datagram_was_sent( const uint64_t sequence_number, const uint64_t send_timestamp )
+{
+  /* no ack yet and no earlier send (one at time 0 just sets this again):
+     the first sending interval starts with this datagram */
+  if ( delivered_time_ == 0 ) {
+    delivered_time_ = first_sent_time_ = send_timestamp;
+  }
+
+  in_flight_[ sequence_number & (IN_FLIGHT_RING - 1) ] =
+    { sequence_number, send_timestamp, delivered_, delivered_time_, first_sent_time_ };
+}
+
+/* An ack was received */
+void Estimator::ack_received( const uint64_t sequence_number_acked,
+			      const uint64_t send_timestamp_acked,
+			      const uint64_t recv_timestamp_acked,
+			      const uint64_t timestamp_ack_received )
+{
+  /* RTT: windowed minimum, and smoothed as in RFC 6298 */
+  const uint64_t rtt = timestamp_ack_received - send_timestamp_acked;
+  latest_rtt_ = rtt;
+  min_rtt_.update( rtt, timestamp_ack_received );
+
+  if ( not has_rtt_sample_ ) {
+    has_rtt_sample_ = true;
+    srtt_ = rtt;
+    rttvar_ = rtt / 2.0;
+  } else {
+    rttvar_ = (1 - RTTVAR_BETA) * rttvar_ + RTTVAR_BETA * abs( srtt_ - rtt );
+    srtt_ = (1 - SRTT_ALPHA) * srtt_ + SRTT_ALPHA * rtt;
+  }
+
+  /* queueing delay: one-way delay above the smallest seen (the clock offset cancels) */
+  const int64_t one_way_delay = int64_t( recv_timestamp_acked - send_timestamp_acked );
+  min_one_way_delay_ = min( min_one_way_delay_, one_way_delay );
+  queueing_delay_ = one_way_delay - min_one_way_delay_;
+
+  /* delivery rate, from the state when the acked datagram was sent */
+  delivered_++;
+  delivered_time_ = timestamp_ack_received;
+
+  const SendRecord & record = in_flight_[ sequence_number_acked & (IN_FLIGHT_RING - 1) ];
+  if ( record.sequence_number != sequence_number_acked ) {
+    return; /* sent too long ago to still have its record */
+  }
+
+  first_sent_time_ = record.sent;
+
+  if ( record.delivered >= next_round_delivered_ ) {
+    next_round_delivered_ = delivered_;
+    round_count_++;
+  }
+
+  /* the slower of the send and ack rates over the datagram's flight (so
+     neither a burst of sends nor a burst of acks overstates the rate) */
+  const uint64_t send_elapsed = record.sent - record.first_sent_time;
+  const uint64_t ack_elapsed = delivered_time_ - record.delivered_time;
+  const uint64_t interval = max( send_elapsed, ack_elapsed );
+
+  /* intervals shorter than the min RTT are mostly noise from bursts (BBR
+     discards them too), and a millisecond clock can't measure them anyway */
+  if ( interval == 0 or interval < min_rtt() ) {
+    return;
+  }
+
+  latest_delivery_rate_ = double( delivered_ - record.delivered ) / interval;
+  bandwidth_.update( latest_delivery_rate_, round_count_ );
+}
+
+/* start from what an earlier run learned */
+void Estimator::warm_start( const uint64_t min_rtt, const double delivery_rate, const uint64_t timestamp )
+{
+  if ( min_rtt ) {
+    min_rtt_.update( min_rtt, timestamp );
+  }
+  if ( delivery_rate > 0 ) {
+    bandwidth_.update( delivery_rate, round_count_ );
+  }
+}
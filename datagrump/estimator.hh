@@ -0,0 +1,165 @@
+#ifndef ESTIMATOR_HH
+#define ESTIMATOR_HH
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/* Kathleen Nichols' windowed min/max filter (as in BBR and Linux's
+   win_minmax): tracks the best value seen over a sliding window of time
+   by keeping the best, second-best and third-best samples from successive
+   sub-windows, so each update is O(1) and needs three samples of memory.
+   Better is std::greater_equal for a max filter, std::less_equal for a min. */
+template <typename T, typename Better>
+class WindowedFilter
+{
+private:
+  struct Sample
+  {
+    uint64_t time;
+    T value;
+  };
+
+  uint64_t window_;
+  Sample best_[ 3 ];
+  bool empty_;
+
+  /* start over with just this sample */
+  void reset( const Sample & sample )
+  {
+    best_[ 0 ] = best_[ 1 ] = best_[ 2 ] = sample;
+    empty_ = false;
+  }
+
+public:
+  explicit WindowedFilter( const uint64_t window )
+    : window_( window ), best_(), empty_( true ) {}
+
+  /* add a sample taken at time (times must not go backwards) */
+  void update( const T & value, const uint64_t time )
+  {
+    const Sample sample { time, value };
+    const Better better;
+
+    /* a new best, or nothing left in the window: forget everything else */
+    if ( empty_ or better( value, best_[ 0 ].value ) or time - best_[ 2 ].time > window_ ) {
+      reset( sample );
+      return;
+    }
+
+    if ( better( value, best_[ 1 ].value ) ) {
+      best_[ 2 ] = best_[ 1 ] = sample;
+    } else if ( better( value, best_[ 2 ].value ) ) {
+      best_[ 2 ] = sample;
+    }
+
+    /* age out the best sample once it has left the window */
+    const uint64_t age = time - best_[ 0 ].time;
+    if ( age > window_ ) {
+      best_[ 0 ] = best_[ 1 ];
+      best_[ 1 ] = best_[ 2 ];
+      best_[ 2 ] = sample;
+      if ( time - best_[ 0 ].time > window_ ) {
+	best_[ 0 ] = best_[ 1 ];
+	best_[ 1 ] = best_[ 2 ];
+	best_[ 2 ] = sample;
+      }
+    } else if ( best_[ 1 ].time == best_[ 0 ].time and age > window_ / 4 ) {
+      /* a quarter of the window passed without a second choice: take this one */
+      best_[ 2 ] = best_[ 1 ] = sample;
+    } else if ( best_[ 2 ].time == best_[ 1 ].time and age > window_ / 2 ) {
+      /* likewise for the third choice after half the window */
+      best_[ 2 ] = sample;
+    }
+  }
+
+  bool empty( void ) const { return empty_; }
+
+  /* best value in the window (only meaningful if not empty) */
+  const T & best( void ) const { return best_[ 0 ].value; }
+};
+
+template <typename T> using WindowedMaxFilter = WindowedFilter<T, std::greater_equal<T>>;
+template <typename T> using WindowedMinFilter = WindowedFilter<T, std::less_equal<T>>;
+
+/* Path estimates that any controller can keep, updated in O(1) per
+   datagram and per ack: windowed min RTT, smoothed RTT and RTT variance
+   (as in RFC 6298), queueing delay from one-way delays, and delivery-rate
+   samples (as in BBR) with a windowed max of them as the bottleneck
+   bandwidth. Times are in milliseconds and rates in datagrams per
+   millisecond. Assumes an ack for every datagram delivered, as the
+   datagrump receiver sends. */
+class Estimator
+{
+private:
+  /* what was known about deliveries when a datagram was sent */
+  struct SendRecord
+  {
+    uint64_t sequence_number;
+    uint64_t sent;
+    uint64_t delivered;
+    uint64_t delivered_time;
+    uint64_t first_sent_time;
+  };
+
+  std::vector<SendRecord> in_flight_; /* ring, indexed by sequence number */
+
+  /* delivery accounting */
+  uint64_t delivered_; /* datagrams acked so far */
+  uint64_t delivered_time_; /* when the latest ack arrived */
+  uint64_t first_sent_time_; /* when the latest acked datagram was sent */
+
+  /* round trips, counted as in BBR: a round ends when a datagram sent after it began is acked */
+  uint64_t round_count_;
+  uint64_t next_round_delivered_;
+
+  WindowedMinFilter<uint64_t> min_rtt_;
+  WindowedMaxFilter<double> bandwidth_;
+  double latest_delivery_rate_;
+
+  bool has_rtt_sample_;
+  double srtt_, rttvar_;
+  uint64_t latest_rtt_;
+
+  /* one-way delays are measured across two clocks, so only their
+     difference from the smallest one seen means anything */
+  int64_t min_one_way_delay_;
+  uint64_t queueing_delay_;
+
+public:
+  Estimator();
+
+  /* A datagram was sent */
+  void datagram_was_sent( const uint64_t sequence_number, const uint64_t send_timestamp );
+
+  /* An ack was received */
+  void ack_received( const uint64_t sequence_number_acked,
+		     const uint64_t send_timestamp_acked,
+		     const uint64_t recv_timestamp_acked,
+		     const uint64_t timestamp_ack_received );
+
+  /* smallest RTT over the last 10 seconds (-1 if there have been no samples) */
+  uint64_t min_rtt( void ) const { return min_rtt_.empty() ? -1 : min_rtt_.best(); }
+
+  /* has any ack been timed yet? (an RTT of 0 ms is a real sample) */
+  bool has_rtt_sample( void ) const { return has_rtt_sample_; }
+
+  /* smoothed RTT and its mean deviation (zero before the first sample) */
+  double srtt( void ) const { return srtt_; }
+  double rttvar( void ) const { return rttvar_; }
+  uint64_t latest_rtt( void ) const { return latest_rtt_; }
+
+  /* how much longer the latest datagram took to arrive than the quickest one */
+  uint64_t queueing_delay( void ) const { return queueing_delay_; }
+
+  /* highest delivery rate over the last 10 round trips, and the latest sample */
+  double delivery_rate( void ) const { return bandwidth_.empty() ? 0 : bandwidth_.best(); }
+  double latest_delivery_rate( void ) const { return latest_delivery_rate_; }
+
+  uint64_t round_count( void ) const { return round_count_; }
+
+  /* start from what an earlier run learned */
+  void warm_start( const uint64_t min_rtt, const double delivery_rate, const uint64_t timestamp );
+};
+
+#endif /* ESTIMATOR_HH */
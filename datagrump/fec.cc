@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <cstring>
+
+#include <endian.h>
+
+#include "fec.hh"
+
+#if defined( __x86_64__ )
+#define FEC_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+/* data datagrams the receiver remembers (a power of two, well above a group) */
+static const size_t RECENT_RING = 1024;
+
+/* gain of the smoothed loss rate, per datagram */
+static const double LOSS_GAIN = 1.0 / 512;
+
+/* portable version, a word at a time */
+static void xor_scalar( char * const dst, const char * const src, const size_t n )
+{
+  size_t i = 0;
+  for ( ; i + 8 <= n; i += 8 ) {
+    uint64_t a, b;
+    memcpy( &a, dst + i, 8 );
+    memcpy( &b, src + i, 8 );
+    a ^= b;
+    memcpy( dst + i, &a, 8 );
+  }
+
+  for ( ; i < n; i++ ) {
+    dst[ i ] ^= src[ i ];
+  }
+}
+
+#ifdef FEC_X86
+/* 16 bytes per instruction (every x86-64 CPU has SSE2) */
+static void xor_sse2( char * const dst, const char * const src, const size_t n )
+{
+  size_t i = 0;
+  for ( ; i + 16 <= n; i += 16 ) {
+    const __m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i *>( dst + i ) );
+    const __m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + i ) );
+    _mm_storeu_si128( reinterpret_cast<__m128i *>( dst + i ), _mm_xor_si128( a, b ) );
+  }
+
+  xor_scalar( dst + i, src + i, n - i );
+}
+
+/* 32 bytes per instruction */
+__attribute__(( target( "avx2" ) ))
+static void xor_avx2( char * const dst, const char * const src, const size_t n )
+{
+  size_t i = 0;
+  for ( ; i + 32 <= n; i += 32 ) {
+    const __m256i a = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( dst + i ) );
+    const __m256i b = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( src + i ) );
+    _mm256_storeu_si256( reinterpret_cast<__m256i *>( dst + i ), _mm256_xor_si256( a, b ) );
+  }
+
+  xor_sse2( dst + i, src + i, n - i );
+}
+#endif
+
+typedef void (*XorFunction)( char *, const char *, size_t );
+
+struct XorImplementation
+{
+  XorFunction function;
+  const char * name;
+};
+
+/* pick the widest implementation this CPU supports */
+static XorImplementation select_implementation( void )
+{
+#ifdef FEC_X86
+  __builtin_cpu_init();
+  if ( __builtin_cpu_supports( "avx2" ) ) {
+    return { xor_avx2, "avx2" };
+  }
+  return { xor_sse2, "sse2" };
+#else
+  return { xor_scalar, "scalar" };
+#endif
+}
+
+static const XorImplementation & implementation( void )
+{
+  static const XorImplementation chosen = select_implementation();
+  return chosen;
+}
+
+void xor_into( char * const dst, const char * const src, const size_t n )
+{
+  implementation().function( dst, src, n );
+}
+
+const char * fec_implementation( void )
+{
+  return implementation().name;
+}
+
+/* XOR a payload into an accumulator, growing it (with zeros) to fit */
+static void xor_payload( string & accumulator, const string & payload )
+{
+  if ( accumulator.size() < payload.size() ) {
+    accumulator.resize( payload.size(), 0 );
+  }
+
+  xor_into( &accumulator[ 0 ], payload.data(), payload.size() );
+}
+
+FecEncoder::FecEncoder()
+  : group_size_( FEC_MAX_GROUP / 2 ),
+    group_count_( 0 ),
+    group_first_( 0 ),
+    timestamp_xor_( 0 ),
+    length_xor_( 0 ),
+    payload_xor_(),
+    loss_rate_( 0 ),
+    next_expected_( 0 )
+{}
+
+/* a data datagram went out */
+void FecEncoder::add( const ContestMessage & message )
+{
+  if ( group_count_ == 0 ) {
+    group_first_ = message.header.sequence_number;
+  }
+
+  timestamp_xor_ ^= message.header.send_timestamp;
+  length_xor_ ^= message.payload.size();
+  xor_payload( payload_xor_, message.payload );
+  group_count_++;
+}
+
+/* the parity datagram for the group */
+ContestMessage FecEncoder::parity( void )
+{
+  string payload( PARITY_HEADER_SIZE, 0 );
+  const uint16_t count = htobe16( group_count_ );
+  const uint64_t timestamp = htobe64( timestamp_xor_ );
+  const uint16_t length = htobe16( length_xor_ );
+  memcpy( &payload[ 0 ], &count, 2 );
+  memcpy( &payload[ 2 ], &timestamp, 8 );
+  memcpy( &payload[ 10 ], &length, 2 );
+  payload += payload_xor_;
+
+  ContestMessage ret( group_first_ | FEC_PARITY_FLAG, payload );
+
+  /* start the next group, sized so it rarely loses more than the one datagram
+     parity can rebuild (about a quarter of a loss expected per group) */
+  group_count_ = 0;
+  timestamp_xor_ = length_xor_ = 0;
+  payload_xor_.clear();
+
+  const double wanted = loss_rate_ > 0 ? 0.25 / loss_rate_ : FEC_MAX_GROUP;
+  group_size_ = max( double( FEC_MIN_GROUP ), min( double( FEC_MAX_GROUP ), wanted ) );
+
+  return ret;
+}
+
+void FecEncoder::record_loss_sample( const bool lost )
+{
+  loss_rate_ += LOSS_GAIN * ((lost ? 1.0 : 0.0) - loss_rate_);
+}
+
+/* an ack arrived */
+void FecEncoder::ack_received( const ContestMessage & ack )
+{
+  const uint64_t sequence_number = ack.header.ack_sequence_number;
+
+  /* late (reordered) acks were already counted as losses; leave them be */
+  if ( sequence_number < next_expected_ ) {
+    return;
+  }
+
+  /* datagrams skipped over were lost even with FEC (bounded, in case of a long outage) */
+  const uint64_t skipped = min( sequence_number - next_expected_, uint64_t( 4096 ) );
+  for ( uint64_t i = 0; i < skipped; i++ ) {
+    record_loss_sample( true );
+  }
+  next_expected_ = sequence_number + 1;
+
+  /* a rebuilt datagram was lost too, as far as the link is concerned */
+  record_loss_sample( ack.header.ack_payload_length & FEC_RECOVERED_FLAG );
+}
+
+/* the ring is allocated on first use, so idle decoders (one per flow) stay small */
+FecDecoder::FecDecoder()
+  : recent_()
+{}
+
+FecDecoder::Received & FecDecoder::slot( const uint64_t sequence_number )
+{
+  return recent_[ sequence_number & (RECENT_RING - 1) ];
+}
+
+/* a data datagram arrived */
+void FecDecoder::add( const ContestMessage & message )
+{
+  if ( recent_.empty() ) {
+    recent_.assign( RECENT_RING, Received { uint64_t( -1 ), 0, string() } );
+  }
+
+  Received & entry = slot( message.header.sequence_number );
+  entry.sequence_number = message.header.sequence_number;
+  entry.send_timestamp = message.header.send_timestamp;
+  entry.payload = message.payload; /* reuses the slot's storage */
+}
+
+/* a parity datagram arrived: rebuild the missing member of its group, if just one is */
+bool FecDecoder::recover( const ContestMessage & parity, ContestMessage & recovered )
+{
+  const string & payload = parity.payload;
+  if ( payload.size() < PARITY_HEADER_SIZE ) {
+    return false;
+  }
+
+  uint16_t count, length;
+  uint64_t timestamp;
+  memcpy( &count, &payload[ 0 ], 2 );
+  memcpy( &timestamp, &payload[ 2 ], 8 );
+  memcpy( &length, &payload[ 10 ], 2 );
+  count = be16toh( count );
+  timestamp = be64toh( timestamp );
+  length = be16toh( length );
+
+  if ( recent_.empty() or count == 0 or count > FEC_MAX_GROUP ) {
+    return false;
+  }
+
+  const uint64_t first = parity.header.sequence_number & ~FEC_PARITY_FLAG;
+  uint64_t missing = -1;
+  for ( uint64_t sequence_number = first; sequence_number < first + count; sequence_number++ ) {
+    if ( slot( sequence_number ).sequence_number != sequence_number ) {
+      if ( missing != uint64_t( -1 ) ) {
+	return false; /* two missing: XOR can't tell them apart */
+      }
+      missing = sequence_number;
+    }
+  }
+
+  if ( missing == uint64_t( -1 ) ) {
+    return false; /* nothing to do */
+  }
+
+  /* XOR the parity with everything that did arrive, leaving what didn't */
+  string rebuilt( payload, PARITY_HEADER_SIZE, string::npos );
+  for ( uint64_t sequence_number = first; sequence_number < first + count; sequence_number++ ) {
+    if ( sequence_number != missing ) {
+      const Received & entry = slot( sequence_number );
+      timestamp ^= entry.send_timestamp;
+      length ^= entry.payload.size();
+      xor_payload( rebuilt, entry.payload );
+    }
+  }
+
+  if ( length > rebuilt.size() ) {
+    return false; /* inconsistent: not a group we saw */
+  }
+  rebuilt.resize( length );
+
+  recovered = ContestMessage( missing, rebuilt );
+  recovered.header.send_timestamp = timestamp;
+  add( recovered );
+  return true;
+}
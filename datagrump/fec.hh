@@ -0,0 +1,114 @@
+#ifndef FEC_HH
+#define FEC_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "contest_message.hh"
+#include "header_codec.hh"
+
+/* Forward error correction with XOR parity. After each group of
+   consecutive data datagrams the sender sends a parity datagram holding
+   the XOR of their send timestamps, lengths and payloads, so the receiver
+   can rebuild any one datagram of the group that went missing (and ack it
+   as if it had arrived, sparing the sender a loss).
+
+   A parity datagram's sequence number is the group's first sequence
+   number with FEC_PARITY_FLAG set; its payload is the group size (16 bits),
+   the XORed send timestamp (64 bits) and length (16 bits), then the XORed
+   payloads. Acks for rebuilt datagrams have FEC_RECOVERED_FLAG set in
+   ack_payload_length, so the sender can count the losses FEC hid. */
+
+static const uint64_t FEC_PARITY_FLAG = uint64_t( 1 ) << 63;
+static const uint64_t FEC_RECOVERED_FLAG = uint64_t( 1 ) << 63;
+
+/* parity payload header: group size, send timestamp and length */
+static const size_t PARITY_HEADER_SIZE = 2 + 8 + 2;
+
+/* A parity payload is as long as the group's longest payload plus its
+   header, so with FEC the data payloads leave room for the header (and
+   the parity datagram still fits in the MTU) */
+static const size_t FEC_MAX_DATA_PAYLOAD_SIZE = MAX_PAYLOAD_SIZE - PARITY_HEADER_SIZE;
+
+/* group sizes the sender chooses between */
+static const unsigned int FEC_MIN_GROUP = 4;
+static const unsigned int FEC_MAX_GROUP = 32;
+
+/* dst ^= src, n bytes (vectorized when the CPU allows) */
+void xor_into( char * const dst, const char * const src, const size_t n );
+
+/* name of the XOR implementation chosen for this CPU ("avx2", "sse2" or "scalar") */
+const char * fec_implementation( void );
+
+inline bool is_parity( const ContestMessage & message )
+{
+  return message.header.sequence_number & FEC_PARITY_FLAG;
+}
+
+/* Sender side: XORs each data datagram into the current group, and picks
+   the next group's size from the measured loss rate */
+class FecEncoder
+{
+private:
+  unsigned int group_size_;
+  unsigned int group_count_;
+  uint64_t group_first_;
+  uint64_t timestamp_xor_;
+  uint64_t length_xor_;
+  std::string payload_xor_;
+
+  /* loss rate before FEC, per datagram, smoothed */
+  double loss_rate_;
+  uint64_t next_expected_; /* one past the highest sequence number acked */
+
+  void record_loss_sample( const bool lost );
+
+public:
+  FecEncoder();
+
+  /* a data datagram went out */
+  void add( const ContestMessage & message );
+
+  /* has the group got all its datagrams (so its parity should go out)? */
+  bool group_full( void ) const { return group_count_ >= group_size_; }
+
+  /* the parity datagram for the group (and start the next one) */
+  ContestMessage parity( void );
+
+  /* an ack arrived (gaps before it count as losses, and so do rebuilt datagrams) */
+  void ack_received( const ContestMessage & ack );
+
+  double loss_rate( void ) const { return loss_rate_; }
+  unsigned int group_size( void ) const { return group_size_; }
+};
+
+/* Receiver side: remembers recent data datagrams, and rebuilds the one
+   missing from a group when its parity arrives */
+class FecDecoder
+{
+private:
+  struct Received
+  {
+    uint64_t sequence_number;
+    uint64_t send_timestamp;
+    std::string payload;
+  };
+
+  std::vector<Received> recent_; /* ring, indexed by sequence number */
+
+  Received & slot( const uint64_t sequence_number );
+
+public:
+  FecDecoder();
+
+  /* a data datagram arrived */
+  void add( const ContestMessage & message );
+
+  /* a parity datagram arrived: if exactly one of its group is missing,
+     rebuild it into recovered and return true */
+  bool recover( const ContestMessage & parity, ContestMessage & recovered );
+};
+
+#endif /* FEC_HH */
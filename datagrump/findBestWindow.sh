@@ -1,9 +1,10 @@
 #!/bin/bash
 
+# the default controller's timeout is a template argument, so each value is its own build
 for i in 50 55 60
   do
-    sed "s/BLOOP/$i/g" controllerTemplate.cc > controller.cc;
-    make;
+    touch controller.hh;
+    make CPPFLAGS="-DTUNED_TIMEOUT=$i";
     echo "Now running timeout $i" | tee -a output.txt;
     ./run-contest EACC 2>&1 | tee -a output.txt;
   done
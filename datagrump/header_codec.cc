@@ -0,0 +1,142 @@
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <endian.h>
+
+#include "header_codec.hh"
+
+#if defined( __x86_64__ ) and __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define HEADER_CODEC_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+/* portable version */
+static void swap_words_scalar( const void * const in, void * const out, const size_t words )
+{
+  const char * src = static_cast<const char *>( in );
+  char * dst = static_cast<char *>( out );
+
+  for ( size_t i = 0; i < words; i++ ) {
+    uint64_t word;
+    memcpy( &word, src + i * sizeof( word ), sizeof( word ) );
+    word = be64toh( word );
+    memcpy( dst + i * sizeof( word ), &word, sizeof( word ) );
+  }
+}
+
+#ifdef HEADER_CODEC_X86
+/* reverse the bytes of each 64-bit lane, two words per 128-bit shuffle */
+__attribute__(( target( "ssse3" ) ))
+static void swap_words_ssse3( const void * const in, void * const out, const size_t words )
+{
+  const char * src = static_cast<const char *>( in );
+  char * dst = static_cast<char *>( out );
+  const __m128i reverse = _mm_set_epi8( 8, 9, 10, 11, 12, 13, 14, 15,
+					0, 1, 2, 3, 4, 5, 6, 7 );
+
+  size_t i = 0;
+  for ( ; i + 2 <= words; i += 2 ) {
+    const __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + i * 8 ) );
+    _mm_storeu_si128( reinterpret_cast<__m128i *>( dst + i * 8 ), _mm_shuffle_epi8( v, reverse ) );
+  }
+
+  swap_words_scalar( src + i * 8, dst + i * 8, words - i );
+}
+
+/* same, four words per 256-bit shuffle */
+__attribute__(( target( "avx2" ) ))
+static void swap_words_avx2( const void * const in, void * const out, const size_t words )
+{
+  const char * src = static_cast<const char *>( in );
+  char * dst = static_cast<char *>( out );
+  const __m256i reverse = _mm256_set_epi8( 8, 9, 10, 11, 12, 13, 14, 15,
+					   0, 1, 2, 3, 4, 5, 6, 7,
+					   8, 9, 10, 11, 12, 13, 14, 15,
+					   0, 1, 2, 3, 4, 5, 6, 7 );
+
+  size_t i = 0;
+  for ( ; i + 4 <= words; i += 4 ) {
+    const __m256i v = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( src + i * 8 ) );
+    _mm256_storeu_si256( reinterpret_cast<__m256i *>( dst + i * 8 ), _mm256_shuffle_epi8( v, reverse ) );
+  }
+
+  swap_words_ssse3( src + i * 8, dst + i * 8, words - i );
+}
+#endif
+
+typedef void (*SwapFunction)( const void *, void *, size_t );
+
+struct SwapImplementation
+{
+  SwapFunction function;
+  const char * name;
+};
+
+/* pick the widest implementation this CPU supports */
+static SwapImplementation select_implementation( void )
+{
+#ifdef HEADER_CODEC_X86
+  __builtin_cpu_init();
+  if ( __builtin_cpu_supports( "avx2" ) ) {
+    return { swap_words_avx2, "avx2" };
+  }
+  if ( __builtin_cpu_supports( "ssse3" ) ) {
+    return { swap_words_ssse3, "ssse3" };
+  }
+#endif
+  return { swap_words_scalar, "scalar" };
+}
+
+static const SwapImplementation & implementation( void )
+{
+  static const SwapImplementation chosen = select_implementation();
+  return chosen;
+}
+
+void swap_header_words( const void * const in, void * const out, const size_t words )
+{
+  implementation().function( in, out, words );
+}
+
+const char * header_codec_implementation( void )
+{
+  return implementation().name;
+}
+
+/* fill in a header from its fields */
+void set_header_fields( const uint64_t * const fields, ContestMessage::Header & header )
+{
+  header.sequence_number = fields[ 0 ];
+  header.send_timestamp = fields[ 1 ];
+  header.ack_sequence_number = fields[ 2 ];
+  header.ack_send_timestamp = fields[ 3 ];
+  header.ack_recv_timestamp = fields[ 4 ];
+  header.ack_payload_length = fields[ 5 ];
+  header.ack_ce_count = fields[ 6 ];
+}
+
+/* Parse the headers of a batch of datagrams */
+void decode_header_batch( const string * const datagrams,
+			  const size_t count,
+			  ContestMessage::Header * const headers )
+{
+  /* gather the headers into one buffer, then swap them all at once */
+  static thread_local vector<uint64_t> words;
+  words.resize( count * HEADER_FIELDS );
+
+  for ( size_t i = 0; i < count; i++ ) {
+    if ( datagrams[ i ].size() < HEADER_WIRE_SIZE ) {
+      throw runtime_error( "contest message too small to contain header" );
+    }
+    memcpy( &words[ i * HEADER_FIELDS ], datagrams[ i ].data(), HEADER_WIRE_SIZE );
+  }
+
+  swap_header_words( words.data(), words.data(), count * HEADER_FIELDS );
+
+  for ( size_t i = 0; i < count; i++ ) {
+    set_header_fields( &words[ i * HEADER_FIELDS ], headers[ i ] );
+  }
+}
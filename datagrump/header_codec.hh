@@ -0,0 +1,42 @@
+#ifndef HEADER_CODEC_HH
+#define HEADER_CODEC_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "contest_message.hh"
+
+/* Wire format of ContestMessage headers: seven 64-bit fields in network
+   byte order. One header is converted inline (see contest_message.cc);
+   a batch of them, as the sender takes acks off the socket in bursts, is
+   byte-swapped in one pass, with AVX2 or SSSE3 shuffles when the CPU has
+   them (checked once, at first use). */
+
+/* number of 64-bit fields in a header, and its size on the wire */
+static const size_t HEADER_FIELDS = 7;
+static const size_t HEADER_WIRE_SIZE = HEADER_FIELDS * sizeof( uint64_t );
+
+/* the largest payload whose datagram fits in a 1500-byte MTU, after
+   28 bytes of IPv4 and UDP headers and then ours */
+static const size_t MTU = 1500;
+static const size_t IP_UDP_HEADER_SIZE = 20 + 8;
+static const size_t MAX_PAYLOAD_SIZE = MTU - IP_UDP_HEADER_SIZE - HEADER_WIRE_SIZE;
+
+/* convert an array of 64-bit words between network and host byte order
+   (in and out may be the same buffer; neither needs to be aligned) */
+void swap_header_words( const void * const in, void * const out, const size_t words );
+
+/* name of the implementation chosen for this CPU ("avx2", "ssse3" or "scalar") */
+const char * header_codec_implementation( void );
+
+/* fill in a header from its fields, in wire order and host byte order */
+void set_header_fields( const uint64_t * const fields, ContestMessage::Header & header );
+
+/* Parse the headers of a batch of datagrams into headers[ 0 .. count )
+   (throws, as parsing one would, if a datagram is too short to hold one) */
+void decode_header_batch( const std::string * const datagrams,
+			  const size_t count,
+			  ContestMessage::Header * const headers );
+
+#endif /* HEADER_CODEC_HH */
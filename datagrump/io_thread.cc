@@ -0,0 +1,238 @@
+#include <time.h>
+
+#include "contest_message.hh"
+#include "io_thread.hh"
+#include "poller.hh"
+#include "util.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* say we're asleep, unless there is work after all */
+template <typename HasWork>
+bool SenderIOThread::Doorbell::sleep( const HasWork & has_work )
+{
+  asleep.store( true, memory_order_relaxed );
+  atomic_thread_fence( memory_order_seq_cst );
+
+  if ( has_work() ) {
+    asleep.store( false, memory_order_relaxed );
+    return false;
+  }
+
+  return true;
+}
+
+/* wake the other side, if it is asleep */
+void SenderIOThread::Doorbell::ring( void )
+{
+  atomic_thread_fence( memory_order_seq_cst );
+
+  /* (the plain load keeps the flag's cache line shared while it is awake) */
+  if ( asleep.load( memory_order_relaxed ) and asleep.exchange( false ) ) {
+    bell.notify();
+  }
+}
+
+SenderIOThread::SenderIOThread( const unsigned int spin_budget_us )
+  : outgoing_( RING_SIZE ), ports_(), doorbell_(), held_(), holding_( false ),
+    spin_budget_us_( spin_budget_us ), running_( false ), finished_( false ), exit_status_( EXIT_SUCCESS ),
+    ack_drops_( 0 ), cpu_ns_( 0 ), error_(), thread_()
+{}
+
+SenderIOThread::~SenderIOThread()
+{
+  try {
+    stop();
+  } catch ( const exception & e ) {
+    print_exception( e );
+  }
+}
+
+/* a socket to do the I/O for */
+size_t SenderIOThread::add_port( UDPSocket & socket, const bool stamp )
+{
+  if ( thread_.joinable() ) {
+    throw runtime_error( "SenderIOThread: ports must be added before it starts" );
+  }
+
+  ports_.emplace_back( new Port( socket, stamp ) );
+  return ports_.size() - 1;
+}
+
+void SenderIOThread::start( void )
+{
+  running_ = true;
+  thread_ = thread( [this] () {
+      try {
+	run();
+      } catch ( ... ) {
+	error_ = current_exception();
+      }
+
+      timespec cpu; zero( cpu );
+      SystemCall( "clock_gettime", clock_gettime( CLOCK_THREAD_CPUTIME_ID, &cpu ) );
+      cpu_ns_ = cpu.tv_sec * uint64_t( 1000000000 ) + cpu.tv_nsec;
+
+      /* the senders may be waiting for acks that will never come */
+      finished_.store( true, memory_order_release );
+      for ( auto & port : ports_ ) {
+	port->doorbell.ring();
+      }
+    } );
+}
+
+/* stop the thread and wait for it */
+void SenderIOThread::stop( void )
+{
+  if ( not thread_.joinable() ) {
+    return;
+  }
+
+  running_ = false;
+  doorbell_.ring();
+  thread_.join();
+
+  if ( error_ ) {
+    const exception_ptr error = error_;
+    error_ = nullptr;
+    rethrow_exception( error );
+  }
+}
+
+/* the sender's side: hand over a datagram to send */
+bool SenderIOThread::send( const size_t port, string && payload )
+{
+  Port & p = *ports_[ port ];
+
+  if ( not outgoing_.try_push( { port, move( payload ) } ) ) {
+    p.wants_room.store( true, memory_order_relaxed );
+    return false;
+  }
+
+  if ( p.wants_room.load( memory_order_relaxed ) ) {
+    p.wants_room.store( false, memory_order_relaxed );
+  }
+
+  doorbell_.ring();
+  return true;
+}
+
+/* the sender's side: take the next ack */
+bool SenderIOThread::receive( const size_t port, Incoming & ack )
+{
+  return ports_[ port ]->acks.try_pop( ack );
+}
+
+/* the sender's side: about to block (unless there are acks, or room it was waiting for) */
+bool SenderIOThread::sleep( const size_t port )
+{
+  Port & p = *ports_[ port ];
+  return p.doorbell.sleep( [&] () {
+      return not p.acks.empty()
+	or (p.wants_room.load( memory_order_relaxed ) and not outgoing_.full())
+	or finished_.load( memory_order_relaxed );
+    } );
+}
+
+/* Send what the senders have handed over, until the ring is empty or a
+   socket buffer is full (then hold that datagram until there is room) */
+void SenderIOThread::transmit( void )
+{
+  bool made_room = false;
+
+  while ( true ) {
+    if ( not holding_ ) {
+      if ( not outgoing_.try_pop( held_ ) ) {
+	break;
+      }
+      holding_ = true;
+      made_room = true;
+    }
+
+    Port & port = *ports_[ held_.port ];
+
+    /* stamp it now, so the time it spent in the ring isn't counted as RTT */
+    if ( port.stamp ) {
+      ContestMessage::set_send_timestamp( held_.payload );
+    }
+
+    if ( not port.socket.try_send( held_.payload ) ) {
+      break;
+    }
+    holding_ = false;
+  }
+
+  /* a sender that found the ring full is waiting for this */
+  if ( made_room ) {
+    for ( auto & port : ports_ ) {
+      if ( port->wants_room.load( memory_order_relaxed ) ) {
+	port->doorbell.ring();
+      }
+    }
+  }
+}
+
+/* pass on every ack that has arrived on a port's socket */
+void SenderIOThread::receive( Port & port )
+{
+  bool got_any = false;
+  UDPSocket::received_datagram recd = { Address(), 0, string(), 0, 0 };
+
+  while ( port.socket.try_recv( recd ) ) {
+    if ( port.acks.try_push( { recd.timestamp, move( recd.payload ) } ) ) {
+      got_any = true;
+    } else {
+      ack_drops_.fetch_add( 1, memory_order_relaxed );
+    }
+  }
+
+  if ( got_any ) {
+    port.doorbell.ring();
+  }
+}
+
+void SenderIOThread::run( void )
+{
+  Poller poller;
+  poller.set_spin_budget( spin_budget_us_ );
+
+  for ( size_t i = 0; i < ports_.size(); i++ ) {
+    Port & port = *ports_[ i ];
+
+    /* acks to pass on */
+    poller.add_action( Action( port.socket, Direction::In, [&] () {
+	  receive( port );
+	  return ResultType::Continue;
+	} ) );
+
+    /* room again for the held datagram */
+    poller.add_action( Action( port.socket, Direction::Out, [&] () {
+	  transmit();
+	  return ResultType::Continue;
+	}, [this, i] () { return holding_ and held_.port == i; } ) );
+  }
+
+  /* datagrams to send (or time to stop) */
+  poller.add_action( Action( doorbell_.bell, Direction::In, [&] () {
+	doorbell_.bell.read_events();
+	return ResultType::Continue;
+      } ) );
+
+  while ( running_.load( memory_order_relaxed ) ) {
+    transmit();
+
+    /* block only if there is nothing to send (or the socket is full) */
+    const bool block = doorbell_.sleep( [&] () {
+	return (not holding_ and not outgoing_.empty()) or not running_.load( memory_order_relaxed );
+      } );
+
+    const auto ret = poller.poll( block ? -1 : 0 );
+    doorbell_.wake();
+
+    if ( ret.result == PollResult::Exit ) {
+      exit_status_ = ret.exit_status;
+      return;
+    }
+  }
+}
@@ -0,0 +1,143 @@
+#ifndef IO_THREAD_HH
+#define IO_THREAD_HH
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "event_fd.hh"
+#include "lockfree_ring.hh"
+#include "socket.hh"
+
+/* Does the socket I/O for one or more senders on a thread of its own, so
+   a sender's thread only runs the controller and builds datagrams, and
+   that work overlaps with the syscalls instead of waiting on them.
+
+   Each sender registers its socket as a port. Datagrams to send go to the
+   I/O thread on one ring, which any number of sender threads may share;
+   each port's acks come back on a ring of their own. Neither side takes a
+   lock or makes a syscall to hand something over, unless the other side
+   is asleep in poll(), in which case it rings that side's eventfd.
+
+   Unless a port asks it not to, the I/O thread fills in each datagram's
+   send_timestamp just before it sends it, so the time a datagram waits in
+   the ring is not part of the round trip its ack measures.
+
+   If a socket buffer is full, the I/O thread holds the datagram until the
+   socket is writable, and the ring backs up behind it (so a send() that
+   fails is the sender's sign the socket is full). If a port's ack ring is
+   full, the acks that don't fit are dropped, as the socket buffer would. */
+class SenderIOThread
+{
+public:
+  /* a datagram to send, and the port whose socket it goes out on */
+  struct Outgoing
+  {
+    size_t port = 0;
+    std::string payload = "";
+  };
+
+  /* an ack, with when it arrived (as timestamp_ms()) */
+  struct Incoming
+  {
+    uint64_t timestamp = 0;
+    std::string payload = "";
+  };
+
+  /* entries in each ring (a power of two) */
+  static const size_t RING_SIZE = 4096;
+
+private:
+  /* How one side waits for the other. Before blocking in poll(), it says
+     it is asleep, then looks for work once more; whoever hands it work
+     afterwards sees the flag and rings the eventfd. (The fences make sure
+     one side or the other sees the work or the flag.) */
+  struct Doorbell
+  {
+    EventFD bell = EventFD();
+    std::atomic<bool> asleep = false;
+
+    /* false (staying awake) if there turns out to be work after all */
+    template <typename HasWork> bool sleep( const HasWork & has_work );
+    void wake( void ) { asleep.store( false, std::memory_order_relaxed ); }
+
+    /* after handing over work */
+    void ring( void );
+  };
+
+  struct Port
+  {
+    UDPSocket & socket;
+    bool stamp; /* fill in send timestamps */
+    SPSCRing<Incoming> acks;
+    Doorbell doorbell; /* the sender's */
+    std::atomic<bool> wants_room; /* the sender is waiting for room in the outgoing ring */
+
+    Port( UDPSocket & s_socket, const bool s_stamp )
+      : socket( s_socket ), stamp( s_stamp ), acks( RING_SIZE ), doorbell(), wants_room( false ) {}
+  };
+
+  MPSCRing<Outgoing> outgoing_;
+  std::vector<std::unique_ptr<Port>> ports_;
+  Doorbell doorbell_; /* the I/O thread's */
+
+  /* a datagram waiting for room in its socket's buffer */
+  Outgoing held_;
+  bool holding_;
+
+  unsigned int spin_budget_us_;
+
+  std::atomic<bool> running_, finished_;
+  std::atomic<unsigned int> exit_status_;
+  std::atomic<uint64_t> ack_drops_, cpu_ns_;
+  std::exception_ptr error_;
+  std::thread thread_;
+
+  void run( void );
+  void transmit( void );
+  void receive( Port & port );
+
+public:
+  SenderIOThread( const unsigned int spin_budget_us = 0 );
+  ~SenderIOThread();
+
+  SenderIOThread( const SenderIOThread & other ) = delete;
+  SenderIOThread & operator=( const SenderIOThread & other ) = delete;
+
+  /* before start(): a socket to do the I/O for (returns its port), and
+     whether to stamp its datagrams as they go out */
+  size_t add_port( UDPSocket & socket, const bool stamp = true );
+
+  void start( void );
+
+  /* stop the thread and wait for it (rethrowing whatever it died of, if anything) */
+  void stop( void );
+
+  /* has the thread ended on its own (an error on a socket, as poll() reports it)? */
+  bool finished( void ) const { return finished_.load( std::memory_order_acquire ); }
+  unsigned int exit_status( void ) const { return exit_status_.load(); }
+
+  /* The sender's side of a port, called from one thread (any number of
+     threads, for send). send() is false if the outgoing ring is full. */
+  bool send( const size_t port, std::string && payload );
+  bool receive( const size_t port, Incoming & ack );
+
+  /* readable when the I/O thread has woken the port's sender */
+  EventFD & wakeup( const size_t port ) { return ports_.at( port )->doorbell.bell; }
+
+  /* before and after the sender blocks in poll(): sleep() is false if
+     there is already something to do (and the sender should not block) */
+  bool sleep( const size_t port );
+  void wake( const size_t port ) { ports_[ port ]->doorbell.wake(); }
+
+  /* acks dropped for want of room in a ring, and the thread's CPU time (once stopped) */
+  uint64_t ack_drops( void ) const { return ack_drops_.load( std::memory_order_relaxed ); }
+  uint64_t cpu_ns( void ) const { return cpu_ns_.load(); }
+};
+
+#endif /* IO_THREAD_HH */
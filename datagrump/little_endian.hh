@@ -0,0 +1,38 @@
+#ifndef LITTLE_ENDIAN_HH
+#define LITTLE_ENDIAN_HH
+
+#include <cstdint>
+#include <cstring>
+
+#include <endian.h>
+
+/* Fields of the binary file formats (trace.hh, delivery_log.hh), which are
+   little-endian and not necessarily aligned */
+
+inline void put_le32( char * const data, const uint32_t value )
+{
+  const uint32_t word = htole32( value );
+  memcpy( data, &word, sizeof( word ) );
+}
+
+inline void put_le64( char * const data, const uint64_t value )
+{
+  const uint64_t word = htole64( value );
+  memcpy( data, &word, sizeof( word ) );
+}
+
+inline uint32_t get_le32( const char * const data )
+{
+  uint32_t word;
+  memcpy( &word, data, sizeof( word ) );
+  return le32toh( word );
+}
+
+inline uint64_t get_le64( const char * const data )
+{
+  uint64_t word;
+  memcpy( &word, data, sizeof( word ) );
+  return le64toh( word );
+}
+
+#endif /* LITTLE_ENDIAN_HH */
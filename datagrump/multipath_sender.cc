@@ -0,0 +1,363 @@
+#include <algorithm>
+#include <iostream>
+
+#include <net/if.h>
+
+#include "multipath_sender.hh"
+#include "timestamp.hh"
+#include "util.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* a subflow leaves through an interface (if via names one) or from a local address */
+template <typename ControllerType>
+MultipathSender<ControllerType>::Subflow::Subflow( const string & s_via,
+						   const Address & peer,
+						   const bool debug )
+  : via( s_via ),
+    socket(),
+    controller( debug ),
+    unacked(),
+    ce_count( 0 ),
+    timer(),
+    timer_deadline( -1 ),
+    timer_armed_for( -1 ),
+    blocked( false ),
+    buffer_bytes( 0 ),
+    force_buffers( true )
+{
+  if ( if_nametoindex( via.c_str() ) ) {
+    socket.bind_to_device( via );
+  } else {
+    socket.bind( Address( via, 0 ) );
+  }
+
+  socket.set_timestamps();
+  socket.set_tos( Socket::ECN_ECT0 );
+  socket.set_blocking( false );
+  buffer_bytes = min( socket.send_buffer(), socket.receive_buffer() ) / 2;
+  socket.connect( peer );
+
+  cerr << "Sending to " << socket.peer_address().to_string()
+       << " from " << socket.local_address().to_string() << " (via " << via << ")" << endl;
+}
+
+template <typename ControllerType>
+MultipathSender<ControllerType>::MultipathSender( const Address & peer,
+						  const vector<string> & via,
+						  const bool debug )
+  : subflows_(),
+    sequence_number_( 0 ),
+    stream_(),
+    pending_(),
+    spin_budget_us_( 0 ),
+    stats_()
+{
+  if ( via.empty() ) {
+    throw runtime_error( "multipath sender needs at least one local address or interface" );
+  }
+
+  for ( const auto & local : via ) {
+    subflows_.emplace_back( new Subflow( local, peer, debug ) );
+  }
+}
+
+/* low-latency mode: spin before blocking */
+template <typename ControllerType>
+void MultipathSender<ControllerType>::set_spin_budget( const unsigned int spin_budget_us )
+{
+  spin_budget_us_ = spin_budget_us;
+
+  /* kernel busy polling is a bonus; user-space spinning works without it */
+  try {
+    for ( auto & subflow : subflows_ ) {
+      subflow->socket.set_busy_poll( spin_budget_us );
+    }
+  } catch ( const unix_error & e ) {
+    cerr << "Kernel busy polling unavailable (" << e.what() << "), spinning in user space only" << endl;
+  }
+}
+
+/* Path caches are keyed by the peer alone, which every subflow shares */
+template <typename ControllerType>
+void MultipathSender<ControllerType>::use_path_cache( const string & )
+{
+  throw runtime_error( "path caches are not supported with several subflows" );
+}
+
+/* Transmit timestamps would need a departure ring per subflow */
+template <typename ControllerType>
+void MultipathSender<ControllerType>::use_tx_timestamps( const bool )
+{
+  throw runtime_error( "transmit timestamps are not supported with several subflows" );
+}
+
+/* The receiver rebuilds from parity per flow, and a group would be spread across subflows */
+template <typename ControllerType>
+void MultipathSender<ControllerType>::use_fec( void )
+{
+  throw runtime_error( "FEC is not supported with several subflows" );
+}
+
+/* Messages would need a scheduler choosing among subflows as well as classes */
+template <typename ControllerType>
+void MultipathSender<ControllerType>::add_message_class( const string &, const unsigned int, const bool )
+{
+  throw runtime_error( "message classes are not supported with several subflows" );
+}
+
+/* The I/O thread's outgoing ring backs up behind a full socket, which would
+   stall every subflow behind the slowest instead of moving on to another */
+template <typename ControllerType>
+void MultipathSender<ControllerType>::use_io_thread( void )
+{
+  throw runtime_error( "the I/O thread is not supported with several subflows" );
+}
+
+/* send a file reliably instead of filler */
+template <typename ControllerType>
+void MultipathSender<ControllerType>::use_stream( const string & filename )
+{
+  stream_.reset( new StreamSender( filename ) );
+
+  /* datagrams on different paths overtake each other as a matter of course,
+     so losses are detected per subflow instead (see got_ack) */
+  stream_->set_reorder_threshold( 0 );
+}
+
+/* is there a datagram to send? */
+template <typename ControllerType>
+bool MultipathSender<ControllerType>::have_data( void )
+{
+  return pending_ or not stream_ or stream_->has_segment();
+}
+
+/* The scheduler: the subflow with the lowest smoothed RTT among those with
+   room in their window (one not yet measured goes first, so every path
+   gets a sample), or nullptr if none has room or there is nothing to send */
+template <typename ControllerType>
+typename MultipathSender<ControllerType>::Subflow * MultipathSender<ControllerType>::pick_subflow( void )
+{
+  if ( not have_data() ) {
+    return nullptr;
+  }
+
+  Subflow * best = nullptr;
+  for ( auto & subflow : subflows_ ) {
+    if ( subflow->blocked or not subflow->window_is_open() ) {
+      continue;
+    }
+
+    if ( not best
+	 or subflow->controller.estimates().srtt() < best->controller.estimates().srtt() ) {
+      best = subflow.get();
+    }
+  }
+
+  return best;
+}
+
+/* send the next datagram (or retry the held one) on a subflow; false if its socket buffer is full */
+template <typename ControllerType>
+bool MultipathSender<ControllerType>::send_datagram( Subflow & subflow )
+{
+  /* All messages use the same dummy payload */
+  static const string dummy_payload( MAX_PAYLOAD_SIZE, 'x' );
+
+  if ( not pending_ ) {
+    if ( not stream_ ) {
+      pending_.reset( new ContestMessage( sequence_number_++, dummy_payload ) );
+    } else if ( stream_->has_segment() ) {
+      pending_.reset( new ContestMessage( sequence_number_, stream_->next_segment( sequence_number_ ) ) );
+      sequence_number_++;
+      stats_.retransmissions = stream_->retransmissions();
+    } else {
+      return true; /* nothing to send */
+    }
+  }
+
+  ContestMessage & cm = *pending_;
+  cm.set_send_timestamp();
+
+  if ( not subflow.socket.try_send( cm.to_string() ) ) {
+    stats_.queue_full_events++;
+    subflow.blocked = true;
+    subflow.controller.local_queue_full( cm.header.send_timestamp );
+    return false;
+  }
+
+  subflow.unacked.push_back( cm.header.sequence_number );
+  stats_.datagrams_sent++;
+
+  subflow.controller.datagram_was_sent( cm.header.sequence_number,
+					cm.header.send_timestamp );
+
+  pending_.reset();
+  return true;
+}
+
+template <typename ControllerType>
+void MultipathSender<ControllerType>::got_ack( Subflow & subflow,
+					       const uint64_t timestamp,
+					       const ContestMessage & ack )
+{
+  if ( not ack.is_ack() ) {
+    throw runtime_error( "sender got something other than an ack from the receiver" );
+  }
+
+  const uint64_t sequence_number = ack.header.ack_sequence_number;
+
+  /* a path rarely reorders by itself, so datagrams sent on this subflow
+     before the one acked were lost (the window counts them out, as
+     DatagrumpSender's next_ack_expected_ does) */
+  while ( not subflow.unacked.empty() and subflow.unacked.front() <= sequence_number ) {
+    if ( stream_ and subflow.unacked.front() != sequence_number ) {
+      stream_->datagram_lost( subflow.unacked.front() );
+    }
+    subflow.unacked.pop_front();
+  }
+
+  stats_.acks_received++;
+  stats_.add_rtt( timestamp - ack.header.ack_send_timestamp );
+
+  subflow.controller.ack_received( sequence_number,
+				   ack.header.ack_send_timestamp,
+				   ack.header.ack_recv_timestamp,
+				   timestamp );
+
+  if ( stream_ ) {
+    stream_->ack_received( sequence_number, ack.payload );
+    stats_.stream_bytes = stream_->bytes_delivered();
+  }
+
+  set_timer( subflow, timestamp + subflow.controller.timeout_ms() );
+
+  if ( ack.header.ack_ce_count > subflow.ce_count ) {
+    const uint64_t newly_marked = ack.header.ack_ce_count - subflow.ce_count;
+    subflow.ce_count = ack.header.ack_ce_count;
+    stats_.ce_marks += newly_marked;
+    subflow.controller.ecn_marked( newly_marked, timestamp );
+  }
+}
+
+/* no ack on this subflow for a while: give up on its oldest datagram, and probe it */
+template <typename ControllerType>
+void MultipathSender<ControllerType>::timer_expired( Subflow & subflow, const uint64_t timestamp )
+{
+  stats_.timer_expirations++;
+  subflow.controller.timer_expired( timestamp );
+
+  if ( not subflow.unacked.empty() ) {
+    if ( stream_ ) {
+      stream_->datagram_lost( subflow.unacked.front() );
+    }
+    subflow.unacked.pop_front();
+  } else if ( stream_ and all_of( subflows_.begin(), subflows_.end(),
+				  [] ( const auto & s ) { return s->unacked.empty(); } ) ) {
+    /* nothing in flight anywhere, but the stream isn't known to be done */
+    stream_->timer_expired();
+  }
+
+  send_datagram( subflow );
+  set_timer( subflow, timestamp + subflow.controller.timeout_ms() );
+}
+
+/* (Re)start a subflow's retransmission timer (lazily, as DatagrumpSender::set_timer) */
+template <typename ControllerType>
+void MultipathSender<ControllerType>::set_timer( Subflow & subflow, const uint64_t deadline )
+{
+  subflow.timer_deadline = deadline;
+
+  if ( deadline < subflow.timer_armed_for ) {
+    const uint64_t now = timestamp_ms();
+    subflow.timer.arm_us( deadline > now ? (deadline - now) * 1000 : 0 );
+    subflow.timer_armed_for = deadline;
+  }
+}
+
+template <typename ControllerType>
+int MultipathSender<ControllerType>::loop( const uint64_t deadline_ms )
+{
+  Poller poller;
+  poller.set_spin_budget( spin_budget_us_ );
+
+  for ( auto & subflow_ptr : subflows_ ) {
+    Subflow & subflow = *subflow_ptr;
+
+    /* first rule: fill the window of the subflow the scheduler picks, or of
+       one whose socket buffer was full, once it is writable (each subflow
+       only sends on its own socket here, so the poller's accounting holds) */
+    poller.add_action( Action( subflow.socket, Direction::Out, [&] () {
+	  subflow.blocked = false;
+	  while ( subflow.window_is_open() and have_data() ) {
+	    if ( not send_datagram( subflow ) ) {
+	      break;
+	    }
+	  }
+	  return ResultType::Continue;
+	},
+	[&] () {
+	  if ( subflow.blocked ) {
+	    return subflow.window_is_open() and have_data();
+	  }
+	  return pick_subflow() == &subflow;
+	} ) );
+
+    /* second rule: acks come back on the subflow their datagram went out on */
+    poller.add_action( Action( subflow.socket, Direction::In, [&] () {
+	  UDPSocket::received_datagram recd = { Address(), 0, string(), 0, 0 };
+	  if ( subflow.socket.try_recv( recd ) ) {
+	    const ContestMessage ack = recd.payload;
+	    got_ack( subflow, recd.timestamp, ack );
+	  }
+	  return ResultType::Continue;
+	} ) );
+
+    /* third rule: each subflow has its own retransmission timer */
+    poller.add_action( Action( subflow.timer, Direction::In, [&] () {
+	  subflow.timer.read_expirations();
+	  subflow.timer_armed_for = -1;
+
+	  const uint64_t now = timestamp_ms();
+	  if ( now < subflow.timer_deadline ) {
+	    set_timer( subflow, subflow.timer_deadline ); /* an ack moved the deadline */
+	  } else {
+	    timer_expired( subflow, now );
+	  }
+	  return ResultType::Continue;
+	} ) );
+
+    set_timer( subflow, timestamp_ms() + subflow.controller.timeout_ms() );
+  }
+
+  const bool has_deadline = deadline_ms != uint64_t( -1 );
+
+  while ( true ) {
+    for ( auto & subflow : subflows_ ) {
+      grow_socket_buffers( subflow->socket, subflow->controller.window_size(),
+			   subflow->buffer_bytes, subflow->force_buffers );
+    }
+
+    const uint64_t now = timestamp_ms();
+    if ( has_deadline and now >= deadline_ms ) {
+      return EXIT_SUCCESS;
+    }
+
+    const auto ret = poller.poll( has_deadline ? deadline_ms - now : -1 );
+    stats_.spin = poller.spin_stats();
+
+    if ( ret.result == PollResult::Exit ) {
+      return ret.exit_status;
+    }
+
+    if ( stream_ and stream_->complete() ) {
+      return EXIT_SUCCESS;
+    }
+  }
+}
+
+/* the prebuilt controllers (see make_datagrump_sender) */
+template class MultipathSender<Controller<DEFAULT_CONTROLLER>>;
+template class MultipathSender<Controller<GENTLE_CONTROLLER>>;
+template class MultipathSender<Controller<AGGRESSIVE_CONTROLLER>>;
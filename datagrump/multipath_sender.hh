@@ -0,0 +1,93 @@
+#ifndef MULTIPATH_SENDER_HH
+#define MULTIPATH_SENDER_HH
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "datagrump_sender.hh"
+
+/* Sender that stripes one flow across several paths (e.g. two cellular
+   modems). Each subflow is its own socket, bound to a local address or
+   interface and connected to the same peer, with its own controller (and
+   so its own window, RTT estimate and retransmission timer). Sequence
+   numbers are shared: each datagram gets the next one, and goes out on
+   the subflow with the lowest smoothed RTT that has room in its window.
+
+   The receiver needs nothing special: it sees each subflow as a flow of
+   its own, acks each datagram back along the path it came by, and (in
+   stream mode) reassembles the segments of all of them by offset. */
+template <typename ControllerType>
+class MultipathSender final : public DatagrumpSenderBase
+{
+private:
+  struct Subflow
+  {
+    std::string via; /* the local address or interface it was given */
+    UDPSocket socket;
+    ControllerType controller;
+
+    /* sequence numbers sent on this subflow after its latest ack, in order */
+    std::deque<uint64_t> unacked;
+
+    /* receiver's running count of CE marks on this subflow */
+    uint64_t ce_count;
+
+    /* retransmission timer, as in DatagrumpSender */
+    TimerFD timer;
+    uint64_t timer_deadline, timer_armed_for;
+
+    /* the last send found the socket buffer full (cleared once it is writable) */
+    bool blocked;
+
+    int buffer_bytes;
+    bool force_buffers;
+
+    Subflow( const std::string & s_via, const Address & peer, const bool debug );
+
+    bool window_is_open( void ) { return unacked.size() < controller.window_size(); }
+  };
+
+  std::vector<std::unique_ptr<Subflow>> subflows_;
+
+  uint64_t sequence_number_; /* next outgoing sequence number, on any subflow */
+
+  /* the byte stream being sent (optional; otherwise every datagram is filler) */
+  std::unique_ptr<StreamSender> stream_;
+
+  /* datagram held back because a socket buffer was full (it goes out on
+     whichever subflow has room next) */
+  std::unique_ptr<ContestMessage> pending_;
+
+  unsigned int spin_budget_us_;
+
+  SenderStats stats_;
+
+  bool have_data( void );
+  Subflow * pick_subflow( void );
+  bool send_datagram( Subflow & subflow );
+  void got_ack( Subflow & subflow, const uint64_t timestamp, const ContestMessage & ack );
+  void timer_expired( Subflow & subflow, const uint64_t timestamp );
+  void set_timer( Subflow & subflow, const uint64_t deadline );
+
+public:
+  /* one subflow per local address or interface name in via */
+  MultipathSender( const Address & peer, const std::vector<std::string> & via, const bool debug );
+
+  void set_spin_budget( const unsigned int spin_budget_us ) override;
+  void use_path_cache( const std::string & filename ) override;
+  void use_tx_timestamps( const bool hardware ) override;
+  void use_stream( const std::string & filename ) override;
+  void use_fec( void ) override;
+  void add_message_class( const std::string & filename, const unsigned int weight,
+			  const bool priority ) override;
+  void use_io_thread( void ) override;
+  int loop( const uint64_t deadline_ms ) override;
+  using DatagrumpSenderBase::loop;
+
+  const SenderStats & stats( void ) const override { return stats_; }
+};
+
+#endif /* MULTIPATH_SENDER_HH */
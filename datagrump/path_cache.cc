@@ -0,0 +1,117 @@
+#include <ctime>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "file_descriptor.hh"
+#include "path_cache.hh"
+#include "util.hh"
+
+using namespace std;
+
+static uint64_t now_s( void )
+{
+  return time( nullptr );
+}
+
+/* read the profiles in a cache file (a missing file has none) */
+static map<string, PathProfile> load( const string & filename )
+{
+  map<string, PathProfile> profiles;
+
+  ifstream file( filename );
+  if ( not file.is_open() ) {
+    return profiles; /* nothing cached yet */
+  }
+
+  /* one line per destination: address min_rtt_ms delivery_rate stable_window updated */
+  string line;
+  while ( getline( file, line ) ) {
+    istringstream fields( line );
+    string destination;
+    PathProfile profile = PathProfile();
+    if ( fields >> destination >> profile.min_rtt_ms >> profile.delivery_rate
+	 >> profile.stable_window >> profile.updated ) {
+      profiles[ destination ] = profile;
+    }
+  }
+
+  return profiles;
+}
+
+/* load the cache */
+PathCache::PathCache( const string & filename, const uint64_t max_age_s )
+  : filename_( filename ),
+    max_age_s_( max_age_s ),
+    profiles_( load( filename ) )
+{}
+
+/* find a fresh profile for a destination */
+bool PathCache::lookup( const string & destination, PathProfile & profile ) const
+{
+  const auto entry = profiles_.find( destination );
+  if ( entry == profiles_.end() or entry->second.updated + max_age_s_ < now_s() ) {
+    return false;
+  }
+
+  profile = entry->second;
+  return true;
+}
+
+/* replace the profile for a destination */
+void PathCache::update( const string & destination, const PathProfile & profile )
+{
+  profiles_[ destination ] = profile;
+  profiles_[ destination ].updated = now_s();
+}
+
+/* write the cache back to disk */
+void PathCache::save( void ) const
+{
+  /* other senders may be saving the same cache: take turns (the lock is
+     on a file of its own, since the rename replaces the cache itself) */
+  FileDescriptor lock( SystemCall( "open " + filename_ + ".lock",
+				   open( (filename_ + ".lock").c_str(),
+					 O_RDWR | O_CREAT | O_CLOEXEC, 0644 ) ) );
+  SystemCall( "flock", flock( lock.fd_num(), LOCK_EX ) );
+
+  /* keep what others saved since we loaded, unless ours is newer */
+  map<string, PathProfile> profiles = load( filename_ );
+  for ( const auto & entry : profiles_ ) {
+    const auto saved = profiles.find( entry.first );
+    if ( saved == profiles.end() or saved->second.updated <= entry.second.updated ) {
+      profiles[ entry.first ] = entry.second;
+    }
+  }
+
+  ostringstream contents;
+  const uint64_t now = now_s();
+  for ( const auto & entry : profiles ) {
+    const PathProfile & p = entry.second;
+    if ( p.updated + max_age_s_ < now ) {
+      continue; /* stale */
+    }
+    contents << entry.first << " " << p.min_rtt_ms << " " << p.delivery_rate
+	     << " " << p.stable_window << " " << p.updated << "\n";
+  }
+
+  /* a temporary file of our own in the same directory, so the rename is atomic */
+  string temporary = filename_ + ".XXXXXX";
+  FileDescriptor file( SystemCall( "mkstemp " + temporary, mkstemp( &temporary[ 0 ] ) ) );
+
+  try {
+    SystemCall( "fchmod", fchmod( file.fd_num(), 0644 ) );
+    if ( not contents.str().empty() ) {
+      file.write( contents.str() );
+    }
+    SystemCall( "rename", rename( temporary.c_str(), filename_.c_str() ) );
+  } catch ( ... ) {
+    unlink( temporary.c_str() );
+    throw;
+  }
+}
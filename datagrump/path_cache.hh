@@ -0,0 +1,41 @@
+#ifndef PATH_CACHE_HH
+#define PATH_CACHE_HH
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+/* What a controller learned about the path to one destination */
+struct PathProfile
+{
+  uint64_t min_rtt_ms;        /* smallest RTT seen */
+  double delivery_rate;       /* datagrams acknowledged per millisecond */
+  unsigned int stable_window; /* last window that did not trigger a cut */
+  uint64_t updated;           /* wall-clock time of the checkpoint (seconds since the epoch) */
+};
+
+/* Small on-disk cache of path profiles, keyed by destination address */
+class PathCache
+{
+private:
+  std::string filename_;
+  uint64_t max_age_s_;
+  std::map<std::string, PathProfile> profiles_;
+
+public:
+  /* load the cache (a missing file is an empty cache); profiles older than
+     max_age_s are ignored on lookup and dropped on the next save */
+  PathCache( const std::string & filename, const uint64_t max_age_s = 3600 );
+
+  /* find a fresh profile for a destination */
+  bool lookup( const std::string & destination, PathProfile & profile ) const;
+
+  /* replace the profile for a destination */
+  void update( const std::string & destination, const PathProfile & profile );
+
+  /* write the cache back to disk (atomically, via a rename), keeping
+     profiles other processes saved in the meantime if they are newer */
+  void save( void ) const;
+};
+
+#endif /* PATH_CACHE_HH */
@@ -2,12 +2,35 @@
 
 #include <cstdlib>
 #include <iostream>
+#include <memory>
 
 #include "socket.hh"
-#include "contest_message.hh"
+#include "acknowledger.hh"
+#include "byte_stream.hh"
+#include "event_loop.hh"
+#include "trace.hh"
 
 using namespace std;
 
+/* Loop and acknowledge every incoming datagram back to its source
+   (and, in stream mode, reassemble the stream and say how far it got;
+   when recording, log each arrival to the trace) */
+static Task<> acknowledge( EventLoop & loop, UDPSocket & socket,
+			   StreamReceiver * const stream, TraceWriter * const trace )
+{
+  Acknowledger acknowledger( stream, trace );
+
+  while ( true ) {
+    const UDPSocket::received_datagram recd = co_await loop.recv( socket );
+
+    const bool was_finished = stream and stream->finished();
+    acknowledger.receive( socket, recd );
+    if ( stream and stream->finished() and not was_finished ) {
+      cerr << "Received the whole stream (" << stream->bytes_delivered() << " bytes)" << endl;
+    }
+  }
+}
+
 int main( int argc, char *argv[] )
 {
    /* check the command-line arguments */
@@ -15,38 +38,55 @@ int main( int argc, char *argv[] )
     abort();
   }
 
-  if ( argc != 2 ) {
-    cerr << "Usage: " << argv[ 0 ] << " PORT" << endl;
+  string stream_file, trace_file;
+  bool usage_error = argc < 2;
+  for ( int i = 2; i < argc; i++ ) {
+    const string option { argv[ i ] };
+    if ( option.substr( 0, 7 ) == "record=" and trace_file.empty() ) {
+      trace_file = option.substr( 7 );
+    } else if ( option.substr( 0, 7 ) != "record=" and stream_file.empty() ) {
+      stream_file = option;
+    } else {
+      usage_error = true;
+    }
+  }
+
+  if ( usage_error ) {
+    cerr << "Usage: " << argv[ 0 ] << " PORT [FILE] [record=TRACE]" << endl
+	 << "   with FILE (\"-\" for standard output), receive a stream from \"sender ... file=...\"" << endl
+	 << "   with record=, log each datagram's arrival to a binary trace (see trace-convert)" << endl;
     return EXIT_FAILURE;
   }
 
+  /* stream mode: write what arrives, in order, to a file */
+  unique_ptr<StreamReceiver> stream;
+  if ( not stream_file.empty() ) {
+    stream.reset( new StreamReceiver( stream_file ) );
+  }
+
+  /* recording: log the arrival of every datagram to a trace */
+  unique_ptr<TraceWriter> trace;
+  if ( not trace_file.empty() ) {
+    trace.reset( new TraceWriter( trace_file ) );
+  }
+
   /* create UDP socket for incoming datagrams */
   UDPSocket socket;
 
   /* turn on timestamps on receipt */
   socket.set_timestamps();
 
+  /* see the ECN bits of each datagram */
+  socket.set_receive_tos();
+
   /* "bind" the socket to the user-specified local port number */
   socket.bind( Address( "192.0.0.2", argv[ 1 ] ) );
 
   cerr << "Listening on " << socket.local_address().to_string() << endl;
 
-  uint64_t sequence_number = 0;
-
-  /* Loop and acknowledge every incoming datagram back to its source */
-  while ( true ) {
-    const UDPSocket::received_datagram recd = socket.recv();
-    ContestMessage message = recd.payload;
-
-    /* assemble the acknowledgment */
-    message.transform_into_ack( sequence_number++, recd.timestamp );
-
-    /* timestamp the ack just before sending */
-    message.set_send_timestamp();
-
-    /* send the ack */
-    socket.sendto( recd.source_address, message.to_string() );
-  }
+  EventLoop loop;
+  loop.spawn( acknowledge( loop, socket, stream.get(), trace.get() ) );
+  loop.run();
 
   return EXIT_SUCCESS;
 }
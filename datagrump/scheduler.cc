@@ -0,0 +1,130 @@
+#include <stdexcept>
+
+#include "scheduler.hh"
+#include "timestamp.hh"
+
+using namespace std;
+
+/* a class that holds the payloads handed to it */
+DatagramScheduler::ClassId DatagramScheduler::add_class( const unsigned int weight, const bool priority )
+{
+  if ( weight == 0 ) {
+    throw runtime_error( "DatagramScheduler: a class needs a weight of at least 1" );
+  }
+
+  classes_.push_back( { weight * QUANTUM, priority, 0, Source(), {}, false } );
+  return classes_.size() - 1;
+}
+
+/* a class that pulls its payloads from a source (it stays on its tier's list for good) */
+DatagramScheduler::ClassId DatagramScheduler::add_class( const unsigned int weight, const bool priority,
+							 const Source & source )
+{
+  const ClassId id = add_class( weight, priority );
+  TrafficClass & c = classes_.back();
+  c.source = source;
+  c.listed = true;
+  tier( c ).push_back( id );
+  pulled_.push_back( id );
+  return id;
+}
+
+void DatagramScheduler::enqueue( const ClassId id, string && payload )
+{
+  TrafficClass & c = classes_.at( id );
+  if ( c.source.take ) {
+    throw runtime_error( "DatagramScheduler: class pulls its payloads from a source" );
+  }
+
+  c.queue.emplace_back( move( payload ), timestamp_us() );
+  queued_++;
+
+  if ( not c.listed ) {
+    c.listed = true;
+    tier( c ).push_back( id );
+  }
+}
+
+/* does any class have a datagram to send? */
+bool DatagramScheduler::has_datagram( void )
+{
+  if ( queued_ ) {
+    return true;
+  }
+
+  for ( const auto & id : pulled_ ) {
+    if ( classes_[ id ].source.ready() ) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* deficit round robin over one tier's list */
+bool DatagramScheduler::dequeue_from( deque<ClassId> & list, string & payload, ClassId & id, uint64_t & wait_us )
+{
+  /* pulled classes in a row found with nothing to send (once all of them
+     are, the tier has nothing) */
+  size_t idle = 0;
+
+  while ( idle < list.size() ) {
+    const ClassId front = list.front();
+    TrafficClass & c = classes_[ front ];
+
+    if ( c.source.take and not c.source.ready() ) {
+      /* an idle class doesn't save up its turns */
+      c.deficit = 0;
+      list.pop_front();
+      list.push_back( front );
+      idle++;
+      continue;
+    }
+
+    if ( c.deficit <= 0 ) {
+      /* its turn is over: top it up and move on */
+      c.deficit += c.quantum;
+      list.pop_front();
+      list.push_back( front );
+      idle = 0;
+      continue;
+    }
+
+    id = front;
+    if ( c.source.take ) {
+      payload = c.source.take();
+      wait_us = 0;
+    } else {
+      payload = move( c.queue.front().first );
+      wait_us = timestamp_us() - c.queue.front().second;
+      c.queue.pop_front();
+      queued_--;
+    }
+
+    c.deficit -= payload.size();
+
+    /* an emptied class leaves the list until it has something again, with
+       neither credit nor debt (the deficit doesn't outlive its turn) */
+    if ( not c.source.take and c.queue.empty() ) {
+      c.deficit = 0;
+      c.listed = false;
+      list.pop_front();
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+/* strict priority first, then everything else */
+bool DatagramScheduler::dequeue( string & payload, ClassId & id, uint64_t & wait_us )
+{
+  for ( auto & list : round_robin_ ) {
+    if ( dequeue_from( list, payload, id, wait_us ) ) {
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,81 @@
+#ifndef SCHEDULER_HH
+#define SCHEDULER_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* Chooses which class of traffic the sender's next datagram comes from,
+   whenever the window has room for one. Strict-priority classes always go
+   first; the rest share what is left by deficit round robin, in
+   proportion to their weights: on its turn a class sends until it has
+   used up weight * QUANTUM bytes (carrying any overdraft into its next
+   turn). Each tier keeps a round-robin list of the classes with something
+   to send, so choosing a class takes constant time.
+
+   A class either holds the payloads handed to it (enqueue), or pulls one
+   from a source when its turn comes, as the bulk data does (a stream
+   segment can only be made once its sequence number is known). */
+class DatagramScheduler
+{
+public:
+  typedef size_t ClassId;
+
+  /* where a pulled class gets its datagrams */
+  struct Source
+  {
+    std::function<bool( void )> ready = nullptr; /* is there one to send now? */
+    std::function<std::string( void )> take = nullptr; /* its payload */
+  };
+
+  /* bytes a weight-1 class may send per turn */
+  static const unsigned int QUANTUM = 1500;
+
+private:
+  struct TrafficClass
+  {
+    unsigned int quantum;
+    bool priority;
+    int64_t deficit;
+    Source source; /* (empty for a class that holds payloads) */
+    std::deque<std::pair<std::string, uint64_t>> queue; /* payload, and when it was queued (us) */
+    bool listed; /* in its tier's round-robin list */
+  };
+
+  std::vector<TrafficClass> classes_;
+  std::deque<ClassId> round_robin_[ 2 ]; /* the strict-priority tier, then the rest */
+  std::vector<ClassId> pulled_;
+  size_t queued_; /* payloads held, over all classes */
+
+  std::deque<ClassId> & tier( const TrafficClass & c ) { return round_robin_[ c.priority ? 0 : 1 ]; }
+  bool dequeue_from( std::deque<ClassId> & list, std::string & payload, ClassId & id, uint64_t & wait_us );
+
+public:
+  DatagramScheduler() : classes_(), round_robin_(), pulled_(), queued_( 0 ) {}
+
+  /* a class that holds the payloads handed to it */
+  ClassId add_class( const unsigned int weight, const bool priority );
+
+  /* a class that pulls its payloads from a source */
+  ClassId add_class( const unsigned int weight, const bool priority, const Source & source );
+
+  void enqueue( const ClassId id, std::string && payload );
+
+  /* payloads held for a class */
+  size_t queued( const ClassId id ) const { return classes_.at( id ).queue.size(); }
+
+  size_t class_count( void ) const { return classes_.size(); }
+
+  /* does any class have a datagram to send? */
+  bool has_datagram( void );
+
+  /* the next payload, which class it is from, and how long it was held
+     (false if no class has anything to send) */
+  bool dequeue( std::string & payload, ClassId & id, uint64_t & wait_us );
+};
+
+#endif /* SCHEDULER_HH */
@@ -1,39 +1,28 @@
 /* UDP sender for congestion-control contest */
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 
-#include "socket.hh"
-#include "contest_message.hh"
-#include "controller.hh"
-#include "poller.hh"
+#include "datagrump_sender.hh"
 
 using namespace std;
-using namespace PollerShortNames;
 
-/* simple sender class to handle the accounting */
-class DatagrumpSender
+static void usage( const char * const argv0 )
 {
-private:
-  UDPSocket socket_;
-  Controller controller_; /* your class */
-
-  uint64_t sequence_number_; /* next outgoing sequence number */
-
-  /* if network does not reorder or lose datagrams,
-     this is the sequence number that the sender
-     next expects will be acknowledged by the receiver */
-  uint64_t next_ack_expected_;
-
-  void send_datagram( void );
-  void got_ack( const uint64_t timestamp, const ContestMessage & msg );
-  bool window_is_open( void );
-
-public:
-  DatagrumpSender( const char * const host, const char * const port,
-		   const bool debug );
-  int loop( void );
-};
+  cerr << "Usage: " << argv0 << " HOST PORT [debug] [spin=USEC] [cache=FILE]"
+       << " [txstamp|hwstamp] [controller=NAME] [file=FILE] [fec] [io] [via=ADDRESS|INTERFACE]..."
+       << " [messages=FILE[:WEIGHT]]..." << endl
+       << "   controllers:";
+  for ( const auto & name : controller_names() ) {
+    cerr << " " << name;
+  }
+  cerr << endl
+       << "   each via= adds a subflow leaving from that local address or interface" << endl
+       << "   each messages= sends a line of FILE per datagram, ahead of the bulk data" << endl
+       << "   (or, with a WEIGHT, sharing the window with it by weight)" << endl
+       << "   io does the socket I/O on a thread of its own, pipelined with the controller" << endl;
+}
 
 int main( int argc, char *argv[] )
 {
@@ -42,117 +31,85 @@ int main( int argc, char *argv[] )
     abort();
   }
 
+  if ( argc < 3 ) {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+
   bool debug = false;
-  if ( argc == 4 and string( argv[ 3 ] ) == "debug" ) {
-    debug = true;
-  } else if ( argc == 3 ) {
-    /* do nothing */
-  } else {
-    cerr << "Usage: " << argv[ 0 ] << " HOST PORT [debug]" << endl;
+  unsigned int spin_budget_us = 0;
+  string path_cache;
+  bool tx_timestamps = false, hardware_timestamps = false;
+  string controller = controller_names().front();
+  string stream_file;
+  bool fec = false;
+  bool io_thread = false;
+  vector<string> via;
+  vector<pair<string, unsigned int>> message_files; /* weight 0: priority */
+  for ( int i = 3; i < argc; i++ ) {
+    const string option { argv[ i ] };
+    if ( option == "debug" ) {
+      debug = true;
+    } else if ( option.substr( 0, 5 ) == "spin=" ) {
+      spin_budget_us = stoul( option.substr( 5 ) );
+    } else if ( option.substr( 0, 6 ) == "cache=" ) {
+      path_cache = option.substr( 6 );
+    } else if ( option == "txstamp" or option == "hwstamp" ) {
+      tx_timestamps = true;
+      hardware_timestamps = option == "hwstamp";
+    } else if ( option.substr( 0, 11 ) == "controller=" ) {
+      controller = option.substr( 11 );
+    } else if ( option == "fec" ) {
+      fec = true;
+    } else if ( option == "io" ) {
+      io_thread = true;
+    } else if ( option.substr( 0, 5 ) == "file=" ) {
+      stream_file = option.substr( 5 );
+    } else if ( option.substr( 0, 4 ) == "via=" ) {
+      via.push_back( option.substr( 4 ) );
+    } else if ( option.substr( 0, 9 ) == "messages=" ) {
+      const string file = option.substr( 9 );
+      const size_t colon = file.rfind( ':' );
+      if ( colon == string::npos ) {
+	message_files.emplace_back( file, 0 );
+      } else {
+	message_files.emplace_back( file.substr( 0, colon ), stoul( file.substr( colon + 1 ) ) );
+      }
+    } else {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+  }
+
+  const auto & names = controller_names();
+  if ( find( names.begin(), names.end(), controller ) == names.end() ) {
+    usage( argv[ 0 ] );
     return EXIT_FAILURE;
   }
 
   /* create sender object to handle the accounting */
   /* all the interesting work is done by the Controller */
-  DatagrumpSender sender( argv[ 1 ], argv[ 2 ], debug );
-  return sender.loop();
-}
-
-DatagrumpSender::DatagrumpSender( const char * const host,
-				  const char * const port,
-				  const bool debug )
-  : socket_(),
-    controller_( debug ),
-    sequence_number_( 0 ),
-    next_ack_expected_( 0 )
-{
-  /* turn on timestamps when socket receives a datagram */
-  socket_.set_timestamps();
-
-  /* connect socket to the remote host */
-  /* (note: this doesn't send anything; it just tags the socket
-     locally with the remote address */
-  socket_.connect( Address( host, port ) );  
-
-  cerr << "Sending to " << socket_.peer_address().to_string() << endl;
-}
-
-void DatagrumpSender::got_ack( const uint64_t timestamp,
-			       const ContestMessage & ack )
-{
-  if ( not ack.is_ack() ) {
-    throw runtime_error( "sender got something other than an ack from the receiver" );
+  const auto sender = make_datagrump_sender( controller, Address( argv[ 1 ], argv[ 2 ] ), debug, via );
+  if ( spin_budget_us ) {
+    sender->set_spin_budget( spin_budget_us );
   }
-
-  /* Update sender's counter */
-  next_ack_expected_ = max( next_ack_expected_,
-			    ack.header.ack_sequence_number + 1 );
-
-  /* Inform congestion controller */
-  controller_.ack_received( ack.header.ack_sequence_number,
-			    ack.header.ack_send_timestamp,
-			    ack.header.ack_recv_timestamp,
-			    timestamp );
-}
-
-unsigned long long int pno = 0;
-
-void DatagrumpSender::send_datagram( void )
-{
-  /* All messages use the same dummy payload */
-  static const string dummy_payload( 1424, 'x' );
-
-  ContestMessage cm( sequence_number_++, dummy_payload );
-  cm.set_send_timestamp();
-//  cout << " Packet no " << pno << endl;
-  socket_.send( cm.to_string() );
-//  cout << " Packet no "  << pno++ << " was sent" << endl;
-
-  /* Inform congestion controller */
-  controller_.datagram_was_sent( cm.header.sequence_number,
-				 cm.header.send_timestamp );
-}
-
-bool DatagrumpSender::window_is_open( void )
-{
-  return sequence_number_ - next_ack_expected_ < controller_.window_size();
-}
-
-int DatagrumpSender::loop( void )
-{
-  /* read and write from the receiver using an event-driven "poller" */
-  Poller poller;
-
-  /* first rule: if the window is open, close it by
-     sending more datagrams */
-  poller.add_action( Action( socket_, Direction::Out, [&] () {
-	/* Close the window */
-	while ( window_is_open() ) {
-	  send_datagram();
-	}
-	return ResultType::Continue;
-      },
-      /* We're only interested in this rule when the window is open */
-      [&] () { return window_is_open(); } ) );
-
-  /* second rule: if sender receives an ack,
-     process it and inform the controller
-     (by using the sender's got_ack method) */
-  poller.add_action( Action( socket_, Direction::In, [&] () {
-	const UDPSocket::received_datagram recd = socket_.recv();
-	const ContestMessage ack  = recd.payload;
-	got_ack( recd.timestamp, ack );
-	return ResultType::Continue;
-      } ) );
-
-  /* Run these two rules forever */
-  while ( true ) {
-    const auto ret = poller.poll( controller_.timeout_ms() );
-    if ( ret.result == PollResult::Exit ) {
-      return ret.exit_status;
-    } else if ( ret.result == PollResult::Timeout ) {
-      /* After a timeout, send one datagram to try to get things moving again */
-      send_datagram();
-    }
+  if ( not path_cache.empty() ) {
+    sender->use_path_cache( path_cache );
+  }
+  if ( tx_timestamps ) {
+    sender->use_tx_timestamps( hardware_timestamps );
+  }
+  if ( not stream_file.empty() ) {
+    sender->use_stream( stream_file );
+  }
+  if ( fec ) {
+    sender->use_fec();
+  }
+  if ( io_thread ) {
+    sender->use_io_thread();
+  }
+  for ( const auto & messages : message_files ) {
+    sender->add_message_class( messages.first, max( messages.second, 1u ), messages.second == 0 );
   }
+  return sender->loop();
 }
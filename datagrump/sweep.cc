@@ -0,0 +1,298 @@
+/* run the benchmark over a grid of controllers and bottlenecks, as many
+   runs at a time as the cores can keep apart, and tabulate the results */
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "datagrump_sender.hh"
+#include "file_descriptor.hh"
+#include "thread_pool.hh"
+#include "util.hh"
+
+using namespace std;
+
+extern char ** environ;
+
+/* threads each benchmark run keeps busy: sender, receiver and relay */
+static const unsigned int RUN_THREADS = 3;
+
+static void usage( const char * const argv0 )
+{
+  cerr << "Usage: " << argv0 << " [-j JOBS] [-b BENCHMARK] [-d SECONDS] [-a CONTROLLER,...]"
+       << " [-r MBIT/S,... | -t TRACE,...] [-l DELAY_MS,...] [-p LOSS,...] [-- BENCHMARK_OPTION...]" << endl
+       << "   runs the benchmark once for every combination of the values given (each" << endl
+       << "   list is comma-separated; -a defaults to every controller), JOBS at a time" << endl
+       << "   (default: one per three cores, as each run keeps a sender, a receiver and" << endl
+       << "   a relay thread busy), and prints a row per run and the mean of each" << endl
+       << "   controller; options after -- go to every run" << endl;
+}
+
+/* "a,b,c" (false if there are no items, or an empty one) */
+static bool split_list( const string & list, vector<string> & items )
+{
+  items.clear();
+  stringstream in( list );
+  string item;
+  while ( getline( in, item, ',' ) ) {
+    if ( item.empty() ) {
+      return false;
+    }
+    items.push_back( item );
+  }
+  return not items.empty();
+}
+
+/* one run of the grid */
+struct Run
+{
+  string controller = "";
+  string bottleneck = "";
+  string delay_ms = "";
+  string loss = "";
+};
+
+/* what a run's report says (or why there isn't one) */
+struct RunResult
+{
+  double mbps = 0;
+  uint64_t rtt_median_ms = 0, rtt_p95_ms = 0, rtt_p99_ms = 0;
+  string error = "";
+};
+
+/* run a program, and return what it wrote to standard output (its
+   standard error goes nowhere); throws if it doesn't exit successfully */
+static string run_program( const vector<string> & args )
+{
+  vector<char *> argv;
+  for ( const auto & arg : args ) {
+    argv.push_back( const_cast<char *>( arg.c_str() ) );
+  }
+  argv.push_back( nullptr );
+
+  /* (close-on-exec, so the programs other threads start don't hold it open) */
+  int pipe_fds[ 2 ];
+  SystemCall( "pipe2", pipe2( pipe_fds, O_CLOEXEC ) );
+  FileDescriptor reader( pipe_fds[ 0 ] );
+
+  pid_t pid;
+  {
+    FileDescriptor writer( pipe_fds[ 1 ] );
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init( &actions );
+    posix_spawn_file_actions_adddup2( &actions, writer.fd_num(), STDOUT_FILENO );
+    posix_spawn_file_actions_addopen( &actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0 );
+
+    const int error = posix_spawnp( &pid, argv[ 0 ], &actions, nullptr, argv.data(), environ );
+    posix_spawn_file_actions_destroy( &actions );
+    if ( error ) {
+      throw unix_error( "posix_spawnp " + args.front(), error );
+    }
+  } /* (our copy of the write end closes here, so the read ends when the program does) */
+
+  string output;
+  while ( not reader.eof() ) {
+    output += reader.read();
+  }
+
+  int status;
+  SystemCall( "waitpid", waitpid( pid, &status, 0 ) );
+  if ( not WIFEXITED( status ) or WEXITSTATUS( status ) != EXIT_SUCCESS ) {
+    string command;
+    for ( const auto & arg : args ) {
+      command += (command.empty() ? "" : " ") + arg;
+    }
+    throw runtime_error( "failed: " + command );
+  }
+
+  return output;
+}
+
+/* the numbers from the benchmark's report */
+static RunResult parse_report( const string & report )
+{
+  RunResult result;
+
+  stringstream in( report );
+  string line;
+  while ( getline( in, line ) ) {
+    if ( line.compare( 0, 11, "throughput:" ) == 0 ) {
+      const size_t paren = line.find( '(' );
+      if ( paren != string::npos ) {
+	result.mbps = stod( line.substr( paren + 1 ) );
+      }
+    } else if ( line.compare( 0, 10, "RTT (ms): " ) == 0 ) {
+      sscanf( line.c_str(), "RTT (ms): min %*u, median %" SCNu64 ", p95 %" SCNu64 ", p99 %" SCNu64,
+	      &result.rtt_median_ms, &result.rtt_p95_ms, &result.rtt_p99_ms );
+    }
+  }
+
+  return result;
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  /* the benchmark built alongside this program, unless told otherwise */
+  const string argv0 = argv[ 0 ];
+  string benchmark = argv0.find( '/' ) == string::npos
+    ? "benchmark" : argv0.substr( 0, argv0.rfind( '/' ) + 1 ) + "benchmark";
+
+  size_t jobs = 0;
+  string seconds = "10";
+  vector<string> controllers = controller_names();
+  vector<string> rates = { "0" }, traces, delays = { "0" }, losses = { "0" };
+
+  int opt;
+  while ( (opt = getopt( argc, argv, "j:b:d:a:r:t:l:p:" )) != -1 ) {
+    bool list_ok = true;
+    switch ( opt ) {
+    case 'j': jobs = stoul( optarg ); break;
+    case 'b': benchmark = optarg; break;
+    case 'd': seconds = optarg; break;
+    case 'a': list_ok = split_list( optarg, controllers ); break;
+    case 'r': list_ok = split_list( optarg, rates ); break;
+    case 't': list_ok = split_list( optarg, traces ); break;
+    case 'l': list_ok = split_list( optarg, delays ); break;
+    case 'p': list_ok = split_list( optarg, losses ); break;
+    default: usage( argv[ 0 ] ); return EXIT_FAILURE;
+    }
+
+    if ( not list_ok ) {
+      cerr << "-" << char( opt ) << ": empty list, or an empty item in it" << endl;
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+  }
+
+  /* (getopt has stopped at --, or the end) */
+  const vector<string> extra( argv + optind, argv + argc );
+
+  try {
+    /* the grid, in the order the table prints it */
+    vector<Run> runs;
+    const vector<string> & bottlenecks = traces.empty() ? rates : traces;
+    for ( const auto & controller : controllers ) {
+      for ( const auto & bottleneck : bottlenecks ) {
+	for ( const auto & delay_ms : delays ) {
+	  for ( const auto & loss : losses ) {
+	    runs.push_back( { controller, bottleneck, delay_ms, loss } );
+	  }
+	}
+      }
+    }
+
+    /* runs that compete for cores would measure the scheduler, not the controllers */
+    if ( jobs == 0 ) {
+      jobs = max( 1u, thread::hardware_concurrency() / RUN_THREADS );
+    }
+
+    ThreadPool pool( jobs );
+    cerr << runs.size() << " runs of " << seconds << " s, " << pool.size() << " at a time" << endl;
+
+    const vector<RunResult> results = pool.map_reduce(
+      runs.size(),
+      [&] ( const size_t i ) {
+	const Run & run = runs[ i ];
+	vector<string> args = { benchmark, "-d", seconds, "-a", run.controller,
+				traces.empty() ? "-r" : "-t", run.bottleneck,
+				"-l", run.delay_ms, "-p", run.loss };
+	args.insert( args.end(), extra.begin(), extra.end() );
+
+	/* a run that fails gets a row saying so, rather than losing the table */
+	try {
+	  return parse_report( run_program( args ) );
+	} catch ( const exception & e ) {
+	  RunResult failed;
+	  failed.error = e.what();
+	  return failed;
+	}
+      },
+      vector<RunResult>(),
+      [] ( vector<RunResult> && all, RunResult && result ) {
+	all.push_back( result );
+	return all;
+      } );
+
+    /* a row per run */
+    cout << left << setw( 12 ) << "controller" << setw( 24 ) << "bottleneck" << right
+	 << setw( 9 ) << "delay" << setw( 7 ) << "loss" << setw( 10 ) << "Mbit/s"
+	 << setw( 7 ) << "p50" << setw( 7 ) << "p95" << setw( 7 ) << "p99" << "  (RTT, ms)" << endl;
+
+    /* and per controller: the total throughput and 95th-percentile RTT of
+       its runs that succeeded, and how many those were */
+    struct Totals
+    {
+      double mbps = 0;
+      uint64_t rtt_p95_ms = 0;
+      size_t runs = 0;
+    };
+    map<string, Totals> totals;
+    size_t failures = 0;
+
+    for ( size_t i = 0; i < runs.size(); i++ ) {
+      const Run & run = runs[ i ];
+      const RunResult & result = results[ i ];
+
+      cout << left << setw( 12 ) << run.controller
+	   << setw( 24 ) << (not traces.empty() ? run.bottleneck
+			      : run.bottleneck == "0" ? "unlimited" : run.bottleneck + " Mbit/s") << right
+	   << setw( 9 ) << run.delay_ms << setw( 7 ) << run.loss;
+
+      if ( not result.error.empty() ) {
+	cout << setw( 10 ) << "failed" << endl;
+	cerr << result.error << endl;
+	failures++;
+	continue;
+      }
+
+      cout << fixed << setprecision( 2 ) << setw( 10 ) << result.mbps
+	   << setw( 7 ) << result.rtt_median_ms << setw( 7 ) << result.rtt_p95_ms
+	   << setw( 7 ) << result.rtt_p99_ms << endl;
+
+      Totals & total = totals[ run.controller ];
+      total.mbps += result.mbps;
+      total.rtt_p95_ms += result.rtt_p95_ms;
+      total.runs++;
+    }
+
+    cout << endl << left << setw( 12 ) << "controller" << right << setw( 14 ) << "mean Mbit/s"
+	 << setw( 14 ) << "mean p95 RTT" << endl;
+    for ( const auto & controller : controllers ) {
+      const Totals & total = totals[ controller ];
+      cout << left << setw( 12 ) << controller << right;
+      if ( total.runs == 0 ) {
+	cout << setw( 14 ) << "-" << setw( 14 ) << "-" << endl; /* every run failed */
+	continue;
+      }
+      cout << fixed << setprecision( 2 )
+	   << setw( 14 ) << total.mbps / total.runs
+	   << setw( 14 ) << double( total.rtt_p95_ms ) / total.runs << endl;
+    }
+
+    if ( failures ) {
+      cerr << failures << " of " << runs.size() << " runs failed" << endl;
+      return EXIT_FAILURE;
+    }
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
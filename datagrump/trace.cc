@@ -0,0 +1,166 @@
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include "trace.hh"
+#include "little_endian.hh"
+#include "util.hh"
+
+using namespace std;
+
+static const char TRACE_MAGIC[ 8 ] = { 'D', 'G', 'T', 'R', 'A', 'C', 'E', '1' };
+static const size_t HEADER_SIZE = 32;
+static const size_t RECORD_SIZE = 16;
+
+/* where the header keeps the record count */
+static const size_t COUNT_OFFSET = 16;
+
+/* room for this many records at first (the file doubles as it fills) */
+static const uint64_t INITIAL_CAPACITY = 65536;
+
+/* start a new trace */
+TraceWriter::TraceWriter( const string & filename )
+  : file_( filename, MappedFile::Mode::Create ),
+    count_( 0 ),
+    capacity_( INITIAL_CAPACITY ),
+    first_us_( 0 ),
+    last_us_( 0 )
+{
+  file_.resize( HEADER_SIZE + capacity_ * RECORD_SIZE );
+
+  char * const header = file_.data();
+  memcpy( header, TRACE_MAGIC, sizeof( TRACE_MAGIC ) );
+  put_le32( header + 8, RECORD_SIZE );
+  put_le32( header + 12, 0 );
+  put_le64( header + COUNT_OFFSET, 0 );
+  put_le64( header + 24, 0 );
+}
+
+void TraceWriter::set_start_unix_us( const uint64_t start_unix_us )
+{
+  put_le64( file_.data() + 24, start_unix_us );
+}
+
+/* trim the file to the records written */
+TraceWriter::~TraceWriter()
+{
+  try {
+    file_.resize( HEADER_SIZE + count_ * RECORD_SIZE );
+  } catch ( const exception & e ) {
+    print_exception( e );
+  }
+}
+
+void TraceWriter::record( const TraceRecord & record )
+{
+  if ( count_ == capacity_ ) {
+    capacity_ *= 2;
+    file_.resize( HEADER_SIZE + capacity_ * RECORD_SIZE );
+  }
+
+  char * const slot = file_.data() + HEADER_SIZE + count_ * RECORD_SIZE;
+  put_le64( slot, record.arrival_us );
+  put_le32( slot + 8, record.bytes );
+  put_le32( slot + 12, record.sequence_number );
+
+  /* publish the record only once it is complete */
+  put_le64( file_.data() + COUNT_OFFSET, ++count_ );
+}
+
+/* record a datagram as it arrives */
+void TraceWriter::arrival( const uint64_t timestamp_us, const uint32_t bytes, const uint64_t sequence_number )
+{
+  if ( count_ == 0 ) {
+    first_us_ = timestamp_us;
+    set_start_unix_us( chrono::duration_cast<chrono::microseconds>(
+			 chrono::system_clock::now().time_since_epoch() ).count() );
+  }
+
+  /* (a signed difference, since a timestamp taken just before the clock's epoch wraps around) */
+  const int64_t since_first = timestamp_us - first_us_;
+  last_us_ = max( last_us_, uint64_t( max( since_first, int64_t( 0 ) ) ) );
+  record( { last_us_, bytes, uint32_t( sequence_number ) } );
+}
+
+/* open a trace */
+TraceReader::TraceReader( const string & filename )
+  : file_( filename, MappedFile::Mode::ReadOnly ),
+    count_( 0 ),
+    start_unix_us_( 0 )
+{
+  const char * const header = file_.data();
+  if ( file_.size() < HEADER_SIZE or memcmp( header, TRACE_MAGIC, sizeof( TRACE_MAGIC ) ) ) {
+    throw runtime_error( filename + " is not a datagrump trace" );
+  }
+
+  if ( get_le32( header + 8 ) != RECORD_SIZE ) {
+    throw runtime_error( filename + ": unsupported trace record size" );
+  }
+
+  count_ = get_le64( header + COUNT_OFFSET );
+  start_unix_us_ = get_le64( header + 24 );
+
+  if ( count_ > (file_.size() - HEADER_SIZE) / RECORD_SIZE ) {
+    throw runtime_error( filename + ": trace is shorter than its header says" );
+  }
+
+  file_.advise_sequential();
+}
+
+TraceRecord TraceReader::at( const uint64_t index ) const
+{
+  if ( index >= count_ ) {
+    throw out_of_range( "TraceReader::at" );
+  }
+
+  const char * const slot = file_.data() + HEADER_SIZE + index * RECORD_SIZE;
+  return { get_le64( slot ), get_le32( slot + 8 ), get_le32( slot + 12 ) };
+}
+
+/* does the file start with the trace magic? */
+bool is_binary_trace( const string & filename )
+{
+  ifstream file( filename, ios::binary );
+  char magic[ sizeof( TRACE_MAGIC ) ] = {};
+  file.read( magic, sizeof( magic ) );
+  return file and not memcmp( magic, TRACE_MAGIC, sizeof( TRACE_MAGIC ) );
+}
+
+/* delivery opportunities (ms) that a trace's arrivals amount to */
+vector<uint64_t> trace_opportunities_ms( const TraceReader & trace )
+{
+  vector<uint64_t> ret;
+  ret.reserve( trace.size() );
+
+  for ( uint64_t i = 0; i < trace.size(); i++ ) {
+    const TraceRecord record = trace.at( i );
+    const uint64_t ms = max( uint64_t( 1 ), (record.arrival_us + 999) / 1000 );
+    const uint32_t opportunities = max( uint32_t( 1 ),
+					(record.bytes + MAHIMAHI_OPPORTUNITY_BYTES - 1) / MAHIMAHI_OPPORTUNITY_BYTES );
+    ret.insert( ret.end(), opportunities, ms );
+  }
+
+  return ret;
+}
+
+/* delivery opportunities from either kind of trace */
+vector<uint64_t> load_opportunities_ms( const string & filename )
+{
+  if ( is_binary_trace( filename ) ) {
+    return trace_opportunities_ms( TraceReader( filename ) );
+  }
+
+  ifstream trace_file( filename );
+  if ( not trace_file.is_open() ) {
+    throw runtime_error( "could not open trace file " + filename );
+  }
+
+  vector<uint64_t> ret;
+  uint64_t ms;
+  while ( trace_file >> ms ) {
+    ret.push_back( ms );
+  }
+  return ret;
+}
@@ -0,0 +1,98 @@
+#ifndef TRACE_HH
+#define TRACE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hh"
+
+/* Binary trace of datagram arrivals, as recorded by the receiver on a
+   real link (see receiver.cc's record=). It is memory-mapped, so
+   recording costs a few stores per datagram and no system calls, and a
+   trace of any length can be read without loading it.
+
+   The file is a 32-byte header (the magic "DGTRACE1", the record size,
+   a reserved word, the record count, and the wall-clock time of the first
+   arrival in microseconds), then one 16-byte record per datagram: its
+   arrival time in microseconds since the first, its UDP payload size,
+   and the low 32 bits of its sequence number. Everything is
+   little-endian. The count in the header is updated after every record,
+   so a recorder that is killed leaves a readable trace behind. */
+
+struct TraceRecord
+{
+  uint64_t arrival_us;
+  uint32_t bytes;
+  uint32_t sequence_number;
+};
+
+/* mahimahi traces list delivery opportunities, in milliseconds, of up to this many bytes */
+static const uint32_t MAHIMAHI_OPPORTUNITY_BYTES = 1504;
+
+class TraceWriter
+{
+private:
+  MappedFile file_;
+  uint64_t count_, capacity_; /* records written, and room for */
+
+  /* arrival() times: the first (as timestamp_us()), and the latest recorded */
+  uint64_t first_us_, last_us_;
+
+public:
+  /* start a new trace (replacing any file of that name) */
+  TraceWriter( const std::string & filename );
+
+  /* trim the file to the records written */
+  ~TraceWriter();
+
+  TraceWriter( const TraceWriter & other ) = delete;
+  TraceWriter & operator=( const TraceWriter & other ) = delete;
+
+  /* the wall-clock time of the first arrival (for the reader's information) */
+  void set_start_unix_us( const uint64_t start_unix_us );
+
+  /* add a record as it is (arrival times must not go backwards) */
+  void record( const TraceRecord & record );
+
+  /* record a datagram received at timestamp_us (as timestamp_us()): the
+     first sets the start of the trace, and later ones are kept in order
+     even if the clock steps back */
+  void arrival( const uint64_t timestamp_us, const uint32_t bytes, const uint64_t sequence_number );
+
+  uint64_t size( void ) const { return count_; }
+};
+
+class TraceReader
+{
+private:
+  MappedFile file_;
+  uint64_t count_;
+  uint64_t start_unix_us_;
+
+public:
+  /* open a trace (throws if it isn't one) */
+  TraceReader( const std::string & filename );
+
+  uint64_t size( void ) const { return count_; }
+  uint64_t start_unix_us( void ) const { return start_unix_us_; }
+
+  TraceRecord at( const uint64_t index ) const;
+};
+
+/* does the file start with the trace magic? */
+bool is_binary_trace( const std::string & filename );
+
+/* The delivery opportunities (in ms) a trace's arrivals amount to: one per
+   datagram (more for one whose payload alone is bigger than an opportunity),
+   at the millisecond it arrived, rounded up to at least 1 (mahimahi
+   repeats a trace with the last opportunity as its period, so that must
+   not be 0). */
+std::vector<uint64_t> trace_opportunities_ms( const TraceReader & trace );
+
+/* delivery opportunities from a mahimahi trace file, or from a binary
+   trace (the benchmark and trace-convert take either) */
+std::vector<uint64_t> load_opportunities_ms( const std::string & filename );
+
+#endif /* TRACE_HH */
@@ -0,0 +1,111 @@
+/* convert between the receiver's binary traces and mahimahi's text traces */
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include "trace.hh"
+#include "util.hh"
+
+using namespace std;
+
+static void usage( const char * const argv0 )
+{
+  cerr << "Usage: " << argv0 << " to-mahimahi TRACE OUTPUT" << endl
+       << "       " << argv0 << " from-mahimahi INPUT TRACE" << endl
+       << "       " << argv0 << " info TRACE" << endl
+       << "   to-mahimahi writes one delivery opportunity (in ms) per datagram recorded;" << endl
+       << "   from-mahimahi records one full-sized datagram per opportunity" << endl;
+}
+
+/* binary trace to mahimahi trace */
+static void to_mahimahi( const string & input, const string & output )
+{
+  const vector<uint64_t> opportunities = trace_opportunities_ms( TraceReader( input ) );
+  if ( opportunities.empty() ) {
+    throw runtime_error( input + ": no arrivals recorded" );
+  }
+
+  ofstream out( output );
+  if ( not out.is_open() ) {
+    throw runtime_error( "could not open " + output );
+  }
+
+  for ( const auto & ms : opportunities ) {
+    out << ms << "\n";
+  }
+
+  if ( not out.flush() ) {
+    throw runtime_error( "error writing " + output );
+  }
+}
+
+/* mahimahi trace to binary trace */
+static void from_mahimahi( const string & input, const string & output )
+{
+  const vector<uint64_t> opportunities = load_opportunities_ms( input );
+  if ( opportunities.empty() or opportunities.back() == 0 ) {
+    throw runtime_error( input + " has no usable delivery opportunities" );
+  }
+
+  TraceWriter trace( output );
+  uint64_t sequence_number = 0, last_ms = 0;
+  for ( const auto & ms : opportunities ) {
+    if ( ms < last_ms ) {
+      throw runtime_error( input + ": delivery opportunities go backwards" );
+    }
+    last_ms = ms;
+
+    trace.record( { ms * 1000, MAHIMAHI_OPPORTUNITY_BYTES, uint32_t( sequence_number++ ) } );
+  }
+}
+
+/* what a trace holds */
+static void info( const string & input )
+{
+  const TraceReader trace( input );
+  cout << input << ": " << trace.size() << " datagrams";
+
+  if ( trace.size() == 0 ) {
+    cout << endl;
+    return;
+  }
+
+  uint64_t bytes = 0;
+  for ( uint64_t i = 0; i < trace.size(); i++ ) {
+    bytes += trace.at( i ).bytes;
+  }
+
+  const uint64_t duration_us = trace.at( trace.size() - 1 ).arrival_us;
+  cout << ", " << bytes << " bytes over " << duration_us / 1e6 << " s";
+  if ( duration_us > 0 ) {
+    cout << " (" << bytes * 8.0 / duration_us << " Mbit/s)";
+  }
+  cout << ", recording started at " << trace.start_unix_us() / 1e6 << " (Unix time)" << endl;
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  try {
+    const string command = argc > 1 ? argv[ 1 ] : "";
+    if ( command == "to-mahimahi" and argc == 4 ) {
+      to_mahimahi( argv[ 2 ], argv[ 3 ] );
+    } else if ( command == "from-mahimahi" and argc == 4 ) {
+      from_mahimahi( argv[ 2 ], argv[ 3 ] );
+    } else if ( command == "info" and argc == 3 ) {
+      info( argv[ 2 ] );
+    } else {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,25 @@
+#!/bin/sh
+
+# Profile-guided build: build instrumented binaries, run the loopback
+# benchmark to record where the time goes, then rebuild with the profile.
+# Any arguments are passed on to configure (e.g. --enable-lto).
+
+set -e
+
+profile_dir="`pwd`/pgo-profile"
+rm -rf "$profile_dir"
+
+./configure --enable-release --enable-pgo=generate --with-pgo-dir="$profile_dir" "$@"
+make clean
+make
+
+# training runs: the send and ack paths on an unlimited link, a lossy
+# link with FEC, an ECN-marking link, and a bulk stream
+datagrump/benchmark -d 5 > /dev/null
+datagrump/benchmark -d 5 -r 50 -l 10 -p 0.01 -e > /dev/null
+datagrump/benchmark -d 5 -r 20 -m 5 > /dev/null
+datagrump/benchmark -d 5 -r 100 -f datagrump/benchmark > /dev/null
+
+./configure --enable-release --enable-pgo=use --with-pgo-dir="$profile_dir" "$@"
+make clean
+make
@@ -135,8 +135,8 @@ const sockaddr & Address::to_sockaddr( void ) const
   return addr_.as_sockaddr;
 }
 
-/* equality */
+/* equality (of the whole sockaddr; see FlowKey for a cheaper identity) */
 bool Address::operator==( const Address & other ) const
 {
-  return 0 == memcmp( &addr_, &other.addr_, size_ );
+  return size_ == other.size_ and 0 == memcmp( &addr_, &other.addr_, size_ );
 }
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "buffered_io.hh"
+
+using namespace std;
+
+/* queue data */
+void WriteQueue::push( string && data )
+{
+  if ( data.empty() ) {
+    return;
+  }
+
+  size_ += data.size();
+  chunks_.push_back( move( data ) );
+}
+
+/* write as much as one writev() will take */
+size_t WriteQueue::flush( FileDescriptor & fd )
+{
+  if ( empty() ) {
+    return 0;
+  }
+
+  iovec iov[ MAX_IOVECS ];
+  int iov_count = 0;
+  for ( auto it = chunks_.begin(); it != chunks_.end() and iov_count < MAX_IOVECS; ++it ) {
+    const size_t offset = (it == chunks_.begin()) ? front_offset_ : 0;
+    iov[ iov_count ].iov_base = const_cast<char *>( it->data() ) + offset;
+    iov[ iov_count ].iov_len = it->size() - offset;
+    iov_count++;
+  }
+
+  const size_t bytes_written = fd.writev( iov, iov_count );
+  size_ -= bytes_written;
+
+  /* retire the chunks that went out completely */
+  size_t remaining = bytes_written;
+  while ( remaining > 0 ) {
+    const size_t left_in_front = chunks_.front().size() - front_offset_;
+    if ( remaining < left_in_front ) {
+      front_offset_ += remaining;
+      break;
+    }
+
+    remaining -= left_in_front;
+    chunks_.pop_front();
+    front_offset_ = 0;
+  }
+
+  return bytes_written;
+}
+
+/* keep writing until everything queued is gone */
+void WriteQueue::flush_all( FileDescriptor & fd )
+{
+  while ( not empty() ) {
+    flush( fd );
+  }
+}
+
+ReadBuffer::ReadBuffer( const size_t capacity )
+  : storage_( capacity ),
+    head_( 0 ),
+    size_( 0 )
+{
+  if ( capacity == 0 ) {
+    throw runtime_error( "ReadBuffer needs a nonzero capacity" );
+  }
+}
+
+/* read whatever fits from the fd */
+size_t ReadBuffer::fill( FileDescriptor & fd )
+{
+  if ( full() ) {
+    throw runtime_error( "ReadBuffer::fill: buffer is full" );
+  }
+
+  /* the free space is at most two runs: up to the end of storage, then from the start */
+  const size_t tail = (head_ + size_) % capacity();
+  const size_t free_space = capacity() - size_;
+  const size_t first_run = min( free_space, capacity() - tail );
+
+  iovec iov[ 2 ];
+  iov[ 0 ].iov_base = &storage_[ tail ];
+  iov[ 0 ].iov_len = first_run;
+  iov[ 1 ].iov_base = &storage_[ 0 ];
+  iov[ 1 ].iov_len = free_space - first_run;
+
+  const size_t bytes_read = fd.readv( iov, iov[ 1 ].iov_len ? 2 : 1 );
+  size_ += bytes_read;
+
+  return bytes_read;
+}
+
+/* offset of the first occurrence of c */
+size_t ReadBuffer::find( const char c ) const
+{
+  for ( size_t i = 0; i < size_; i++ ) {
+    if ( storage_[ (head_ + i) % capacity() ] == c ) {
+      return i;
+    }
+  }
+
+  return string::npos;
+}
+
+/* copy out the first n bytes without consuming them */
+void ReadBuffer::peek( char * const out, const size_t n ) const
+{
+  if ( n > size_ ) {
+    throw runtime_error( "ReadBuffer::peek: not enough data" );
+  }
+
+  const size_t first_run = min( n, capacity() - head_ );
+  memcpy( out, &storage_[ head_ ], first_run );
+  memcpy( out + first_run, &storage_[ 0 ], n - first_run );
+}
+
+/* drop the first n bytes */
+void ReadBuffer::consume( const size_t n )
+{
+  if ( n > size_ ) {
+    throw runtime_error( "ReadBuffer::consume: not enough data" );
+  }
+
+  head_ = (head_ + n) % capacity();
+  size_ -= n;
+
+  /* start over at the front when empty, so reads stay in one run */
+  if ( size_ == 0 ) {
+    head_ = 0;
+  }
+}
+
+/* copy out and drop the first n bytes */
+string ReadBuffer::pop( const size_t n )
+{
+  string ret( n, 0 );
+  peek( &ret[ 0 ], n );
+  consume( n );
+  return ret;
+}
@@ -0,0 +1,72 @@
+#ifndef BUFFERED_IO_HH
+#define BUFFERED_IO_HH
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "file_descriptor.hh"
+
+/* Output queue that hands its chunks to writev() as they are, rather than
+   copying them together first; one syscall covers many pending messages */
+class WriteQueue
+{
+private:
+  std::deque<std::string> chunks_;
+  size_t front_offset_; /* bytes of the first chunk already written */
+  size_t size_;
+
+  /* most chunks gathered into one writev() */
+  const static int MAX_IOVECS = 64;
+
+public:
+  WriteQueue() : chunks_(), front_offset_( 0 ), size_( 0 ) {}
+
+  /* queue data (the rvalue version takes the string without copying) */
+  void push( std::string && data );
+  void push( const std::string & data ) { push( std::string( data ) ); }
+
+  bool empty( void ) const { return size_ == 0; }
+  size_t size( void ) const { return size_; }
+
+  /* write as much as one writev() will take (returns bytes written) */
+  size_t flush( FileDescriptor & fd );
+
+  /* keep writing until everything queued is gone (for blocking fds) */
+  void flush_all( FileDescriptor & fd );
+};
+
+/* Reusable ring buffer for input: fill() reads straight into the free
+   space (with readv(), when it wraps), and callers consume from the front */
+class ReadBuffer
+{
+private:
+  std::vector<char> storage_;
+  size_t head_; /* index of the first buffered byte */
+  size_t size_;
+
+public:
+  ReadBuffer( const size_t capacity = 16384 );
+
+  size_t size( void ) const { return size_; }
+  size_t capacity( void ) const { return storage_.size(); }
+  bool empty( void ) const { return size_ == 0; }
+  bool full( void ) const { return size_ == storage_.size(); }
+
+  /* read whatever fits from the fd (returns bytes read; zero means EOF) */
+  size_t fill( FileDescriptor & fd );
+
+  /* offset of the first occurrence of c, or std::string::npos */
+  size_t find( const char c ) const;
+
+  /* copy out the first n bytes without consuming them */
+  void peek( char * const out, const size_t n ) const;
+
+  /* drop the first n bytes */
+  void consume( const size_t n );
+
+  /* copy out and drop the first n bytes */
+  std::string pop( const size_t n );
+};
+
+#endif /* BUFFERED_IO_HH */
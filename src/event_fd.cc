@@ -0,0 +1,29 @@
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "event_fd.hh"
+#include "util.hh"
+
+using namespace std;
+
+EventFD::EventFD()
+  : FileDescriptor( SystemCall( "eventfd", eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) )
+{}
+
+/* Add one to the count. This is called from a thread other than the one
+   polling the fd, so it leaves the fd's (unsynchronized) write count alone. */
+void EventFD::notify( void )
+{
+  const uint64_t one = 1;
+  NonBlockingSystemCall( "write", ::write( fd_num(), &one, sizeof( one ) ) ); /* (a full counter is awake anyway) */
+}
+
+/* take the count */
+uint64_t EventFD::read_events( void )
+{
+  uint64_t events = 0;
+  const ssize_t bytes_read = NonBlockingSystemCall( "read", ::read( fd_num(), &events, sizeof( events ) ) );
+  register_read();
+
+  return bytes_read == sizeof( events ) ? events : 0;
+}
@@ -0,0 +1,22 @@
+#ifndef EVENT_FD_HH
+#define EVENT_FD_HH
+
+#include <cstdint>
+
+#include "file_descriptor.hh"
+
+/* a counter one thread can bump to wake another that is waiting on it
+   in a Poller: the fd is readable while the count is nonzero */
+class EventFD : public FileDescriptor
+{
+public:
+  EventFD();
+
+  /* add one to the count (waking whoever is polling the fd) */
+  void notify( void );
+
+  /* take the count, resetting it to zero (returns it) */
+  uint64_t read_events( void );
+};
+
+#endif /* EVENT_FD_HH */
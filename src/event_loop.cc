@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <chrono>
+
+#include "event_loop.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* monotonic clock used for timers, in microseconds */
+uint64_t EventLoop::now_us( void )
+{
+  return chrono::duration_cast<chrono::microseconds>( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+/* receive a datagram, waiting for one if necessary */
+Task<UDPSocket::received_datagram> EventLoop::recv( UDPSocket & socket )
+{
+  UDPSocket::received_datagram datagram = { Address(), 0, string(), 0, 0 };
+  while ( not socket.try_recv( datagram ) ) {
+    co_await readable( socket );
+  }
+  co_return datagram;
+}
+
+/* send a datagram, waiting for room in the socket buffer if necessary */
+Task<> EventLoop::send( UDPSocket & socket, const string & payload )
+{
+  while ( not socket.try_send( payload ) ) {
+    co_await writable( socket );
+  }
+}
+
+Task<> EventLoop::sendto( UDPSocket & socket, const Address & destination, const string & payload )
+{
+  while ( not socket.try_sendto( destination, payload ) ) {
+    co_await writable( socket );
+  }
+}
+
+/* run a task to completion alongside the others */
+void EventLoop::spawn( Task<> && task )
+{
+  tasks_.push_back( move( task ) );
+  ready_.push_back( tasks_.back().handle() );
+}
+
+/* resume everything that is ready to run */
+void EventLoop::resume_ready( void )
+{
+  /* coroutines resumed now may make others ready; those run next time round */
+  swap( resuming_, ready_ );
+  for ( const auto & handle : resuming_ ) {
+    handle.resume();
+  }
+  resuming_.clear();
+}
+
+/* destroy finished tasks (rethrowing anything they threw) */
+void EventLoop::reap_tasks( void )
+{
+  for ( auto task = tasks_.begin(); task != tasks_.end(); ) {
+    if ( task->done() ) {
+      Task<> finished = move( *task );
+      task = tasks_.erase( task );
+      finished.result();
+    } else {
+      ++task;
+    }
+  }
+}
+
+/* make everything waiting ready to run */
+void EventLoop::Signal::notify( void )
+{
+  loop_.ready_.insert( loop_.ready_.end(), waiting_.begin(), waiting_.end() );
+  waiting_.clear();
+}
+
+/* ppoll() without blocking until something is ready or the time runs out */
+int EventLoop::spin( const uint64_t limit_us )
+{
+  const auto start = chrono::steady_clock::now();
+  const auto deadline = start + chrono::microseconds( limit_us );
+  timespec no_wait { 0, 0 };
+
+  int ready = 0;
+  auto now = start;
+  do {
+    ready = SystemCall( "ppoll", ::ppoll( pollfds_.data(), pollfds_.size(), &no_wait, nullptr ) );
+    now = chrono::steady_clock::now();
+  } while ( ready == 0 and now < deadline );
+
+  spin_stats_.spin_ns += chrono::duration_cast<chrono::nanoseconds>( now - start ).count();
+  if ( ready > 0 ) {
+    spin_stats_.events_while_spinning++;
+  }
+
+  return ready;
+}
+
+/* wait for fds and timers, and mark whatever fired as ready */
+void EventLoop::wait( const int timeout_ms )
+{
+  /* how long to wait, in microseconds (-1 for as long as it takes) */
+  uint64_t timeout_us = 0;
+  if ( ready_.empty() ) {
+    timeout_us = timeout_ms < 0 ? uint64_t( -1 ) : uint64_t( timeout_ms ) * 1000;
+    if ( not timers_.empty() ) {
+      const uint64_t now = now_us();
+      const uint64_t deadline = timers_.top().deadline_us;
+      timeout_us = min( timeout_us, deadline > now ? deadline - now : 0 );
+    }
+  }
+
+  pollfds_.clear();
+  for ( const auto & waiter : waiters_ ) {
+    pollfds_.push_back( { waiter.fd, waiter.events, 0 } );
+  }
+
+  int ready = 0;
+  if ( spin_budget_us_ > 0 and timeout_us > 0 ) {
+    const uint64_t spun_before = spin_stats_.spin_ns;
+    ready = spin( min( timeout_us, uint64_t( spin_budget_us_ ) ) );
+    if ( ready == 0 ) {
+      spin_stats_.blocking_polls++;
+      if ( timeout_us != uint64_t( -1 ) ) {
+	timeout_us -= min( timeout_us, (spin_stats_.spin_ns - spun_before) / 1000 );
+      }
+    }
+  }
+
+  if ( ready == 0 ) {
+    /* ppoll() takes the timeout in nanoseconds, so timers aren't rounded to milliseconds */
+    timespec timeout { time_t( timeout_us / 1000000 ), long( timeout_us % 1000000 * 1000 ) };
+    ready = SystemCall( "ppoll", ::ppoll( pollfds_.data(), pollfds_.size(),
+					   timeout_us == uint64_t( -1 ) ? nullptr : &timeout, nullptr ) );
+  }
+
+  if ( ready == 0 ) {
+    pollfds_.clear(); /* nothing to look at */
+  }
+
+  /* wake the waiters whose fds are ready (or in error, so the next operation reports it) */
+  size_t still_waiting = 0;
+  for ( size_t i = 0; i < waiters_.size(); i++ ) {
+    if ( i < pollfds_.size() and pollfds_[ i ].revents ) {
+      *waiters_[ i ].revents = pollfds_[ i ].revents;
+      ready_.push_back( waiters_[ i ].handle );
+    } else {
+      waiters_[ still_waiting++ ] = waiters_[ i ];
+    }
+  }
+  waiters_.erase( waiters_.begin() + still_waiting, waiters_.end() );
+
+  const uint64_t now = now_us();
+  while ( not timers_.empty() and timers_.top().deadline_us <= now ) {
+    ready_.push_back( timers_.top().handle );
+    timers_.pop();
+  }
+}
+
+/* run until every spawned task has finished, or stop() is called */
+void EventLoop::run( void )
+{
+  stopping_ = false;
+
+  while ( true ) {
+    resume_ready();
+    reap_tasks();
+
+    if ( stopping_ or tasks_.empty() ) {
+      return;
+    }
+
+    wait( -1 );
+  }
+}
+
+/* run what is ready, wait for what comes next (up to a limit) and run that */
+bool EventLoop::run_once( const int timeout_ms )
+{
+  resume_ready();
+  reap_tasks();
+
+  if ( stopping_ or tasks_.empty() ) {
+    return false;
+  }
+
+  wait( timeout_ms );
+  resume_ready();
+  reap_tasks();
+
+  return not (stopping_ or tasks_.empty());
+}
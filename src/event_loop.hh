@@ -0,0 +1,193 @@
+#ifndef EVENT_LOOP_HH
+#define EVENT_LOOP_HH
+
+#include <coroutine>
+#include <cstdint>
+#include <list>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+
+#include "file_descriptor.hh"
+#include "poller.hh"
+#include "socket.hh"
+#include "task.hh"
+
+/* Runs coroutines (Tasks) over ppoll(2). A coroutine that needs to wait does
+   co_await loop.readable( fd ), loop.writable( fd ) or loop.sleep_us( n ),
+   and the loop resumes it directly when the fd is ready or the time is up:
+   there are no registered callbacks and no std::function per event.
+
+   For example, a receiver that acknowledges everything:
+
+     Task<> acknowledge( EventLoop & loop, UDPSocket & socket )
+     {
+       while ( true ) {
+         const auto datagram = co_await loop.recv( socket );
+         ...
+       }
+     }
+
+     EventLoop loop;
+     loop.spawn( acknowledge( loop, socket ) );
+     loop.run();
+
+   A program with its own work to do between events (deadlines, statistics)
+   calls run_once() in its own loop instead of run(). */
+class EventLoop
+{
+private:
+  struct Waiter
+  {
+    int fd;
+    short events;
+    short * revents; /* where to say what woke it */
+    std::coroutine_handle<> handle;
+  };
+
+  struct Timer
+  {
+    uint64_t deadline_us;
+    std::coroutine_handle<> handle;
+
+    bool operator>( const Timer & other ) const { return deadline_us > other.deadline_us; }
+  };
+
+  std::vector<Waiter> waiters_;
+  std::vector<pollfd> pollfds_;
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+  std::vector<std::coroutine_handle<>> ready_, resuming_;
+  std::list<Task<>> tasks_;
+  bool stopping_;
+
+  unsigned int spin_budget_us_;
+  Poller::SpinStats spin_stats_;
+
+  /* ppoll() without blocking until something is ready or limit_us runs out */
+  int spin( const uint64_t limit_us );
+
+  /* resume everything that is ready to run */
+  void resume_ready( void );
+
+  /* destroy finished tasks (rethrowing anything they threw) */
+  void reap_tasks( void );
+
+  /* wait for fds and timers (for at most timeout_ms, unless it is -1),
+     and mark whatever fired as ready */
+  void wait( const int timeout_ms );
+
+public:
+  class FdAwaiter
+  {
+  private:
+    EventLoop & loop_;
+    int fd_;
+    short events_, revents_;
+
+  public:
+    FdAwaiter( EventLoop & loop, const int fd, const short events )
+      : loop_( loop ), fd_( fd ), events_( events ), revents_( 0 ) {}
+
+    bool await_ready( void ) const noexcept { return false; }
+    void await_suspend( const std::coroutine_handle<> handle ) { loop_.waiters_.push_back( { fd_, events_, &revents_, handle } ); }
+
+    /* the poll(2) events that woke the coroutine (POLLERR etc. included) */
+    short await_resume( void ) const noexcept { return revents_; }
+  };
+
+  class TimerAwaiter
+  {
+  private:
+    EventLoop & loop_;
+    uint64_t deadline_us_;
+
+  public:
+    TimerAwaiter( EventLoop & loop, const uint64_t deadline_us )
+      : loop_( loop ), deadline_us_( deadline_us ) {}
+
+    bool await_ready( void ) const noexcept { return false; }
+    void await_suspend( const std::coroutine_handle<> handle ) { loop_.timers_.push( { deadline_us_, handle } ); }
+    void await_resume( void ) const noexcept {}
+  };
+
+  /* Something coroutines can wait for until another says it has happened,
+     such as "the window may have opened": co_await signal.wait() suspends
+     until the next notify() (so check the condition again after waking). */
+  class Signal
+  {
+  private:
+    EventLoop & loop_;
+    std::vector<std::coroutine_handle<>> waiting_;
+
+  public:
+    class Awaiter
+    {
+    private:
+      Signal & signal_;
+
+    public:
+      explicit Awaiter( Signal & signal ) : signal_( signal ) {}
+
+      bool await_ready( void ) const noexcept { return false; }
+      void await_suspend( const std::coroutine_handle<> handle ) { signal_.waiting_.push_back( handle ); }
+      void await_resume( void ) const noexcept {}
+    };
+
+    explicit Signal( EventLoop & loop ) : loop_( loop ), waiting_() {}
+
+    Awaiter wait( void ) { return Awaiter( *this ); }
+
+    /* make everything waiting ready to run (after the coroutine calling this suspends) */
+    void notify( void );
+  };
+
+  EventLoop() : waiters_(), pollfds_(), timers_(), ready_(), resuming_(), tasks_(), stopping_( false ),
+		spin_budget_us_( 0 ), spin_stats_() {}
+
+  /* monotonic clock used for timers, in microseconds */
+  static uint64_t now_us( void );
+
+  /* wait until the fd is readable / writable (or has an error); co_await gives the revents */
+  FdAwaiter readable( const FileDescriptor & fd ) { return FdAwaiter( *this, fd.fd_num(), POLLIN ); }
+  FdAwaiter writable( const FileDescriptor & fd ) { return FdAwaiter( *this, fd.fd_num(), POLLOUT ); }
+
+  /* wait for (at least) a number of microseconds, or until a time on now_us()'s clock */
+  TimerAwaiter sleep_us( const uint64_t usecs ) { return TimerAwaiter( *this, now_us() + usecs ); }
+  TimerAwaiter sleep_until_us( const uint64_t deadline_us ) { return TimerAwaiter( *this, deadline_us ); }
+
+  /* let everything else that is ready run first */
+  TimerAwaiter yield( void ) { return TimerAwaiter( *this, 0 ); }
+
+  /* receive a datagram, waiting for one if necessary */
+  Task<UDPSocket::received_datagram> recv( UDPSocket & socket );
+
+  /* send a datagram, waiting for room in the socket buffer if necessary */
+  Task<> send( UDPSocket & socket, const std::string & payload );
+  Task<> sendto( UDPSocket & socket, const Address & destination, const std::string & payload );
+
+  /* run a task to completion alongside the others (the loop owns it) */
+  void spawn( Task<> && task );
+
+  /* run until every spawned task has finished, or stop() is called */
+  void run( void );
+
+  /* run what is ready, wait (for at most timeout_ms, unless it is -1) and run
+     what that woke; false once every task has finished or stop() was called */
+  bool run_once( const int timeout_ms );
+
+  /* make run() return once the coroutine calling this suspends */
+  void stop( void ) { stopping_ = true; }
+
+  /* before blocking, keep polling for up to this many microseconds
+     (as Poller::set_spin_budget) */
+  void set_spin_budget( const unsigned int spin_budget_us ) { spin_budget_us_ = spin_budget_us; }
+  const Poller::SpinStats & spin_stats( void ) const { return spin_stats_; }
+
+  /* forbid copying */
+  EventLoop( const EventLoop & other ) = delete;
+  EventLoop & operator=( const EventLoop & other ) = delete;
+};
+
+#endif /* EVENT_LOOP_HH */
@@ -1,7 +1,11 @@
+#include <algorithm>
+#include <vector>
+
 #include "file_descriptor.hh"
 #include "util.hh"
 
 #include <unistd.h>
+#include <fcntl.h>
 
 using namespace std;
 
@@ -38,6 +42,19 @@ FileDescriptor::~FileDescriptor()
   }
 }
 
+/* put the fd in blocking or non-blocking mode */
+void FileDescriptor::set_blocking( const bool blocking )
+{
+  int flags = SystemCall( "fcntl", fcntl( fd_, F_GETFL ) );
+  if ( blocking ) {
+    flags &= ~O_NONBLOCK;
+  } else {
+    flags |= O_NONBLOCK;
+  }
+
+  SystemCall( "fcntl", fcntl( fd_, F_SETFL, flags ) );
+}
+
 /* attempt to write a portion of a string */
 string::const_iterator FileDescriptor::write( const string::const_iterator & begin,
 					      const string::const_iterator & end )
@@ -46,29 +63,67 @@ string::const_iterator FileDescriptor::write( const string::const_iterator & beg
     throw runtime_error( "nothing to write" );
   }
 
-  ssize_t bytes_written = SystemCall( "write", ::write( fd_, &*begin, end - begin ) );
-  if ( bytes_written == 0 ) {
+  return begin + write( &*begin, end - begin );
+}
+
+/* write part of a buffer with one syscall */
+size_t FileDescriptor::write( const char * const data, const size_t length )
+{
+  ssize_t bytes_written = SystemCall( "write", ::write( fd_, data, length ) );
+  if ( bytes_written == 0 and length > 0 ) {
     throw runtime_error( "write returned 0" );
   }
 
   register_write();
 
-  return begin + bytes_written;
+  return bytes_written;
 }
 
-/* read method */
-string FileDescriptor::read( const size_t limit )
+/* gather-write several buffers with one syscall */
+size_t FileDescriptor::writev( const iovec * const iov, const int iov_count )
 {
-  char buffer[ BUFFER_SIZE ];
+  ssize_t bytes_written = SystemCall( "writev", ::writev( fd_, iov, iov_count ) );
+
+  register_write();
+
+  return bytes_written;
+}
 
-  ssize_t bytes_read = SystemCall( "read", ::read( fd_, buffer, min( BUFFER_SIZE, limit ) ) );
+/* read into a caller-supplied buffer */
+size_t FileDescriptor::read( char * const buffer, const size_t capacity )
+{
+  ssize_t bytes_read = SystemCall( "read", ::read( fd_, buffer, capacity ) );
+  if ( bytes_read == 0 and capacity > 0 ) {
+    set_eof();
+  }
+
+  register_read();
+
+  return bytes_read;
+}
+
+/* scatter-read into several buffers with one syscall */
+size_t FileDescriptor::readv( const iovec * const iov, const int iov_count )
+{
+  ssize_t bytes_read = SystemCall( "readv", ::readv( fd_, iov, iov_count ) );
   if ( bytes_read == 0 ) {
     set_eof();
   }
 
   register_read();
 
-  return string( buffer, bytes_read );
+  return bytes_read;
+}
+
+/* read method */
+string FileDescriptor::read( const size_t limit )
+{
+  /* reused from call to call, rather than a megabyte of stack per read */
+  static thread_local vector<char> buffer( BUFFER_SIZE );
+
+  const size_t bytes_read = read( buffer.data(), min( BUFFER_SIZE, limit ) );
+
+  return string( buffer.data(), bytes_read );
 }
 
 /* write method */
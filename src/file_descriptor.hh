@@ -3,6 +3,8 @@
 
 #include <string>
 
+#include <sys/uio.h>
+
 /* Unix file descriptors (sockets, files, etc.) */
 class FileDescriptor
 {
@@ -40,10 +42,23 @@ public:
   unsigned int read_count( void ) const { return read_count_; }
   unsigned int write_count( void ) const { return write_count_; }
 
+  /* put the fd in blocking or non-blocking (O_NONBLOCK) mode */
+  void set_blocking( const bool blocking );
+
   /* read and write methods */
   std::string read( const size_t limit = BUFFER_SIZE );
   std::string::const_iterator write( const std::string & buffer, const bool write_all = true );
 
+  /* read into a caller-supplied buffer (returns bytes read; zero means EOF) */
+  size_t read( char * const buffer, const size_t capacity );
+
+  /* write part of a buffer with one syscall (returns bytes written) */
+  size_t write( const char * const data, const size_t length );
+
+  /* scatter/gather versions: one syscall for several buffers */
+  size_t readv( const iovec * const iov, const int iov_count );
+  size_t writev( const iovec * const iov, const int iov_count );
+
   /* forbid copying FileDescriptor objects or assigning them */
   FileDescriptor( const FileDescriptor & other ) = delete;
   const FileDescriptor & operator=( const FileDescriptor & other ) = delete;
@@ -0,0 +1,37 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "flow_key.hh"
+
+using namespace std;
+
+/* key for an address */
+FlowKey::FlowKey( const Address & address )
+  : FlowKey()
+{
+  const sockaddr & addr = address.to_sockaddr();
+
+  switch ( addr.sa_family ) {
+  case AF_INET:
+    {
+      const sockaddr_in & v4 = reinterpret_cast<const sockaddr_in &>( addr );
+      uint32_t ip;
+      memcpy( &ip, &v4.sin_addr, sizeof( ip ) );
+      ip_high = ip;
+      port = v4.sin_port;
+      break;
+    }
+  case AF_INET6:
+    {
+      const sockaddr_in6 & v6 = reinterpret_cast<const sockaddr_in6 &>( addr );
+      memcpy( &ip_high, &v6.sin6_addr, sizeof( ip_high ) );
+      memcpy( &ip_low, reinterpret_cast<const char *>( &v6.sin6_addr ) + sizeof( ip_high ), sizeof( ip_low ) );
+      port = v6.sin6_port;
+      break;
+    }
+  default:
+    throw runtime_error( "FlowKey: address is neither IPv4 nor IPv6" );
+  }
+
+  family = addr.sa_family;
+}
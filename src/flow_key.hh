@@ -0,0 +1,165 @@
+#ifndef FLOW_KEY_HH
+#define FLOW_KEY_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "address.hh"
+
+/* Compact identity of a UDP endpoint (family, IP and port in 24 bytes),
+   for looking up per-flow state by source address on every datagram
+   without touching a sockaddr_storage, the resolver or any strings */
+struct FlowKey
+{
+  uint64_t ip_high, ip_low; /* the address bytes as they are in the sockaddr (IPv4 in ip_high) */
+  uint16_t port; /* network byte order */
+  uint16_t family; /* AF_INET or AF_INET6 (AF_UNSPEC: no flow) */
+
+  FlowKey() : ip_high( 0 ), ip_low( 0 ), port( 0 ), family( AF_UNSPEC ) {}
+
+  /* key for an address (throws if it is not IPv4 or IPv6) */
+  explicit FlowKey( const Address & address );
+
+  bool operator==( const FlowKey & other ) const
+  {
+    return ip_high == other.ip_high and ip_low == other.ip_low
+      and port == other.port and family == other.family;
+  }
+
+  bool operator!=( const FlowKey & other ) const { return not operator==( other ); }
+
+  /* 64-bit hash (well mixed in every bit, so the low bits can index a table) */
+  uint64_t hash( void ) const
+  {
+    uint64_t h = ip_high * 0x9e3779b97f4a7c15ULL;
+    h ^= (ip_low + (uint64_t( port ) << 16 | family)) * 0xc2b2ae3d27d4eb4fULL;
+
+    /* MurmurHash3's finalizer */
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+};
+
+/* Hash table from FlowKey to per-flow state, with open addressing and
+   linear probing. The keys live in one array, apart from the values, so
+   a lookup usually reads a single cache line of keys (and then the value
+   it found). The table doubles when it is three-quarters full. */
+template <typename Value>
+class FlowMap
+{
+private:
+  std::vector<FlowKey> keys_; /* family AF_UNSPEC marks an empty slot */
+  std::vector<Value> values_;
+  size_t size_;
+
+  size_t mask( void ) const { return keys_.size() - 1; }
+
+  static bool empty_slot( const FlowKey & key ) { return key.family == AF_UNSPEC; }
+
+  /* slot holding the key, or the empty slot where it would go */
+  size_t slot( const FlowKey & key ) const
+  {
+    size_t i = key.hash() & mask();
+    while ( not empty_slot( keys_[ i ] ) and keys_[ i ] != key ) {
+      i = (i + 1) & mask();
+    }
+    return i;
+  }
+
+  void grow( void )
+  {
+    std::vector<FlowKey> old_keys( keys_.size() * 2 );
+    std::vector<Value> old_values( values_.size() * 2 );
+    old_keys.swap( keys_ );
+    old_values.swap( values_ );
+
+    for ( size_t i = 0; i < old_keys.size(); i++ ) {
+      if ( not empty_slot( old_keys[ i ] ) ) {
+	const size_t j = slot( old_keys[ i ] );
+	keys_[ j ] = old_keys[ i ];
+	values_[ j ] = std::move( old_values[ i ] );
+      }
+    }
+  }
+
+public:
+  /* room for about expected_flows before the first resize */
+  explicit FlowMap( const size_t expected_flows = 16 )
+    : keys_(), values_(), size_( 0 )
+  {
+    size_t capacity = 8;
+    while ( capacity * 3 / 4 < expected_flows ) {
+      capacity *= 2;
+    }
+    keys_.resize( capacity );
+    values_.resize( capacity );
+  }
+
+  size_t size( void ) const { return size_; }
+  bool empty( void ) const { return size_ == 0; }
+
+  /* the flow's state, or nullptr if it has none */
+  Value * find( const FlowKey & key )
+  {
+    const size_t i = slot( key );
+    return empty_slot( keys_[ i ] ) ? nullptr : &values_[ i ];
+  }
+
+  /* the flow's state, default-constructed the first time the flow is seen */
+  Value & operator[]( const FlowKey & key )
+  {
+    size_t i = slot( key );
+    if ( empty_slot( keys_[ i ] ) ) {
+      if ( (size_ + 1) * 4 > keys_.size() * 3 ) {
+	grow();
+	i = slot( key );
+      }
+      keys_[ i ] = key;
+      size_++;
+    }
+    return values_[ i ];
+  }
+
+  /* call visit( key, value ) for every flow (which must not add or erase flows) */
+  template <typename Visit>
+  void for_each( const Visit & visit )
+  {
+    for ( size_t i = 0; i < keys_.size(); i++ ) {
+      if ( not empty_slot( keys_[ i ] ) ) {
+	visit( keys_[ i ], values_[ i ] );
+      }
+    }
+  }
+
+  /* forget a flow (returns false if it wasn't there) */
+  bool erase( const FlowKey & key )
+  {
+    size_t i = slot( key );
+    if ( empty_slot( keys_[ i ] ) ) {
+      return false;
+    }
+
+    /* shift later keys of the same probe run back into the hole, so
+       lookups never need tombstones */
+    for ( size_t j = (i + 1) & mask(); not empty_slot( keys_[ j ] ); j = (j + 1) & mask() ) {
+      const size_t home = keys_[ j ].hash() & mask();
+      if ( ((j - home) & mask()) >= ((j - i) & mask()) ) {
+	keys_[ i ] = keys_[ j ];
+	values_[ i ] = std::move( values_[ j ] );
+	i = j;
+      }
+    }
+
+    keys_[ i ] = FlowKey();
+    values_[ i ] = Value();
+    size_--;
+    return true;
+  }
+};
+
+#endif /* FLOW_KEY_HH */
@@ -0,0 +1,184 @@
+#ifndef LOCKFREE_RING_HH
+#define LOCKFREE_RING_HH
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+/* Bounded queues for handing items from one thread to another without
+   locks or syscalls (pair them with an EventFD to wake a thread that is
+   asleep in poll()). Capacities are powers of two. The indices each side
+   writes live on cache lines of their own, so the producer and the
+   consumer don't slow each other down by writing to the same line. */
+
+static const size_t CACHE_LINE_SIZE = 64;
+
+/* One producer thread, one consumer thread */
+template <typename T>
+class SPSCRing
+{
+private:
+  const size_t mask_;
+  std::unique_ptr<T[]> slots_;
+
+  /* the consumer's side: the next slot to pop, and the producer's tail as last seen */
+  alignas( CACHE_LINE_SIZE ) std::atomic<size_t> head_;
+  size_t tail_seen_;
+
+  /* the producer's side: the next slot to fill, and the consumer's head as last seen */
+  alignas( CACHE_LINE_SIZE ) std::atomic<size_t> tail_;
+  size_t head_seen_;
+
+  char padding_[ CACHE_LINE_SIZE - sizeof( std::atomic<size_t> ) - sizeof( size_t ) ];
+
+public:
+  SPSCRing( const size_t capacity )
+    : mask_( capacity - 1 ), slots_( new T[ capacity ] ),
+      head_( 0 ), tail_seen_( 0 ), tail_( 0 ), head_seen_( 0 ), padding_()
+  {
+    if ( capacity == 0 or (capacity & mask_) ) {
+      throw std::runtime_error( "SPSCRing: capacity must be a power of two" );
+    }
+  }
+
+  SPSCRing( const SPSCRing & other ) = delete;
+  SPSCRing & operator=( const SPSCRing & other ) = delete;
+
+  /* producer: add an item (false, leaving it alone, if the ring is full) */
+  bool try_push( T && item )
+  {
+    const size_t tail = tail_.load( std::memory_order_relaxed );
+    if ( tail - head_seen_ > mask_ ) {
+      head_seen_ = head_.load( std::memory_order_acquire );
+      if ( tail - head_seen_ > mask_ ) {
+	return false;
+      }
+    }
+
+    slots_[ tail & mask_ ] = std::move( item );
+    tail_.store( tail + 1, std::memory_order_release );
+    return true;
+  }
+
+  /* consumer: take the oldest item (false if the ring is empty) */
+  bool try_pop( T & item )
+  {
+    const size_t head = head_.load( std::memory_order_relaxed );
+    if ( head == tail_seen_ ) {
+      tail_seen_ = tail_.load( std::memory_order_acquire );
+      if ( head == tail_seen_ ) {
+	return false;
+      }
+    }
+
+    item = std::move( slots_[ head & mask_ ] );
+    head_.store( head + 1, std::memory_order_release );
+    return true;
+  }
+
+  /* consumer: is there nothing to take? */
+  bool empty( void ) const
+  {
+    return head_.load( std::memory_order_relaxed ) == tail_.load( std::memory_order_acquire );
+  }
+};
+
+/* Any number of producer threads, one consumer thread. Each slot carries
+   a sequence number saying whose turn it is (D. Vyukov's bounded queue):
+   producers claim slots by advancing the tail, and publish each item by
+   bumping its slot's sequence number, so the consumer never sees a slot
+   that is still being filled. */
+template <typename T>
+class MPSCRing
+{
+private:
+  struct Slot
+  {
+    std::atomic<size_t> sequence;
+    T item;
+
+    Slot() : sequence( 0 ), item() {}
+  };
+
+  const size_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+
+  /* where producers claim the next slot */
+  alignas( CACHE_LINE_SIZE ) std::atomic<size_t> tail_;
+
+  /* the consumer's next slot (only the consumer touches it) */
+  alignas( CACHE_LINE_SIZE ) size_t head_;
+
+  char padding_[ CACHE_LINE_SIZE - sizeof( size_t ) ];
+
+public:
+  MPSCRing( const size_t capacity )
+    : mask_( capacity - 1 ), slots_( new Slot[ capacity ] ), tail_( 0 ), head_( 0 ), padding_()
+  {
+    if ( capacity == 0 or (capacity & mask_) ) {
+      throw std::runtime_error( "MPSCRing: capacity must be a power of two" );
+    }
+
+    for ( size_t i = 0; i < capacity; i++ ) {
+      slots_[ i ].sequence.store( i, std::memory_order_relaxed );
+    }
+  }
+
+  MPSCRing( const MPSCRing & other ) = delete;
+  MPSCRing & operator=( const MPSCRing & other ) = delete;
+
+  /* any producer: add an item (false, leaving it alone, if the ring is full) */
+  bool try_push( T && item )
+  {
+    size_t tail = tail_.load( std::memory_order_relaxed );
+    while ( true ) {
+      Slot & slot = slots_[ tail & mask_ ];
+      const size_t sequence = slot.sequence.load( std::memory_order_acquire );
+
+      if ( sequence == tail ) {
+	/* the slot is free: claim it (or, if another producer got there first, try the next) */
+	if ( tail_.compare_exchange_weak( tail, tail + 1, std::memory_order_relaxed ) ) {
+	  slot.item = std::move( item );
+	  slot.sequence.store( tail + 1, std::memory_order_release );
+	  return true;
+	}
+      } else if ( sequence < tail + 1 ) {
+	return false; /* the consumer hasn't emptied it yet: full */
+      } else {
+	tail = tail_.load( std::memory_order_relaxed );
+      }
+    }
+  }
+
+  /* consumer: take the oldest item (false if the ring is empty, or the
+     oldest is still being added) */
+  bool try_pop( T & item )
+  {
+    Slot & slot = slots_[ head_ & mask_ ];
+    if ( slot.sequence.load( std::memory_order_acquire ) != head_ + 1 ) {
+      return false;
+    }
+
+    item = std::move( slot.item );
+    slot.sequence.store( head_ + mask_ + 1, std::memory_order_release );
+    head_++;
+    return true;
+  }
+
+  /* any producer: would a push fail right now? */
+  bool full( void ) const
+  {
+    const size_t tail = tail_.load( std::memory_order_relaxed );
+    return slots_[ tail & mask_ ].sequence.load( std::memory_order_acquire ) != tail;
+  }
+
+  /* consumer: is there nothing to take? */
+  bool empty( void ) const
+  {
+    return slots_[ head_ & mask_ ].sequence.load( std::memory_order_acquire ) != head_ + 1;
+  }
+};
+
+#endif /* LOCKFREE_RING_HH */
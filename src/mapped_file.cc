@@ -0,0 +1,97 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped_file.hh"
+#include "util.hh"
+
+using namespace std;
+
+static int open_file( const string & filename, const MappedFile::Mode mode )
+{
+  const int flags = mode == MappedFile::Mode::ReadOnly ? O_RDONLY : O_RDWR | O_CREAT | O_TRUNC;
+  return SystemCall( "open " + filename, open( filename.c_str(), flags | O_CLOEXEC, 0644 ) );
+}
+
+MappedFile::MappedFile( const string & filename, const Mode mode )
+  : fd_( open_file( filename, mode ) ),
+    writable_( mode != Mode::ReadOnly ),
+    data_( nullptr ),
+    size_( 0 )
+{
+  struct stat info;
+  SystemCall( "fstat " + filename, fstat( fd_.fd_num(), &info ) );
+  size_ = info.st_size;
+  map();
+}
+
+MappedFile::~MappedFile()
+{
+  try {
+    unmap();
+  } catch ( const exception & e ) {
+    print_exception( e );
+  }
+}
+
+void MappedFile::map( void )
+{
+  if ( size_ == 0 ) {
+    return; /* mmap can't map nothing */
+  }
+
+  void * const mapping = mmap( nullptr, size_, writable_ ? PROT_READ | PROT_WRITE : PROT_READ,
+			       MAP_SHARED, fd_.fd_num(), 0 );
+  if ( mapping == MAP_FAILED ) {
+    throw unix_error( "mmap" );
+  }
+  data_ = static_cast<char *>( mapping );
+}
+
+void MappedFile::unmap( void )
+{
+  if ( data_ ) {
+    SystemCall( "munmap", munmap( data_, size_ ) );
+    data_ = nullptr;
+  }
+}
+
+/* change the length of the file and the mapping */
+void MappedFile::resize( const size_t size )
+{
+  if ( not writable_ ) {
+    throw runtime_error( "MappedFile::resize: file is mapped read-only" );
+  }
+
+  SystemCall( "ftruncate", ftruncate( fd_.fd_num(), size ) );
+
+  if ( data_ and size ) {
+    void * const mapping = mremap( data_, size_, size, MREMAP_MAYMOVE );
+    if ( mapping == MAP_FAILED ) {
+      throw unix_error( "mremap" );
+    }
+    data_ = static_cast<char *>( mapping );
+    size_ = size;
+  } else {
+    unmap();
+    size_ = size;
+    map();
+  }
+}
+
+/* the file will be read front to back */
+void MappedFile::advise_sequential( void )
+{
+  if ( data_ ) {
+    SystemCall( "madvise", madvise( data_, size_, MADV_SEQUENTIAL ) );
+  }
+}
+
+/* write dirty pages back now */
+void MappedFile::sync( void )
+{
+  if ( data_ ) {
+    SystemCall( "msync", msync( data_, size_, MS_SYNC ) );
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef MAPPED_FILE_HH
+#define MAPPED_FILE_HH
+
+#include <cstddef>
+#include <string>
+
+#include "file_descriptor.hh"
+
+/* A file mapped into memory. Read-only mappings cover the whole file;
+   writable ones can be grown (and the file with them) with resize(), and
+   what is written through data() reaches the file without any write
+   calls. The mapping moves when it is resized, so don't keep pointers
+   into it across a resize(). */
+class MappedFile
+{
+private:
+  FileDescriptor fd_;
+  bool writable_;
+  char * data_; /* nullptr while the mapping is empty */
+  size_t size_;
+
+  void map( void );
+  void unmap( void );
+
+public:
+  enum class Mode { ReadOnly, Create /* read-write, truncating any existing file */ };
+
+  MappedFile( const std::string & filename, const Mode mode );
+  ~MappedFile();
+
+  /* the mapping is owned: no copies */
+  MappedFile( const MappedFile & other ) = delete;
+  MappedFile & operator=( const MappedFile & other ) = delete;
+
+  char * data( void ) { return data_; }
+  const char * data( void ) const { return data_; }
+  size_t size( void ) const { return size_; }
+
+  /* change the length of the file and the mapping (writable files only) */
+  void resize( const size_t size );
+
+  /* tell the kernel the file will be read front to back (more readahead) */
+  void advise_sequential( void );
+
+  /* write dirty pages back to the file now */
+  void sync( void );
+};
+
+#endif /* MAPPED_FILE_HH */
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <numeric>
 
 #include "poller.hh"
@@ -10,10 +11,59 @@ using namespace PollerShortNames;
 
 void Poller::add_action( Poller::Action action )
 {
+  /* don't disturb actions_ while one of its callbacks is running */
+  if ( dispatching_ ) {
+    pending_actions_.push_back( action );
+    return;
+  }
+
   actions_.push_back( action );
   pollfds_.push_back( { action.fd.fd_num(), 0, 0 } );
 }
 
+/* cancel every action on an fd */
+void Poller::cancel_actions( const FileDescriptor & fd )
+{
+  for ( auto & action : actions_ ) {
+    if ( &action.fd == &fd ) {
+      action.active = false;
+    }
+  }
+
+  for ( auto & action : pending_actions_ ) {
+    if ( &action.fd == &fd ) {
+      action.active = false;
+    }
+  }
+}
+
+/* fold in pending actions and drop cancelled ones */
+void Poller::update_actions( void )
+{
+  for ( auto & action : pending_actions_ ) {
+    add_action( move( action ) );
+  }
+  pending_actions_.clear();
+
+  /* Action holds a reference, so rebuild rather than erase in place */
+  if ( none_of( actions_.begin(), actions_.end(),
+		[] ( const Action & x ) { return not x.active; } ) ) {
+    return;
+  }
+
+  vector< Action > kept_actions;
+  vector< pollfd > kept_pollfds;
+  for ( unsigned int i = 0; i < actions_.size(); i++ ) {
+    if ( actions_[ i ].active ) {
+      kept_actions.push_back( move( actions_[ i ] ) );
+      kept_pollfds.push_back( pollfds_[ i ] );
+    }
+  }
+
+  actions_.swap( kept_actions );
+  pollfds_.swap( kept_pollfds );
+}
+
 unsigned int Poller::Action::service_count( void ) const
 {
   return direction == Direction::In ? fd.read_count() : fd.write_count();
@@ -21,6 +71,7 @@ unsigned int Poller::Action::service_count( void ) const
 
 Poller::Result Poller::poll( const int & timeout_ms )
 {
+  update_actions();
   assert( pollfds_.size() == actions_.size() );
 
   /* tell poll whether we care about each fd */
@@ -42,35 +93,106 @@ Poller::Result Poller::poll( const int & timeout_ms )
     return Result::Type::Exit;
   }
 
-  if ( 0 == SystemCall( "poll", ::poll( &pollfds_[ 0 ], pollfds_.size(), timeout_ms ) ) ) {
-    return Result::Type::Timeout;
+  int ready = 0;
+  int remaining_ms = timeout_ms;
+
+  if ( spin_budget_us_ > 0 and timeout_ms != 0 ) {
+    const uint64_t spun_before = spin_stats_.spin_ns;
+    ready = spin();
+    if ( timeout_ms > 0 ) {
+      remaining_ms = max( 0, timeout_ms - int( (spin_stats_.spin_ns - spun_before) / 1000000 ) );
+    }
   }
 
+  if ( ready == 0 ) {
+    if ( spin_budget_us_ > 0 and timeout_ms != 0 ) {
+      spin_stats_.blocking_polls++;
+    }
+
+    if ( 0 == SystemCall( "poll", ::poll( &pollfds_[ 0 ], pollfds_.size(), remaining_ms ) ) ) {
+      return Result::Type::Timeout;
+    }
+  }
+
+  dispatching_ = true;
+  try {
+    const Result ret = dispatch();
+    dispatching_ = false;
+    return ret;
+  } catch ( ... ) {
+    dispatching_ = false;
+    throw;
+  }
+}
+
+/* run the callbacks for whatever poll() found */
+Poller::Result Poller::dispatch( void )
+{
+  bool called_back = false;
+
   for ( unsigned int i = 0; i < pollfds_.size(); i++ ) {
-    if ( pollfds_[ i ].revents & (POLLERR | POLLHUP | POLLNVAL) ) {
-      return Result::Type::Exit;
+    /* an earlier callback may have cancelled this action */
+    if ( not actions_.at( i ).active ) {
+      continue;
     }
 
-    if ( pollfds_[ i ].revents & pollfds_[ i ].events ) {
+    Action::Result result;
+
+    if ( pollfds_[ i ].revents & (POLLERR | POLLHUP | POLLNVAL) ) {
+      if ( not actions_.at( i ).fderror_callback ) {
+	return Result::Type::Exit;
+      }
+
+      result = actions_.at( i ).fderror_callback();
+    } else if ( pollfds_[ i ].revents & pollfds_[ i ].events ) {
       /* we only want to call callback if revents includes
-	 the event we asked for */
+	 the event we asked for (and if an earlier callback
+	 hasn't since taken away the reason to) */
+      if ( called_back and not actions_.at( i ).when_interested() ) {
+	continue;
+      }
+      called_back = true;
+
       const auto count_before = actions_.at( i ).service_count();
-      auto result = actions_.at( i ).callback();
+      result = actions_.at( i ).callback();
 
       if ( count_before == actions_.at( i ).service_count() ) {
 	throw runtime_error( "Poller: busy wait detected: callback did not read/write fd" );
       }
+    } else {
+      continue;
+    }
 
-      switch ( result.result ) {
-      case ResultType::Exit:
-	return Result( Result::Type::Exit, result.exit_status );
-      case ResultType::Cancel:
-	actions_.at( i ).active = false;
-      case ResultType::Continue:
-	break;
-      }
+    switch ( result.result ) {
+    case ResultType::Exit:
+      return Result( Result::Type::Exit, result.exit_status );
+    case ResultType::Cancel:
+      actions_.at( i ).active = false;
+    case ResultType::Continue:
+      break;
     }
   }
 
   return Result::Type::Success;
 }
+
+/* poll without blocking until something is ready or the budget runs out */
+int Poller::spin( void )
+{
+  const auto start = chrono::steady_clock::now();
+  const auto deadline = start + chrono::microseconds( spin_budget_us_ );
+
+  int ready = 0;
+  auto now = start;
+  do {
+    ready = SystemCall( "poll", ::poll( &pollfds_[ 0 ], pollfds_.size(), 0 ) );
+    now = chrono::steady_clock::now();
+  } while ( ready == 0 and now < deadline );
+
+  spin_stats_.spin_ns += chrono::duration_cast<chrono::nanoseconds>( now - start ).count();
+  if ( ready > 0 ) {
+    spin_stats_.events_while_spinning++;
+  }
+
+  return ready;
+}
@@ -1,6 +1,7 @@
 #ifndef POLLER_HH
 #define POLLER_HH
 
+#include <cstdint>
 #include <functional>
 #include <vector>
 
@@ -29,20 +30,48 @@ public:
     std::function<bool(void)> when_interested;
     bool active;
 
+    /* called on POLLERR/POLLHUP/POLLNVAL (if empty, the poller exits instead) */
+    CallbackType fderror_callback;
+
     Action( FileDescriptor & s_fd,
 	    const PollDirection & s_direction,
 	    const CallbackType & s_callback,
-	    const std::function<bool(void)> & s_when_interested = [] () { return true; } )
+	    const std::function<bool(void)> & s_when_interested = [] () { return true; },
+	    const CallbackType & s_fderror_callback = CallbackType() )
       : fd( s_fd ), direction( s_direction ), callback( s_callback ),
-	when_interested( s_when_interested ), active( true ) {}
+	when_interested( s_when_interested ), active( true ),
+	fderror_callback( s_fderror_callback ) {}
 
     unsigned int service_count( void ) const;
   };
 
+  /* accounting for the optional spin phase before a blocking poll */
+  struct SpinStats
+  {
+    uint64_t spin_ns;               /* time spent polling without blocking */
+    uint64_t events_while_spinning; /* polls satisfied without going to sleep */
+    uint64_t blocking_polls;        /* polls that exhausted the budget and blocked */
+
+    SpinStats() : spin_ns( 0 ), events_while_spinning( 0 ), blocking_polls( 0 ) {}
+  };
+
 private:
   std::vector< Action > actions_;
   std::vector< pollfd > pollfds_;
 
+  /* actions added from inside a callback wait here until the next poll() */
+  std::vector< Action > pending_actions_;
+  bool dispatching_;
+
+  /* fold in pending actions and drop cancelled ones */
+  void update_actions( void );
+
+  unsigned int spin_budget_us_;
+  SpinStats spin_stats_;
+
+  /* poll without blocking until something is ready or the budget runs out */
+  int spin( void );
+
 public:
   struct Result
   {
@@ -52,9 +81,23 @@ public:
       : result( s_result ), exit_status( s_status ) {}
   };
 
-  Poller() : actions_(), pollfds_() {}
+private:
+  /* run the callbacks for whatever poll() found */
+  Result dispatch( void );
+
+public:
+  Poller() : actions_(), pollfds_(), pending_actions_(), dispatching_( false ),
+	     spin_budget_us_( 0 ), spin_stats_() {}
   void add_action( Action action );
   Result poll( const int & timeout_ms );
+
+  /* cancel every action on an fd (so the fd can be closed after this poll) */
+  void cancel_actions( const FileDescriptor & fd );
+
+  /* before blocking, keep polling for up to this many microseconds
+     (trades a busy CPU for not paying the scheduler's wakeup latency) */
+  void set_spin_budget( const unsigned int spin_budget_us ) { spin_budget_us_ = spin_budget_us; }
+  const SpinStats & spin_stats( void ) const { return spin_stats_; }
 };
 
 namespace PollerShortNames {
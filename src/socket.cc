@@ -1,4 +1,9 @@
+#include <cstring>
+
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
 
 #include "socket.hh"
 #include "util.hh"
@@ -6,6 +11,11 @@
 
 using namespace std;
 
+/* from Linux 5.11's asm-generic/socket.h, for older headers */
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
 /* default constructor for socket of (subclassed) domain and type */
 Socket::Socket( const int domain, const int type )
   : FileDescriptor( SystemCall( "socket", socket( domain, type, 0 ) ) )
@@ -21,7 +31,7 @@ Socket::Socket( FileDescriptor && fd, const int domain, const int type )
   /* verify domain */
   len = sizeof( actual_value );
   SystemCall( "getsockopt",
-	      getsockopt( fd_num(), SOL_SOCKET, SO_DOMAIN, &actual_value, &len ) );
+	      ::getsockopt( fd_num(), SOL_SOCKET, SO_DOMAIN, &actual_value, &len ) );
   if ( (len != sizeof( actual_value )) or (actual_value != domain) ) {
     throw runtime_error( "socket domain mismatch" );
   }
@@ -29,7 +39,7 @@ Socket::Socket( FileDescriptor && fd, const int domain, const int type )
   /* verify type */
   len = sizeof( actual_value );
   SystemCall( "getsockopt",
-	      getsockopt( fd_num(), SOL_SOCKET, SO_TYPE, &actual_value, &len ) );
+	      ::getsockopt( fd_num(), SOL_SOCKET, SO_TYPE, &actual_value, &len ) );
   if ( (len != sizeof( actual_value )) or (actual_value != type) ) {
     throw runtime_error( "socket type mismatch" );
   }
@@ -76,7 +86,7 @@ void Socket::connect( const Address & address )
 }
 
 /* receive datagram and where it came from */
-UDPSocket::received_datagram UDPSocket::recv( void )
+bool UDPSocket::receive( received_datagram & datagram, const bool nonblocking )
 {
   static const ssize_t RECEIVE_MTU = 65536;
 
@@ -103,11 +113,16 @@ UDPSocket::received_datagram UDPSocket::recv( void )
   header.msg_controllen = sizeof( msg_control );
 
   /* call recvmsg */
-  ssize_t recv_len = SystemCall( "recvmsg",
-				 recvmsg( fd_num(), &header, 0 ) );
+  const ssize_t recv_len = nonblocking
+    ? NonBlockingSystemCall( "recvmsg", recvmsg( fd_num(), &header, MSG_DONTWAIT ) )
+    : SystemCall( "recvmsg", recvmsg( fd_num(), &header, 0 ) );
 
   register_read();
 
+  if ( recv_len < 0 ) {
+    return false; /* nothing waiting */
+  }
+
   /* make sure we got the whole datagram */
   if ( header.msg_flags & MSG_TRUNC ) {
     throw runtime_error( "recvfrom (oversized datagram)" );
@@ -115,7 +130,8 @@ UDPSocket::received_datagram UDPSocket::recv( void )
     throw runtime_error( "recvfrom (unhandled flag)" );
   }
 
-  uint64_t timestamp = -1;
+  uint64_t timestamp = -1, timestamp_us = -1;
+  uint8_t tos = 0;
 
   /* find the timestamp header (if there is one) */
   cmsghdr *ts_hdr = CMSG_FIRSTHDR( &header );
@@ -124,50 +140,93 @@ UDPSocket::received_datagram UDPSocket::recv( void )
 	 and ts_hdr->cmsg_type == SO_TIMESTAMPNS ) {
       const timespec * const kernel_time = reinterpret_cast<timespec *>( CMSG_DATA( ts_hdr ) );
       timestamp = timestamp_ms( *kernel_time );
+      timestamp_us = ::timestamp_us( *kernel_time );
+    } else if ( ts_hdr->cmsg_level == SOL_SOCKET
+		and ts_hdr->cmsg_type == SO_RXQ_OVFL ) {
+      memcpy( &receive_queue_drops_, CMSG_DATA( ts_hdr ), sizeof( receive_queue_drops_ ) );
+    } else if ( ts_hdr->cmsg_level == IPPROTO_IP
+		and ts_hdr->cmsg_type == IP_TOS ) {
+      tos = *CMSG_DATA( ts_hdr ); /* IPv4 (mapped) peers: one byte */
+    } else if ( ts_hdr->cmsg_level == IPPROTO_IPV6
+		and ts_hdr->cmsg_type == IPV6_TCLASS ) {
+      int tclass;
+      memcpy( &tclass, CMSG_DATA( ts_hdr ), sizeof( tclass ) );
+      tos = tclass;
     }
     ts_hdr = CMSG_NXTHDR( &header, ts_hdr );
   }
 
-  received_datagram ret = { Address( datagram_source_address,
-				     header.msg_namelen ),
-			    timestamp,
-			    string( msg_payload, recv_len ) };
+  datagram.source_address = Address( datagram_source_address, header.msg_namelen );
+  datagram.timestamp = timestamp;
+  datagram.timestamp_us = timestamp_us;
+  datagram.tos = tos;
+  datagram.payload.assign( msg_payload, recv_len );
+
+  return true;
+}
 
+/* receive datagram, timestamp, and where it came from */
+UDPSocket::received_datagram UDPSocket::recv( void )
+{
+  received_datagram ret = { Address(), 0, string(), 0, 0 };
+  receive( ret, false );
   return ret;
 }
 
-/* send datagram to specified address */
-void UDPSocket::sendto( const Address & destination, const string & payload )
+/* receive a datagram if one is waiting */
+bool UDPSocket::try_recv( received_datagram & datagram )
 {
-  const ssize_t bytes_sent =
-    SystemCall( "sendto", ::sendto( fd_num(),
-				    payload.data(),
-				    payload.size(),
-				    0,
-				    &destination.to_sockaddr(),
-				    destination.size() ) );
+  return receive( datagram, true );
+}
+
+/* send datagram to a specified address (or, if null, to the connected address) */
+bool UDPSocket::transmit( const Address * const destination, const string & payload,
+			  const bool nonblocking )
+{
+  const ssize_t ret = destination
+    ? ::sendto( fd_num(), payload.data(), payload.size(), nonblocking ? MSG_DONTWAIT : 0,
+		&destination->to_sockaddr(), destination->size() )
+    : ::send( fd_num(), payload.data(), payload.size(), nonblocking ? MSG_DONTWAIT : 0 );
+
+  const char * const attempt = destination ? "sendto" : "send";
+  const ssize_t bytes_sent = nonblocking ? NonBlockingSystemCall( attempt, ret )
+					 : SystemCall( attempt, ret );
 
   register_write();
 
+  if ( bytes_sent < 0 ) {
+    return false; /* socket buffer full */
+  }
+
   if ( size_t( bytes_sent ) != payload.size() ) {
-    throw runtime_error( "datagram payload too big for sendto()" );
+    throw runtime_error( string( "datagram payload too big for " ) + attempt + "()" );
   }
+
+  return true;
+}
+
+/* send datagram to specified address */
+void UDPSocket::sendto( const Address & destination, const string & payload )
+{
+  transmit( &destination, payload, false );
 }
 
 /* send datagram to connected address */
 void UDPSocket::send( const string & payload )
 {
-  const ssize_t bytes_sent =
-    SystemCall( "send", ::send( fd_num(),
-				payload.data(),
-				payload.size(),
-				0 ) );
+  transmit( nullptr, payload, false );
+}
 
-  register_write();
+/* send datagram to specified address, unless the socket buffer is full */
+bool UDPSocket::try_sendto( const Address & destination, const string & payload )
+{
+  return transmit( &destination, payload, true );
+}
 
-  if ( size_t( bytes_sent ) != payload.size() ) {
-    throw runtime_error( "datagram payload too big for send()" );
-  }
+/* send datagram to connected address, unless the socket buffer is full */
+bool UDPSocket::try_send( const string & payload )
+{
+  return transmit( nullptr, payload, true );
 }
 
 /* mark the socket as listening for incoming connections */
@@ -191,14 +250,177 @@ void Socket::setsockopt( const int level, const int option, const option_type &
 					  &option_value, sizeof( option_value ) ) );
 }
 
+/* get socket option */
+template <typename option_type>
+option_type Socket::getsockopt( const int level, const int option ) const
+{
+  option_type option_value;
+  socklen_t option_len = sizeof( option_value );
+  SystemCall( "getsockopt", ::getsockopt( fd_num(), level, option,
+					  &option_value, &option_len ) );
+  if ( option_len != sizeof( option_value ) ) {
+    throw runtime_error( "unexpected length from getsockopt" );
+  }
+  return option_value;
+}
+
 /* allow local address to be reused sooner, at the cost of some robustness */
 void Socket::set_reuseaddr( void )
 {
   setsockopt( SOL_SOCKET, SO_REUSEADDR, int( true ) );
 }
 
+/* have the kernel busy-poll the device queue on blocking receives */
+void Socket::set_busy_poll( const unsigned int usecs )
+{
+  setsockopt( SOL_SOCKET, SO_BUSY_POLL, int( usecs ) );
+
+  /* prefer busy polling over interrupt-driven processing where supported (Linux 5.11+) */
+  try {
+    setsockopt( SOL_SOCKET, SO_PREFER_BUSY_POLL, int( true ) );
+  } catch ( const unix_error & e ) {
+    if ( e.code().value() != ENOPROTOOPT ) {
+      throw;
+    }
+  }
+}
+
+/* size of the kernel's send buffer */
+void Socket::set_send_buffer( const int bytes, const bool force )
+{
+  setsockopt( SOL_SOCKET, force ? SO_SNDBUFFORCE : SO_SNDBUF, bytes );
+}
+
+/* size of the kernel's receive buffer */
+void Socket::set_receive_buffer( const int bytes, const bool force )
+{
+  setsockopt( SOL_SOCKET, force ? SO_RCVBUFFORCE : SO_RCVBUF, bytes );
+}
+
+int Socket::send_buffer( void ) const
+{
+  return getsockopt<int>( SOL_SOCKET, SO_SNDBUF );
+}
+
+int Socket::receive_buffer( void ) const
+{
+  return getsockopt<int>( SOL_SOCKET, SO_RCVBUF );
+}
+
+/* priority of outgoing packets in the local qdisc */
+void Socket::set_priority( const int priority )
+{
+  setsockopt( SOL_SOCKET, SO_PRIORITY, priority );
+}
+
+/* send and receive only through the named network interface */
+void Socket::bind_to_device( const string & interface )
+{
+  SystemCall( "setsockopt SO_BINDTODEVICE " + interface,
+	      ::setsockopt( fd_num(), SOL_SOCKET, SO_BINDTODEVICE,
+			    interface.data(), interface.size() ) );
+}
+
+/* cap the rate at which the kernel sends */
+void Socket::set_max_pacing_rate( const uint64_t bytes_per_second )
+{
+  setsockopt( SOL_SOCKET, SO_MAX_PACING_RATE, bytes_per_second );
+}
+
+/* set the traffic class / type of service byte */
+void Socket::set_tos( const uint8_t tos )
+{
+  /* the socket is IPv6, but IPv4 (mapped) peers use the IPv4 setting */
+  setsockopt( IPPROTO_IPV6, IPV6_TCLASS, int( tos ) );
+  setsockopt( IPPROTO_IP, IP_TOS, int( tos ) );
+}
+
+/* throw the socket's pending error, if any */
+void Socket::throw_pending_error( void )
+{
+  const int error = getsockopt<int>( SOL_SOCKET, SO_ERROR );
+  if ( error ) {
+    errno = error;
+    throw unix_error( "socket error" );
+  }
+}
+
 /* turn on timestamps on receipt */
 void UDPSocket::set_timestamps( void )
 {
   setsockopt( SOL_SOCKET, SO_TIMESTAMPNS, int( true ) );
 }
+
+/* report the TOS / traffic class byte of each datagram */
+void UDPSocket::set_receive_tos( void )
+{
+  setsockopt( IPPROTO_IPV6, IPV6_RECVTCLASS, int( true ) );
+  setsockopt( IPPROTO_IP, IP_RECVTOS, int( true ) );
+}
+
+/* have the kernel report when each datagram is sent */
+void UDPSocket::set_tx_timestamps( const bool enable, const bool hardware )
+{
+  int flags = 0;
+  if ( enable ) {
+    /* OPT_ID numbers the stamps; OPT_TSONLY leaves the datagram itself off the error queue */
+    flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE
+      | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    if ( hardware ) {
+      flags |= SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+    }
+  }
+
+  setsockopt( SOL_SOCKET, SO_TIMESTAMPING, flags );
+}
+
+/* read one transmit timestamp from the error queue */
+bool UDPSocket::try_recv_tx_timestamp( tx_timestamp & stamp )
+{
+  msghdr header; zero( header );
+  char msg_control[ 512 ];
+  header.msg_control = msg_control;
+  header.msg_controllen = sizeof( msg_control );
+
+  while ( true ) {
+    header.msg_controllen = sizeof( msg_control );
+
+    if ( NonBlockingSystemCall( "recvmsg", recvmsg( fd_num(), &header, MSG_ERRQUEUE | MSG_DONTWAIT ) ) < 0 ) {
+      return false; /* error queue is empty */
+    }
+
+    const scm_timestamping * times = nullptr;
+    const sock_extended_err * error = nullptr;
+
+    for ( cmsghdr * cmsg = CMSG_FIRSTHDR( &header ); cmsg; cmsg = CMSG_NXTHDR( &header, cmsg ) ) {
+      if ( cmsg->cmsg_level == SOL_SOCKET and cmsg->cmsg_type == SCM_TIMESTAMPING ) {
+	times = reinterpret_cast<const scm_timestamping *>( CMSG_DATA( cmsg ) );
+      } else if ( (cmsg->cmsg_level == IPPROTO_IP and cmsg->cmsg_type == IP_RECVERR)
+		  or (cmsg->cmsg_level == IPPROTO_IPV6 and cmsg->cmsg_type == IPV6_RECVERR) ) {
+	error = reinterpret_cast<const sock_extended_err *>( CMSG_DATA( cmsg ) );
+      }
+    }
+
+    /* skip anything that isn't a send timestamp */
+    if ( not times or not error
+	 or error->ee_origin != SO_EE_ORIGIN_TIMESTAMPING
+	 or error->ee_info != SCM_TSTAMP_SND ) {
+      continue;
+    }
+
+    /* ts[ 0 ] is the software stamp, ts[ 2 ] the raw hardware stamp */
+    const bool hardware = times->ts[ 2 ].tv_sec or times->ts[ 2 ].tv_nsec;
+    const timespec & when = times->ts[ hardware ? 2 : 0 ];
+
+    stamp.id = error->ee_data;
+    stamp.timestamp = timestamp_ms( when );
+    stamp.hardware = hardware;
+    return true;
+  }
+}
+
+/* report receive-buffer drops with each datagram */
+void UDPSocket::set_receive_queue_drops( void )
+{
+  setsockopt( SOL_SOCKET, SO_RXQ_OVFL, int( true ) );
+}
@@ -25,6 +25,10 @@ protected:
   template <typename option_type>
   void setsockopt( const int level, const int option, const option_type & option_value );
 
+  /* get socket option */
+  template <typename option_type>
+  option_type getsockopt( const int level, const int option ) const;
+
 public:
   /* bind socket to a specified local address (usually to listen/accept) */
   void bind( const Address & address );
@@ -38,20 +42,68 @@ public:
 
   /* allow local address to be reused sooner, at the cost of some robustness */
   void set_reuseaddr( void );
+
+  /* have the kernel busy-poll the device queue for up to usecs on blocking receives
+     (raising it above net.core.busy_read needs CAP_NET_ADMIN) */
+  void set_busy_poll( const unsigned int usecs );
+
+  /* size of the kernel's send and receive buffers, in bytes (the kernel doubles
+     the request to allow for bookkeeping, and the getters report what it chose);
+     force goes past net.core.wmem_max/rmem_max and needs CAP_NET_ADMIN */
+  void set_send_buffer( const int bytes, const bool force = false );
+  void set_receive_buffer( const int bytes, const bool force = false );
+  int send_buffer( void ) const;
+  int receive_buffer( void ) const;
+
+  /* priority of outgoing packets in the local qdisc (above 6 needs CAP_NET_ADMIN) */
+  void set_priority( const int priority );
+
+  /* send and receive only through the named interface, whatever the routing table says
+     (needs CAP_NET_RAW before Linux 5.7) */
+  void bind_to_device( const std::string & interface );
+
+  /* cap the rate (in bytes per second) at which the kernel sends, so the fq qdisc paces for us */
+  void set_max_pacing_rate( const uint64_t bytes_per_second );
+
+  /* set the traffic class (IPv6) and type of service (IPv4) byte: DSCP and ECN bits */
+  void set_tos( const uint8_t tos );
+
+  /* throw the socket's pending error (SO_ERROR, e.g. from an ICMP message), if any */
+  void throw_pending_error( void );
+
+  /* ECN codepoints (the low two bits of the TOS byte) */
+  static const uint8_t ECN_MASK = 0x03;
+  static const uint8_t ECN_ECT0 = 0x02; /* ECN-capable transport */
+  static const uint8_t ECN_CE = 0x03; /* congestion experienced */
 };
 
 /* UDP socket */
 class UDPSocket : public Socket
 {
+private:
+  /* datagrams dropped because the receive buffer was full, as of the last recv */
+  uint32_t receive_queue_drops_;
+
 public:
-  UDPSocket() : Socket( AF_INET6, SOCK_DGRAM ) {}
+  UDPSocket() : Socket( AF_INET6, SOCK_DGRAM ), receive_queue_drops_( 0 ) {}
 
   struct received_datagram {
     Address source_address;
     uint64_t timestamp;
     std::string payload;
+    uint8_t tos; /* TOS / traffic class byte (zero unless set_receive_tos() was called) */
+    uint64_t timestamp_us; /* the timestamp in microseconds, as timestamp_us() */
   };
 
+private:
+  /* shared by recv() and try_recv(); false if recvmsg would block */
+  bool receive( received_datagram & datagram, const bool nonblocking );
+
+  /* shared by the send variants; false if the socket buffer is full */
+  bool transmit( const Address * const destination, const std::string & payload,
+		 const bool nonblocking );
+
+public:
   /* receive datagram, timestamp, and where it came from */
   received_datagram recv( void );
 
@@ -61,8 +113,39 @@ public:
   /* send datagram to connected address */
   void send( const std::string & payload );
 
+  /* non-throwing versions for backpressure: return false (instead of blocking
+     or throwing) if nothing is waiting or the socket buffer is full */
+  bool try_recv( received_datagram & datagram );
+  bool try_sendto( const Address & peer, const std::string & payload );
+  bool try_send( const std::string & payload );
+
   /* turn on timestamps on receipt */
   void set_timestamps( void );
+
+  /* report the TOS / traffic class byte (and so the ECN bits) of each received datagram */
+  void set_receive_tos( void );
+
+  /* have each received datagram report how many were dropped for lack of buffer space */
+  void set_receive_queue_drops( void );
+
+  /* datagrams dropped because the receive buffer was full (as of the last receipt) */
+  uint32_t receive_queue_drops( void ) const { return receive_queue_drops_; }
+
+  /* when a sent datagram left the host, as read back from the error queue */
+  struct tx_timestamp {
+    uint32_t id; /* counts datagrams sent since set_tx_timestamps( true ), from zero */
+    uint64_t timestamp; /* as timestamp_ms() */
+    bool hardware; /* stamped by the NIC (its clock must be synchronized to the host's) */
+  };
+
+  /* have the kernel stamp each datagram as it goes to the device (and, if hardware
+     is true and the NIC is set up for it, as the NIC sends it); the stamps arrive
+     on the error queue, which makes poll() report POLLERR.
+     Turning this off and on again restarts the ids from zero. */
+  void set_tx_timestamps( const bool enable, const bool hardware = false );
+
+  /* read one transmit timestamp from the error queue; false if there are none */
+  bool try_recv_tx_timestamp( tx_timestamp & stamp );
 };
 
 /* TCP socket */
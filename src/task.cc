@@ -0,0 +1,53 @@
+#include <new>
+
+#include "task.hh"
+
+using namespace std;
+
+/* frames are pooled in size classes of this many bytes */
+static const size_t FRAME_GRANULE = 64;
+static const size_t FRAME_CLASSES = 64; /* so up to 4 KiB */
+
+namespace {
+  struct FreeFrame
+  {
+    FreeFrame * next;
+  };
+
+  /* the free lists of this thread (frames are never handed back to the heap) */
+  thread_local FreeFrame * free_frames[ FRAME_CLASSES ] = {};
+}
+
+static size_t size_class( const size_t size )
+{
+  return (size + FRAME_GRANULE - 1) / FRAME_GRANULE - 1;
+}
+
+void * FramePool::allocate( const size_t size )
+{
+  const size_t c = size_class( size );
+  if ( c >= FRAME_CLASSES ) {
+    return ::operator new( size );
+  }
+
+  FreeFrame * const frame = free_frames[ c ];
+  if ( frame ) {
+    free_frames[ c ] = frame->next;
+    return frame;
+  }
+
+  return ::operator new( (c + 1) * FRAME_GRANULE );
+}
+
+void FramePool::deallocate( void * const frame, const size_t size )
+{
+  const size_t c = size_class( size );
+  if ( c >= FRAME_CLASSES ) {
+    ::operator delete( frame );
+    return;
+  }
+
+  FreeFrame * const free_frame = static_cast<FreeFrame *>( frame );
+  free_frame->next = free_frames[ c ];
+  free_frames[ c ] = free_frame;
+}
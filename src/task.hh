@@ -0,0 +1,157 @@
+#ifndef TASK_HH
+#define TASK_HH
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <optional>
+#include <utility>
+
+/* Recycles coroutine frames: freed frames go on a per-thread free list for
+   their size class (multiples of 64 bytes, up to 4 KiB) instead of back to
+   the heap, so a coroutine started per datagram costs no malloc() once the
+   pool is warm. Larger frames use the heap. */
+class FramePool
+{
+public:
+  static void * allocate( const size_t size );
+  static void deallocate( void * const frame, const size_t size );
+};
+
+template <typename T> class Task;
+
+namespace task_detail {
+  /* what every Task's promise has in common */
+  struct PromiseBase
+  {
+    std::coroutine_handle<> continuation {}; /* coroutine awaiting this one (if any) */
+    std::exception_ptr exception {};
+
+    static void * operator new( const size_t size ) { return FramePool::allocate( size ); }
+    static void operator delete( void * const frame, const size_t size ) { FramePool::deallocate( frame, size ); }
+
+    /* tasks start when first awaited (or spawned on an EventLoop) */
+    std::suspend_always initial_suspend( void ) noexcept { return {}; }
+
+    /* when done, resume whoever is awaiting (without growing the stack) */
+    struct FinalAwaiter
+    {
+      bool await_ready( void ) noexcept { return false; }
+
+      template <typename Promise>
+      std::coroutine_handle<> await_suspend( std::coroutine_handle<Promise> finished ) noexcept
+      {
+	const auto continuation = finished.promise().continuation;
+	return continuation ? continuation : std::noop_coroutine();
+      }
+
+      void await_resume( void ) noexcept {}
+    };
+
+    FinalAwaiter final_suspend( void ) noexcept { return {}; }
+
+    void unhandled_exception( void ) { exception = std::current_exception(); }
+  };
+
+  template <typename T>
+  struct Promise : PromiseBase
+  {
+    std::optional<T> value {};
+
+    Task<T> get_return_object( void );
+    void return_value( T && v ) { value.emplace( std::move( v ) ); }
+    void return_value( const T & v ) { value.emplace( v ); }
+
+    T result( void )
+    {
+      if ( exception ) {
+	std::rethrow_exception( exception );
+      }
+      return std::move( *value );
+    }
+  };
+
+  template <>
+  struct Promise<void> : PromiseBase
+  {
+    Task<void> get_return_object( void );
+    void return_void( void ) {}
+
+    void result( void )
+    {
+      if ( exception ) {
+	std::rethrow_exception( exception );
+      }
+    }
+  };
+}
+
+/* A coroutine that produces a T. It does nothing until it is co_awaited
+   (or handed to EventLoop::spawn), and the Task owns its frame. */
+template <typename T = void>
+class Task
+{
+public:
+  typedef task_detail::Promise<T> promise_type;
+  typedef std::coroutine_handle<promise_type> Handle;
+
+private:
+  Handle handle_;
+
+public:
+  explicit Task( const Handle handle ) : handle_( handle ) {}
+
+  Task( Task && other ) noexcept : handle_( std::exchange( other.handle_, nullptr ) ) {}
+
+  Task & operator=( Task && other ) noexcept
+  {
+    if ( this != &other ) {
+      if ( handle_ ) {
+	handle_.destroy();
+      }
+      handle_ = std::exchange( other.handle_, nullptr );
+    }
+    return *this;
+  }
+
+  ~Task()
+  {
+    if ( handle_ ) {
+      handle_.destroy();
+    }
+  }
+
+  Handle handle( void ) const { return handle_; }
+  bool done( void ) const { return handle_.done(); }
+
+  /* the result of a finished task (rethrows what it threw) */
+  T result( void ) { return handle_.promise().result(); }
+
+  /* awaiting a task starts it, and resumes the awaiting coroutine when it finishes */
+  bool await_ready( void ) const noexcept { return false; }
+
+  std::coroutine_handle<> await_suspend( const std::coroutine_handle<> awaiting ) noexcept
+  {
+    handle_.promise().continuation = awaiting;
+    return handle_;
+  }
+
+  T await_resume( void ) { return result(); }
+
+  /* forbid copying */
+  Task( const Task & other ) = delete;
+  Task & operator=( const Task & other ) = delete;
+};
+
+template <typename T>
+Task<T> task_detail::Promise<T>::get_return_object( void )
+{
+  return Task<T>( Task<T>::Handle::from_promise( *this ) );
+}
+
+inline Task<void> task_detail::Promise<void>::get_return_object( void )
+{
+  return Task<void>( Task<void>::Handle::from_promise( *this ) );
+}
+
+#endif /* TASK_HH */
@@ -0,0 +1,272 @@
+#include <iostream>
+
+#include <sys/eventfd.h>
+
+#include "tcp_server.hh"
+#include "timestamp.hh"
+#include "util.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* how long to stop accepting when out of file descriptors */
+static const uint64_t ACCEPT_PAUSE_MS = 100;
+
+/* make an eventfd (a counter that a poller can wait on) */
+static int make_eventfd( void )
+{
+  return SystemCall( "eventfd", eventfd( 0, EFD_NONBLOCK ) );
+}
+
+/* wake whatever is polling on an eventfd */
+static void signal_eventfd( FileDescriptor & fd )
+{
+  const uint64_t one = 1;
+  fd.write( string( reinterpret_cast<const char *>( &one ), sizeof( one ) ) );
+}
+
+TCPServer::Connection::Connection( TCPSocket && socket )
+  : socket_( move( socket ) ),
+    peer_( socket_.peer_address().to_string() ),
+    incoming_(),
+    outgoing_(),
+    closing_( false )
+{}
+
+TCPServer::Worker::Worker()
+  : poller(),
+    wakeup( make_eventfd() ),
+    incoming_mutex(),
+    incoming(),
+    connections(),
+    closed(),
+    thread()
+{}
+
+TCPServer::TCPServer( const Address & listen_address,
+		      const size_t worker_count,
+		      const DataHandler & on_data )
+  : listening_socket_(),
+    on_data_( on_data ),
+    on_open_(),
+    on_close_(),
+    workers_(),
+    next_worker_( 0 ),
+    shutdown_( make_eventfd() ),
+    stopping_( false ),
+    accept_paused_until_( 0 )
+{
+  if ( worker_count == 0 ) {
+    throw runtime_error( "TCPServer needs at least one worker" );
+  }
+
+  for ( size_t i = 0; i < worker_count; i++ ) {
+    workers_.emplace_back( new Worker );
+  }
+
+  listening_socket_.set_reuseaddr();
+  listening_socket_.bind( listen_address );
+  listening_socket_.listen( 1024 );
+  listening_socket_.set_blocking( false );
+}
+
+/* hand a new connection to the next worker */
+void TCPServer::hand_off( TCPSocket && client )
+{
+  client.set_blocking( false );
+
+  Worker & worker = *workers_.at( next_worker_++ % workers_.size() );
+  {
+    unique_lock<mutex> lock( worker.incoming_mutex );
+    worker.incoming.push_back( move( client ) );
+  }
+  signal_eventfd( worker.wakeup );
+}
+
+/* accept every pending connection and deal them out to the workers */
+void TCPServer::accept_connections( void )
+{
+  while ( true ) {
+    try {
+      hand_off( listening_socket_.accept() );
+    } catch ( const unix_error & e ) {
+      const int error = e.code().value();
+      if ( error == EAGAIN or error == EWOULDBLOCK ) {
+	return; /* accepted everything that was waiting */
+      }
+
+      /* a failed accept (an aborted connection, no descriptors left, ...)
+	 shouldn't take down the server: log it and keep serving */
+      print_exception( e );
+
+      if ( error == EMFILE or error == ENFILE or error == ENOBUFS or error == ENOMEM ) {
+	/* the listener would stay readable and fail the same way, so leave
+	   the backlog queued for a while and let connections close */
+	accept_paused_until_ = timestamp_ms() + ACCEPT_PAUSE_MS;
+      }
+
+      return;
+    }
+  }
+}
+
+/* start serving a connection on this worker */
+void TCPServer::add_connection( Worker & worker, TCPSocket && socket )
+{
+  const int fd = socket.fd_num();
+  Connection & c = worker.connections.emplace( fd, move( socket ) ).first->second;
+
+  if ( on_open_ ) {
+    on_open_( c );
+  }
+
+  /* flush queued output; finish closing once it is all written */
+  auto flush = [this, &worker, fd, &c] () {
+    try {
+      c.outgoing_.flush( c.socket_ );
+      if ( c.closing_ and c.outgoing_.empty() ) {
+	close_connection( worker, fd );
+      }
+    } catch ( const exception & e ) {
+      print_exception( e );
+      close_connection( worker, fd );
+    }
+    return ResultType::Continue;
+  };
+
+  worker.poller.add_action( Action( c.socket_, Direction::In,
+    [this, &worker, fd, &c] () {
+      try {
+	c.incoming_.fill( c.socket_ );
+	if ( c.socket_.eof() ) {
+	  close_connection( worker, fd );
+	  return ResultType::Continue;
+	}
+
+	on_data_( c, c.incoming_ );
+
+	if ( c.closing_ and c.outgoing_.empty() ) {
+	  close_connection( worker, fd );
+	}
+      } catch ( const exception & e ) {
+	print_exception( e );
+	close_connection( worker, fd );
+      }
+      return ResultType::Continue;
+    },
+    /* stop reading while closing, or while the handler leaves the buffer full */
+    [&c] () { return not c.closing_ and not c.incoming_.full(); },
+    [this, &worker, fd] () {
+      close_connection( worker, fd );
+      return ResultType::Continue;
+    } ) );
+
+  worker.poller.add_action( Action( c.socket_, Direction::Out, flush,
+    [&c] () { return not c.outgoing_.empty(); },
+    [this, &worker, fd] () {
+      close_connection( worker, fd );
+      return ResultType::Continue;
+    } ) );
+}
+
+/* stop polling a connection; it is destroyed once the current poll() is done */
+void TCPServer::close_connection( Worker & worker, const int fd )
+{
+  if ( not worker.closed.insert( fd ).second ) {
+    return; /* already closing */
+  }
+
+  Connection & connection = worker.connections.at( fd );
+
+  if ( on_close_ ) {
+    on_close_( connection );
+  }
+
+  worker.poller.cancel_actions( connection.socket_ );
+}
+
+/* one worker thread: serve the connections this worker owns */
+void TCPServer::run_worker( Worker & worker )
+{
+  worker.poller.add_action( Action( worker.wakeup, Direction::In, [this, &worker] () {
+	worker.wakeup.read( sizeof( uint64_t ) );
+
+	if ( stopping_ ) {
+	  return ResultType::Exit;
+	}
+
+	vector<TCPSocket> incoming;
+	{
+	  unique_lock<mutex> lock( worker.incoming_mutex );
+	  swap( incoming, worker.incoming );
+	}
+
+	for ( auto & socket : incoming ) {
+	  add_connection( worker, move( socket ) );
+	}
+
+	return ResultType::Continue;
+      } ) );
+
+  while ( true ) {
+    const auto ret = worker.poller.poll( -1 );
+
+    for ( const int fd : worker.closed ) {
+      worker.connections.erase( fd );
+    }
+    worker.closed.clear();
+
+    if ( ret.result == PollResult::Exit ) {
+      return;
+    }
+  }
+}
+
+/* accept and serve connections until stop() is called */
+void TCPServer::run( void )
+{
+  for ( auto & worker : workers_ ) {
+    Worker & w = *worker;
+    w.thread = thread( [this, &w] () {
+	try {
+	  run_worker( w );
+	} catch ( const exception & e ) {
+	  print_exception( e );
+	  abort();
+	}
+      } );
+  }
+
+  Poller poller;
+  poller.add_action( Action( listening_socket_, Direction::In, [this] () {
+	accept_connections();
+	return ResultType::Continue;
+      },
+      [this] () { return timestamp_ms() >= accept_paused_until_; } ) );
+  poller.add_action( Action( shutdown_, Direction::In, [this] () {
+	shutdown_.read( sizeof( uint64_t ) );
+	return ResultType::Exit;
+      } ) );
+
+  while ( true ) {
+    /* (while accepting is paused, wake up when it is time to resume) */
+    const uint64_t now = timestamp_ms();
+    const int timeout_ms = now < accept_paused_until_ ? int( accept_paused_until_ - now ) : -1;
+
+    if ( poller.poll( timeout_ms ).result == PollResult::Exit ) {
+      break;
+    }
+  }
+
+  for ( auto & worker : workers_ ) {
+    signal_eventfd( worker->wakeup );
+    worker->thread.join();
+  }
+}
+
+/* ask run() to return (from any thread) */
+void TCPServer::stop( void )
+{
+  stopping_ = true;
+  signal_eventfd( shutdown_ );
+}
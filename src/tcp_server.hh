@@ -0,0 +1,114 @@
+#ifndef TCP_SERVER_HH
+#define TCP_SERVER_HH
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "address.hh"
+#include "buffered_io.hh"
+#include "poller.hh"
+#include "socket.hh"
+
+/* Event-driven TCP server: one thread accepts (without blocking) and
+   hands each connection to one of a small pool of worker threads, each
+   of which runs its own Poller over the connections it owns. Each
+   connection reads into its own ring buffer and writes from a queue. */
+class TCPServer
+{
+public:
+  /* one client connection, owned by a worker */
+  class Connection
+  {
+  private:
+    TCPSocket socket_;
+    std::string peer_;
+    ReadBuffer incoming_;
+    WriteQueue outgoing_;
+    bool closing_;
+
+    friend class TCPServer;
+
+  public:
+    Connection( TCPSocket && socket );
+
+    /* queue data to be written to the client (written with writev, without copying) */
+    void send( std::string && data ) { outgoing_.push( std::move( data ) ); }
+    void send( const std::string & data ) { outgoing_.push( data ); }
+
+    /* close the connection once everything queued has been written */
+    void close( void ) { closing_ = true; }
+
+    /* "ip:port" of the client */
+    const std::string & peer( void ) const { return peer_; }
+  };
+
+  /* called when a client has sent data; the handler consumes what it can
+     use from the buffer, and anything left stays for the next call */
+  typedef std::function<void( Connection &, ReadBuffer & )> DataHandler;
+
+  /* called when a client connects or disconnects */
+  typedef std::function<void( Connection & )> ConnectionHandler;
+
+private:
+  struct Worker
+  {
+    Poller poller;
+    FileDescriptor wakeup; /* eventfd: new connections or shutdown */
+
+    std::mutex incoming_mutex;
+    std::vector<TCPSocket> incoming;
+
+    /* keyed by file descriptor number */
+    std::unordered_map<int, Connection> connections;
+    std::unordered_set<int> closed;
+
+    std::thread thread;
+
+    Worker();
+  };
+
+  TCPSocket listening_socket_;
+  DataHandler on_data_;
+  ConnectionHandler on_open_, on_close_;
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  size_t next_worker_;
+  FileDescriptor shutdown_; /* eventfd: wakes the accepting thread */
+  std::atomic<bool> stopping_;
+  uint64_t accept_paused_until_; /* out of file descriptors: stop accepting until then */
+
+  void accept_connections( void );
+  void hand_off( TCPSocket && client );
+  void run_worker( Worker & worker );
+  void add_connection( Worker & worker, TCPSocket && socket );
+  void close_connection( Worker & worker, const int fd );
+
+public:
+  TCPServer( const Address & listen_address,
+	     const size_t worker_count,
+	     const DataHandler & on_data );
+
+  /* optional notifications */
+  void set_open_handler( const ConnectionHandler & on_open ) { on_open_ = on_open; }
+  void set_close_handler( const ConnectionHandler & on_close ) { on_close_ = on_close; }
+
+  Address local_address( void ) const { return listening_socket_.local_address(); }
+
+  /* accept and serve connections until stop() is called (from any thread) */
+  void run( void );
+  void stop( void );
+
+  /* forbid copying */
+  TCPServer( const TCPServer & other ) = delete;
+  const TCPServer & operator=( const TCPServer & other ) = delete;
+};
+
+#endif /* TCP_SERVER_HH */
@@ -0,0 +1,158 @@
+#include <stdexcept>
+
+#include "thread_pool.hh"
+
+using namespace std;
+
+/* the pool and worker the calling thread belongs to (if any) */
+static thread_local ThreadPool * current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
+ThreadPool::ThreadPool( const size_t threads )
+  : workers_(), threads_(), queued_( 0 ), unfinished_( 0 ), next_worker_( 0 ), steals_( 0 ),
+    state_lock_(), work_available_(), all_done_(), stopping_( false ), error_()
+{
+  const size_t count = threads ? threads : max( 1u, thread::hardware_concurrency() );
+
+  for ( size_t i = 0; i < count; i++ ) {
+    workers_.emplace_back( new Worker );
+  }
+
+  for ( size_t i = 0; i < count; i++ ) {
+    threads_.emplace_back( [this, i] () { work( i ); } );
+  }
+}
+
+/* finish the jobs already submitted, then stop */
+ThreadPool::~ThreadPool()
+{
+  {
+    unique_lock<mutex> lock( state_lock_ );
+    stopping_ = true;
+  }
+  work_available_.notify_all();
+
+  for ( auto & thread : threads_ ) {
+    thread.join();
+  }
+}
+
+void ThreadPool::submit( Job && job )
+{
+  const size_t index = current_pool == this
+    ? current_worker
+    : next_worker_.fetch_add( 1, memory_order_relaxed ) % workers_.size();
+
+  unfinished_++;
+  {
+    Worker & worker = *workers_[ index ];
+    unique_lock<mutex> lock( worker.lock );
+    worker.jobs.push_back( move( job ) );
+  }
+  queued_++;
+
+  /* (taking the lock means a worker about to sleep either sees the job or gets the notification) */
+  {
+    unique_lock<mutex> lock( state_lock_ );
+  }
+  work_available_.notify_one();
+}
+
+/* a job from the worker's own deque (newest first), or else one stolen from another's (oldest first) */
+bool ThreadPool::take( const size_t index, Job & job )
+{
+  if ( queued_.load() == 0 ) {
+    return false;
+  }
+
+  for ( size_t i = 0; i < workers_.size(); i++ ) {
+    Worker & worker = *workers_[ (index + i) % workers_.size() ];
+    unique_lock<mutex> lock( worker.lock );
+    if ( worker.jobs.empty() ) {
+      continue;
+    }
+
+    if ( i == 0 ) {
+      job = move( worker.jobs.back() );
+      worker.jobs.pop_back();
+    } else {
+      job = move( worker.jobs.front() );
+      worker.jobs.pop_front();
+      steals_++;
+    }
+
+    queued_--;
+    return true;
+  }
+
+  return false;
+}
+
+void ThreadPool::run( Job & job )
+{
+  try {
+    job();
+  } catch ( ... ) {
+    unique_lock<mutex> lock( state_lock_ );
+    if ( not error_ ) {
+      error_ = current_exception();
+    }
+  }
+  job = nullptr; /* (let go of what it captured before saying it's done) */
+
+  if ( --unfinished_ == 0 ) {
+    {
+      unique_lock<mutex> lock( state_lock_ );
+    }
+    all_done_.notify_all();
+  }
+}
+
+void ThreadPool::work( const size_t index )
+{
+  current_pool = this;
+  current_worker = index;
+
+  Job job;
+  while ( true ) {
+    if ( take( index, job ) ) {
+      run( job );
+      continue;
+    }
+
+    unique_lock<mutex> lock( state_lock_ );
+    work_available_.wait( lock, [&] () { return stopping_ or queued_.load() > 0; } );
+    if ( stopping_ and queued_.load() == 0 ) {
+      return;
+    }
+  }
+}
+
+/* from outside the pool: wait until every job submitted so far is done */
+void ThreadPool::wait( void )
+{
+  if ( current_pool == this ) {
+    throw runtime_error( "ThreadPool: a job can't wait for the pool it runs on" );
+  }
+
+  unique_lock<mutex> lock( state_lock_ );
+  all_done_.wait( lock, [&] () { return unfinished_.load() == 0; } );
+
+  if ( error_ ) {
+    const exception_ptr error = error_;
+    error_ = nullptr;
+    rethrow_exception( error );
+  }
+}
+
+/* run body( i ) for i in [begin, end), handing the upper halves to the pool */
+void ThreadPool::split( size_t begin, size_t end, const function<void( size_t )> & body )
+{
+  while ( end - begin > 1 ) {
+    const size_t middle = begin + (end - begin) / 2;
+    submit( [this, middle, end, &body] () { split( middle, end, body ); } );
+    end = middle;
+  }
+
+  body( begin );
+}
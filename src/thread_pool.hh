@@ -0,0 +1,103 @@
+#ifndef THREAD_POOL_HH
+#define THREAD_POOL_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/* A pool of worker threads for batch work: simulation runs, analysis of
+   many files, parameter sweeps. Each worker has a deque of jobs of its
+   own. It runs its newest job first (a job's children, whose data is still
+   in cache), and when it runs dry it steals the oldest job of another
+   worker (for a job that splits itself, the biggest piece, so stealing
+   stays rare). Jobs submitted from outside the pool are dealt out
+   round-robin. A job that throws doesn't stop the others; wait() rethrows
+   the first exception once they are done. */
+class ThreadPool
+{
+public:
+  typedef std::function<void( void )> Job;
+
+private:
+  struct Worker
+  {
+    std::mutex lock = {};
+    std::deque<Job> jobs = {};
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+
+  /* jobs waiting in the deques, and jobs not yet finished (waiting or running) */
+  std::atomic<size_t> queued_, unfinished_;
+  std::atomic<size_t> next_worker_, steals_;
+
+  /* for sleeping when there is nothing to run or steal, and for wait() */
+  std::mutex state_lock_;
+  std::condition_variable work_available_, all_done_;
+  bool stopping_;
+  std::exception_ptr error_;
+
+  void work( const size_t index );
+  bool take( const size_t index, Job & job );
+  void run( Job & job );
+
+  /* run body( i ) for i in [begin, end), handing the upper halves to the pool */
+  void split( size_t begin, size_t end, const std::function<void( size_t )> & body );
+
+public:
+  /* one worker per core by default */
+  ThreadPool( const size_t threads = 0 );
+  ~ThreadPool();
+
+  ThreadPool( const ThreadPool & other ) = delete;
+  ThreadPool & operator=( const ThreadPool & other ) = delete;
+
+  size_t size( void ) const { return threads_.size(); }
+
+  /* jobs one worker took from another's deque */
+  size_t steals( void ) const { return steals_.load(); }
+
+  /* from anywhere, including a job (which puts it on its own worker's deque) */
+  void submit( Job && job );
+
+  /* from outside the pool: wait until every job submitted so far is done */
+  void wait( void );
+
+  /* run body( i ) for every i in [begin, end) across the pool, and wait */
+  template <typename Body>
+  void parallel_for( const size_t begin, const size_t end, const Body & body )
+  {
+    const std::function<void( size_t )> call = [&] ( const size_t i ) { body( i ); };
+    if ( begin < end ) {
+      submit( [this, begin, end, &call] () { split( begin, end, call ); } );
+    }
+    wait();
+  }
+
+  /* compute map( i ) for every i in [0, count) across the pool, then fold
+     the results into initial with reduce, in order (so the answer doesn't
+     depend on which worker finished first) */
+  template <typename Result, typename Map, typename Reduce>
+  Result map_reduce( const size_t count, const Map & map, Result initial, const Reduce & reduce )
+  {
+    std::vector<std::optional<decltype( map( size_t() ) )>> results( count );
+    parallel_for( 0, count, [&] ( const size_t i ) { results[ i ].emplace( map( i ) ); } );
+
+    for ( auto & result : results ) {
+      initial = reduce( std::move( initial ), std::move( *result ) );
+    }
+    return initial;
+  }
+};
+
+#endif /* THREAD_POOL_HH */
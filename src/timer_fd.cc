@@ -0,0 +1,41 @@
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "timer_fd.hh"
+#include "util.hh"
+
+using namespace std;
+
+TimerFD::TimerFD()
+  : FileDescriptor( SystemCall( "timerfd_create",
+				timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC ) ) )
+{}
+
+/* fire once, this many microseconds from now */
+void TimerFD::arm_us( const uint64_t usecs )
+{
+  itimerspec when; zero( when );
+
+  /* an all-zero time would disarm the timer instead */
+  when.it_value.tv_sec = usecs / 1000000;
+  when.it_value.tv_nsec = usecs ? usecs % 1000000 * 1000 : 1;
+
+  SystemCall( "timerfd_settime", timerfd_settime( fd_num(), 0, &when, nullptr ) );
+}
+
+/* don't fire */
+void TimerFD::disarm( void )
+{
+  itimerspec never; zero( never );
+  SystemCall( "timerfd_settime", timerfd_settime( fd_num(), 0, &never, nullptr ) );
+}
+
+/* acknowledge the timer firing */
+uint64_t TimerFD::read_expirations( void )
+{
+  uint64_t expirations = 0;
+  const ssize_t bytes_read = NonBlockingSystemCall( "read", ::read( fd_num(), &expirations, sizeof( expirations ) ) );
+  register_read();
+
+  return bytes_read == sizeof( expirations ) ? expirations : 0; /* (zero if it hadn't fired after all) */
+}
@@ -0,0 +1,25 @@
+#ifndef TIMER_FD_HH
+#define TIMER_FD_HH
+
+#include <cstdint>
+
+#include "file_descriptor.hh"
+
+/* a one-shot timer (on the monotonic clock) that a Poller can wait on:
+   the fd becomes readable when it fires */
+class TimerFD : public FileDescriptor
+{
+public:
+  TimerFD();
+
+  /* fire once, this many microseconds from now (replacing any earlier setting) */
+  void arm_us( const uint64_t usecs );
+
+  /* don't fire */
+  void disarm( void );
+
+  /* acknowledge the timer firing (returns how many times it has, since the last call) */
+  uint64_t read_expirations( void );
+};
+
+#endif /* TIMER_FD_HH */
@@ -3,6 +3,9 @@
 #include "timestamp.hh"
 #include "util.hh"
 
+/* nanoseconds per microsecond */
+static const uint64_t THOUSAND = 1000;
+
 /* nanoseconds per millisecond */
 static const uint64_t MILLION = 1000000;
 
@@ -23,14 +26,38 @@ static uint64_t timestamp_ms_raw( const timespec & ts )
   return nanos / MILLION;
 }
 
+static uint64_t timestamp_us_raw( const timespec & ts )
+{
+  const uint64_t nanos = ts.tv_sec * BILLION + ts.tv_nsec;
+  return nanos / THOUSAND;
+}
+
 /* Current time in milliseconds since the start of the program */
 uint64_t timestamp_ms( void )
 {
   return timestamp_ms( current_time() );
 }
 
-uint64_t timestamp_ms( const timespec & ts )
+/* the start of the program, in milliseconds */
+static uint64_t epoch_ms( void )
 {
   const static uint64_t EPOCH = timestamp_ms_raw( current_time() );
-  return timestamp_ms_raw( ts ) - EPOCH;
+  return EPOCH;
+}
+
+uint64_t timestamp_ms( const timespec & ts )
+{
+  return timestamp_ms_raw( ts ) - epoch_ms();
+}
+
+/* The same in microseconds */
+uint64_t timestamp_us( void )
+{
+  return timestamp_us( current_time() );
+}
+
+/* (from the same epoch, so timestamp_us() / 1000 is timestamp_ms()) */
+uint64_t timestamp_us( const timespec & ts )
+{
+  return timestamp_us_raw( ts ) - epoch_ms() * 1000;
 }
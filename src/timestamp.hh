@@ -8,4 +8,8 @@
 uint64_t timestamp_ms( void );
 uint64_t timestamp_ms( const timespec & ts );
 
+/* The same in microseconds (for finer measurements, such as trace recording) */
+uint64_t timestamp_us( void );
+uint64_t timestamp_us( const timespec & ts );
+
 #endif /* TIMESTAMP_HH */
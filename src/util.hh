@@ -58,6 +58,23 @@ inline int SystemCall( const std::string & s_attempt, const int return_value )
   return SystemCall( s_attempt.c_str(), return_value );
 }
 
+/* version of SystemCall for non-blocking I/O: "try again later" errors
+   (EAGAIN/EWOULDBLOCK, or ENOBUFS from a full device queue) come back
+   as -errno instead of being thrown, so backpressure stays off the
+   exception path */
+inline int NonBlockingSystemCall( const char * s_attempt, const int return_value )
+{
+  if ( return_value >= 0 ) {
+    return return_value;
+  }
+
+  if ( errno == EAGAIN or errno == EWOULDBLOCK or errno == ENOBUFS ) {
+    return -errno;
+  }
+
+  throw unix_error( s_attempt );
+}
+
 /* zero out an arbitrary structure */
 template <typename T> void zero( T & x ) { memset( &x, 0, sizeof( x ) ); }
 